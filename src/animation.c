@@ -0,0 +1,240 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <animation.h>
+#include <rendering.h>
+#include <kernel.h>
+#include <perturbation.h>
+#include <imagefile.h>
+#include <costmap.h>
+#include <log.h>
+
+
+typedef struct {
+  t_thread_pool*        p_pool;
+  const t_batch_options* p_options;
+  int                   frames_per_octave;
+  int                   nr_frames;
+  t_ref_orbit*          p_orbit;        /*!< orbit of the center shared by all frames */
+  t_parman_data**       p_octave;       /*!< central quarter of the last frames_per_octave frames */
+  long                  nr_reused;      /*!< pixels taken from the frame one octave earlier */
+} t_animation;
+
+
+/*
+ * The width is halved exactly every frames_per_octave frames, so that
+ * frames one octave apart share their pixel lattice.
+ */
+long double get_zoom_width( const long double width, const int k, const int frames_per_octave )
+{
+  const int n = frames_per_octave;
+
+  return ldexpl( width * exp2l( -(long double)( k % n ) / n ), -( k / n ) );
+}
+
+int get_nr_zoom_frames( const long double width, const long double end_width, const int frames_per_octave )
+{
+  const int n = 1 + (int)ceill( frames_per_octave * log2l( width / end_width ) - 1e-9L );
+
+  return ( n > 1 ) ? n : 1;
+}
+
+int write_zoom_frame( const t_batch_options* p_options, const int k, const t_parman_data* p_frame )
+{
+  t_image_file* p_file;
+  char path[ 4096 ];
+  int retcode;
+
+  if( strcmp( p_options->path, "-" ) )
+    snprintf( path, sizeof( path ), p_options->path, k );
+  else
+    strcpy( path, "-" );
+
+  p_file = create_image_file( path, p_options->format, p_frame->res_x, p_frame->res_y );
+  if( p_file == NULL )
+    return -1;
+
+  if( p_options->format == IMAGE_FORMAT_TIFF )
+    retcode = write_image_chunk( p_file, p_frame, 0, 0 );
+  else
+    retcode = write_image_band( p_file, p_frame );
+  if( ! retcode )
+    retcode = finish_image_file( p_file );
+  release_image_file( p_file );
+
+  return retcode;
+}
+
+static long double get_frame_width( const t_animation* p, const int k )
+{
+  return get_zoom_width( p->p_options->width, k, p->frames_per_octave );
+}
+
+static t_parman_job* start_frame( t_animation* p, const int k )
+{
+  const t_batch_options* p_options = p->p_options;
+  const long double width = get_frame_width( p, k );
+  const long double height = width * p_options->res_y / p_options->res_x;
+  const t_parman_data* p_octave = p->p_octave[ k % p->frames_per_octave ];
+  t_bigfix min_x, min_y;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+  int stop = 0;
+
+  bigfix_add_ld( & min_x, & p_options->center_x, -width / 2 );
+  bigfix_add_ld( & min_y, & p_options->center_y, -height / 2 );
+
+  p_data = create_parman_data_hp( p_options->res_x, p_options->res_y, & min_x, & min_y, width, height,
+                                  p_options->iterations );
+  if( p_data == NULL )
+    return NULL;
+
+  if( p_data->precision == PARMAN_PRECISION_AUTO )
+    p_data->precision = select_precision( p_data );
+
+  if( is_perturbation( p_data->precision ) ) {
+    if( p->p_orbit == NULL ) {
+      p->p_orbit = create_ref_orbit( & p_options->center_x, & p_options->center_y, p_options->iterations, & stop );
+      if( p->p_orbit == NULL ) {
+        release_parman_data( p_data );
+        return NULL;
+      }
+      log_message("shared reference orbit with %d of %d iterations from frame %d on\n",
+                  p->p_orbit->length, p_options->iterations, k );
+    }
+
+    p_data->p_orbit = share_ref_orbit( p->p_orbit );
+    if( p_data->p_orbit == NULL ) {
+      release_parman_data( p_data );
+      return NULL;
+    }
+  }
+
+  if( p_octave )
+    p->nr_reused += reuse_coarser_pixels( p_data, p_octave );
+
+  p_job = start_rendering( p_data, p->p_pool );
+  if( p_job == NULL )
+    release_parman_data( p_data );
+
+  return p_job;
+}
+
+/*
+ * write frame k and keep its central quarter for frame k + frames_per_octave
+ */
+static int finish_frame( t_animation* p, const int k, t_parman_job* p_job )
+{
+  const t_parman_data* p_data = get_image_data( p_job );
+  t_parman_data** pp_octave = & p->p_octave[ k % p->frames_per_octave ];
+  const int retcode = write_zoom_frame( p->p_options, k, p_data );
+
+  if( p->p_options->cost_map_path )
+    write_cost_map( p_data, p->p_options->cost_map_path );
+
+  release_parman_data( *pp_octave );
+  *pp_octave = NULL;
+  if( p_data->res_x % 4 == 0 && p_data->res_y % 4 == 0 )
+    *pp_octave = copy_parman_rect( p_data, p_data->res_x / 4, p_data->res_y / 4,
+                                   p_data->res_x / 2, p_data->res_y / 2 );
+
+  log_message("frame %d of %d: width %Lg, %s kernel\n", k + 1, p->nr_frames, get_frame_width( p, k ),
+              precision_name( p_data->precision ) );
+
+  return retcode;
+}
+
+int start_animation( t_thread_pool* p_pool, const t_batch_options* p_options,
+                     const long double end_width, const int frames_per_octave )
+{
+  const t_parman_options saved_options = *get_parman_options();
+  t_parman_options options = saved_options;
+  t_animation anim;
+  t_parman_job** p_ring;
+  long frame_bytes, window;
+  int started, written, i, retcode = 0;
+
+  memset( & anim, 0, sizeof( anim ) );
+  anim.p_pool = p_pool;
+  anim.p_options = p_options;
+  anim.frames_per_octave = frames_per_octave;
+  anim.nr_frames = get_nr_zoom_frames( p_options->width, end_width, frames_per_octave );
+
+  /* every frame is rendered once, previews and caching do not pay off */
+  options.progressive = 0;
+  options.p_tile_cache = NULL;
+  options.p_palette = NULL;
+  if( p_options->format != IMAGE_FORMAT_RAW ) {
+    options.p_palette = get_palette( p_options->palette );
+    if( options.p_palette == NULL )
+      return -1;
+  }
+
+  frame_bytes = (long)p_options->res_x * p_options->res_y
+    * ( sizeof( int ) + ( options.p_palette ? sizeof( t_argb ) : 0 ) + ( options.smooth ? sizeof( float ) : 0 ) );
+  window = p_options->band_budget / frame_bytes;
+  if( window < 1 )
+    window = 1;
+  /* the frame one octave earlier must be finished before a frame starts */
+  if( window > frames_per_octave )
+    window = frames_per_octave;
+  if( window > anim.nr_frames )
+    window = anim.nr_frames;
+
+  anim.p_octave = calloc( frames_per_octave, sizeof( t_parman_data* ) );
+  p_ring = malloc( window * sizeof( t_parman_job* ) );
+  if( anim.p_octave == NULL || p_ring == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( anim.p_octave );
+    free( p_ring );
+    return -1;
+  }
+
+  set_parman_options( & options );
+  log_message("rendering %d frames of %dx%d pixels, %d per octave, %ld in flight, to %s\n", anim.nr_frames,
+              p_options->res_x, p_options->res_y, frames_per_octave, window, p_options->path );
+
+  for( started = written = 0; written < anim.nr_frames && ! retcode; ) {
+    if( started < anim.nr_frames && started - written < window ) {
+      p_ring[ started % window ] = start_frame( & anim, started );
+      if( p_ring[ started % window ] == NULL )
+        retcode = -1;
+      else
+        ++started;
+      continue;
+    }
+
+    /* a broken frame is neither written nor kept for the next octave */
+    if( wait_rendering( p_ring[ written % window ] ) ) {
+      log_error("%s,%d: rendering of frame %d failed!\n", __func__, __LINE__, written );
+      retcode = -1;
+    }
+    else
+      retcode = finish_frame( & anim, written, p_ring[ written % window ] );
+    release_image( p_ring[ written % window ] );
+    ++written;
+  }
+
+  for( ; written < started; ++written )
+    release_image( p_ring[ written % window ] );
+
+  if( ! retcode )
+    log_message("%ld pixels taken from frames one octave earlier\n", anim.nr_reused );
+
+  for( i=0; i < frames_per_octave; ++i )
+    release_parman_data( anim.p_octave[i] );
+  free( anim.p_octave );
+  free( p_ring );
+  release_ref_orbit( anim.p_orbit );
+  set_parman_options( & saved_options );
+
+  return retcode;
+}
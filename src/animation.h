@@ -0,0 +1,69 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <scheduler.h>
+#include <batch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file animation.h
+    \brief rendering of zoom sequences
+
+    The frames of a zoom into the center of a view shrink by the same
+    factor from one frame to the next, so that the width halves every
+    frames_per_octave frames. All frames share the reference orbit of
+    the center when they need perturbation. A frame covers exactly the
+    central half of the frame one octave earlier, whose pixels fall onto
+    the even rows and columns of the new frame, so only three quarters
+    of its pixels are iterated.
+
+    Several frames are rendered at once, bounded by the memory budget,
+    while finished frames are colored, compressed and written in order.
+ */
+
+
+/*!
+ * \return width of frame k of a zoom which halves the width every
+ * frames_per_octave frames
+ */
+long double get_zoom_width( const long double width, const int k, const int frames_per_octave );
+
+/*!
+ * \return number of frames of a zoom from width down to end_width
+ */
+int get_nr_zoom_frames( const long double width, const long double end_width, const int frames_per_octave );
+
+/*!
+ * write the colored image of frame k to the file given by the pattern of
+ * the batch options
+ *
+ * \return 0 on success, -1 on error
+ */
+int write_zoom_frame( const t_batch_options* p_options, const int k, const t_parman_data* p_frame );
+
+/*!
+ * render the zoom from the view of the batch options to the given end
+ * width, the path of the batch options is a printf pattern for the
+ * frame number such as zoom%05d.png or - for a stream of images on the
+ * standard output
+ *
+ * \return 0 on success, -1 on error
+ */
+int start_animation( t_thread_pool* p_pool, const t_batch_options* p_options,
+                     const long double end_width, const int frames_per_octave );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef ANIMATION_H */
@@ -0,0 +1,446 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <batch.h>
+#include <rendering.h>
+#include <kernel.h>
+#include <perturbation.h>
+#include <gridfile.h>
+#include <cluster.h>
+#include <log.h>
+
+/* edge length of the chunks of a tiled image, a multiple of TIFF_TILE_SIZE */
+#define BATCH_CHUNK_SIZE      ( 2 * TIFF_TILE_SIZE )
+
+/*
+ * The chunk covers the image columns [x0, x0 + w) and rows [y0, y0 + h)
+ * from the top. Image row r lies at init_y + (r + 1) * step_y, so the
+ * chunk origin is shifted by exact multiples of the step. Perturbation
+ * chunks are rendered relative to the orbit and series of the whole
+ * view, which is set up with the first one and returned in pp_orbit.
+ */
+static t_parman_job* start_chunk( t_thread_pool* p_pool, const t_bigfix* min_x, const t_bigfix* min_y,
+                                  const long double step_x, const long double step_y,
+                                  const t_batch_options* p_options, const int x0, const int y0,
+                                  const int w, const int h, t_ref_orbit** pp_orbit )
+{
+  t_bigfix step, chunk_x, chunk_y;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+  volatile int stop = 0;
+
+  bigfix_from_ld( & step, step_x );
+  bigfix_mul_int( & chunk_x, & step, x0 );
+  bigfix_add( & chunk_x, & chunk_x, min_x );
+
+  bigfix_from_ld( & step, step_y );
+  bigfix_mul_int( & chunk_y, & step, y0 );
+  bigfix_add( & chunk_y, & chunk_y, min_y );
+
+  p_data = create_parman_data_hp( w, h, & chunk_x, & chunk_y, w * step_x, h * step_y, p_options->iterations );
+  if( p_data == NULL )
+    return NULL;
+  p_data->step_x = step_x;
+  p_data->step_y = step_y;
+
+  if( is_perturbation( p_data->precision ) ) {
+    if( *pp_orbit == NULL )
+      *pp_orbit = create_view_orbit( min_x, min_y, step_x, step_y, p_options->res_x, p_options->res_y,
+                                     p_options->iterations, & stop );
+    if( *pp_orbit == NULL || attach_view_orbit( p_data, *pp_orbit ) ) {
+      release_parman_data( p_data );
+      return NULL;
+    }
+  }
+
+  p_job = start_rendering( p_data, p_pool );
+  if( p_job == NULL )
+    release_parman_data( p_data );
+
+  return p_job;
+}
+
+/* bytes per pixel for grid, image and fractional counts */
+static long get_pixel_bytes( const t_parman_options* p_render )
+{
+  return sizeof( int ) + ( p_render->p_palette ? sizeof( t_argb ) : 0 )
+    + ( p_render->smooth ? sizeof( float ) : 0 );
+}
+
+/*
+ * band height from the memory budget for two bands, in whole tiles
+ */
+static int get_band_rows( const t_batch_options* p_options, const t_parman_options* p_render )
+{
+  long rows = p_options->band_budget / ( 2 * get_pixel_bytes( p_render ) * p_options->res_x );
+
+  rows -= rows % TILE_SIZE;
+  if( rows < TILE_SIZE )
+    rows = TILE_SIZE;
+  if( rows > p_options->res_y )
+    rows = p_options->res_y;
+
+  return (int)rows;
+}
+
+/*
+ * Bands are written while the next one is rendered.
+ */
+static int render_bands( t_thread_pool* p_pool, t_image_file* p_file, const t_bigfix* min_x,
+                         const t_bigfix* min_y, const long double step_x, const long double step_y,
+                         const t_batch_options* p_options, const t_parman_options* p_render )
+{
+  const int rows = get_band_rows( p_options, p_render );
+  t_parman_job *p_job, *p_next;
+  t_ref_orbit* p_orbit = NULL;
+  int r0, retcode = 0;
+
+  log_message("rendering %dx%d pixels in bands of %d rows to %s\n", p_options->res_x, p_options->res_y,
+              rows, p_options->path );
+
+  p_next = start_chunk( p_pool, min_x, min_y, step_x, step_y, p_options, 0, 0, p_options->res_x, rows,
+                        & p_orbit );
+  if( p_next == NULL )
+    retcode = -1;
+
+  for( r0 = 0; r0 < p_options->res_y && ! retcode; r0 += rows ) {
+    p_job = p_next;
+    p_next = NULL;
+
+    /* the next band is rendered while this one is written */
+    if( r0 + rows < p_options->res_y ) {
+      p_next = start_chunk( p_pool, min_x, min_y, step_x, step_y, p_options, 0, r0 + rows, p_options->res_x,
+                            ( r0 + 2 * rows <= p_options->res_y ) ? rows : p_options->res_y - r0 - rows,
+                            & p_orbit );
+      if( p_next == NULL )
+        retcode = -1;
+    }
+
+    if( wait_rendering( p_job ) && ! retcode ) {
+      log_error("%s,%d: rendering of the band at row %d failed!\n", __func__, __LINE__, r0 );
+      retcode = -1;
+    }
+    if( ! retcode )
+      retcode = write_image_band( p_file, get_image_data( p_job ) );
+    release_image( p_job );
+  }
+
+  if( p_next )
+    release_image( p_next );
+  release_ref_orbit( p_orbit );
+
+  return retcode;
+}
+
+/*
+ * Chunks of BATCH_CHUNK_SIZE pixels are started in raster order and
+ * written in the same order as soon as the oldest one is complete. The
+ * number of chunks in flight is bounded by the memory budget, so the
+ * image may be far larger than the main memory.
+ */
+static int render_chunks( t_thread_pool* p_pool, t_image_file* p_file, const t_bigfix* min_x,
+                          const t_bigfix* min_y, const long double step_x, const long double step_y,
+                          const t_batch_options* p_options, const t_parman_options* p_render )
+{
+  const int across = ( p_options->res_x + BATCH_CHUNK_SIZE - 1 ) / BATCH_CHUNK_SIZE;
+  const long nr_chunks = (long)across * ( ( p_options->res_y + BATCH_CHUNK_SIZE - 1 ) / BATCH_CHUNK_SIZE );
+  long window = p_options->band_budget / ( get_pixel_bytes( p_render ) * BATCH_CHUNK_SIZE * BATCH_CHUNK_SIZE );
+  t_parman_job** p_ring;
+  t_ref_orbit* p_orbit = NULL;
+  long started, written;
+  int x0, y0, retcode = 0;
+
+  if( window < 1 )
+    window = 1;
+  if( window > nr_chunks )
+    window = nr_chunks;
+
+  p_ring = malloc( window * sizeof( t_parman_job* ) );
+  if( p_ring == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  log_message("rendering %dx%d pixels in %ld chunks of %dx%d pixels, %ld in flight, to %s\n",
+              p_options->res_x, p_options->res_y, nr_chunks, BATCH_CHUNK_SIZE, BATCH_CHUNK_SIZE,
+              window, p_options->path );
+
+  for( started = written = 0; written < nr_chunks && ! retcode; ) {
+    if( started < nr_chunks && started - written < window ) {
+      x0 = ( started % across ) * BATCH_CHUNK_SIZE;
+      y0 = ( started / across ) * BATCH_CHUNK_SIZE;
+      p_ring[ started % window ] = start_chunk( p_pool, min_x, min_y, step_x, step_y, p_options, x0, y0,
+                                                ( x0 + BATCH_CHUNK_SIZE <= p_options->res_x ) ? BATCH_CHUNK_SIZE : p_options->res_x - x0,
+                                                ( y0 + BATCH_CHUNK_SIZE <= p_options->res_y ) ? BATCH_CHUNK_SIZE : p_options->res_y - y0,
+                                                & p_orbit );
+      if( p_ring[ started % window ] == NULL )
+        retcode = -1;
+      else
+        ++started;
+      continue;
+    }
+
+    x0 = ( written % across ) * BATCH_CHUNK_SIZE;
+    y0 = ( written / across ) * BATCH_CHUNK_SIZE;
+    if( wait_rendering( p_ring[ written % window ] ) ) {
+      log_error("%s,%d: rendering of the chunk at %d,%d failed!\n", __func__, __LINE__, x0, y0 );
+      retcode = -1;
+    }
+    else
+      retcode = write_image_chunk( p_file, get_image_data( p_ring[ written % window ] ), x0, y0 );
+    release_image( p_ring[ written % window ] );
+    ++written;
+  }
+
+  for( ; written < started; ++written )
+    release_image( p_ring[ written % window ] );
+  free( p_ring );
+  release_ref_orbit( p_orbit );
+
+  return retcode;
+}
+
+/*
+ * The image is colored band by band from the grid, whose rows of a band
+ * are contiguous in reverse order.
+ */
+static int write_grid_image( const t_parman_data* p, const t_batch_options* p_options,
+                             const t_palette* p_palette )
+{
+  t_parman_data band;
+  t_image_file* p_file;
+  long rows;
+  int r0, y, retcode = 0;
+
+  rows = p_options->band_budget / ( sizeof( t_argb ) * p->res_x );
+  rows -= rows % TIFF_TILE_SIZE;
+  if( rows < TIFF_TILE_SIZE )
+    rows = TIFF_TILE_SIZE;
+  if( rows > p->res_y )
+    rows = p->res_y;
+
+  memset( & band, 0, sizeof( band ) );
+  band.res_x = p->res_x;
+  band.iterations = p->iterations;
+  if( p_palette ) {
+    band.image = malloc( sizeof( t_argb ) * p->res_x * rows );
+    if( band.image == NULL ) {
+      log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+      return -1;
+    }
+  }
+
+  p_file = create_image_file( p_options->path, p_options->format, p->res_x, p->res_y );
+  if( p_file == NULL ) {
+    free( band.image );
+    return -1;
+  }
+
+  for( r0 = 0; r0 < p->res_y && ! retcode; r0 += rows ) {
+    band.res_y = ( r0 + rows <= p->res_y ) ? rows : p->res_y - r0;
+    band.grid = & p->grid[ (long)( p->res_y - r0 - band.res_y ) * p->res_x ];
+
+    for( y = 0; p_palette && y < band.res_y; ++y ) {
+      if( p->smooth_grid )
+        colorize_smooth_span( p_palette, p->iterations, & p->smooth_grid[ (long)( p->res_y - 1 - r0 - y ) * p->res_x ],
+                              & band.image[ (long)y * p->res_x ], p->res_x );
+      else
+        colorize_span( p_palette, p->iterations, & p->grid[ (long)( p->res_y - 1 - r0 - y ) * p->res_x ],
+                       & band.image[ (long)y * p->res_x ], p->res_x );
+    }
+
+    if( p_options->format == IMAGE_FORMAT_TIFF )
+      retcode = write_image_chunk( p_file, & band, 0, r0 );
+    else
+      retcode = write_image_band( p_file, & band );
+  }
+
+  if( ! retcode )
+    retcode = finish_image_file( p_file );
+  release_image_file( p_file );
+  free( band.image );
+
+  return retcode;
+}
+
+/*
+ * The whole grid is rendered into the mapped file, tiles completed by
+ * an earlier run of the same view are skipped. Without a grid file the
+ * grid is held in memory, which is needed for rendering on workers.
+ */
+static int render_grid_file( t_thread_pool* p_pool, const t_bigfix* min_x, const t_bigfix* min_y,
+                             const long double step_x, const long double step_y,
+                             const t_batch_options* p_options, const t_parman_options* p_render,
+                             const t_palette* p_palette )
+{
+  t_grid_file* p_grid = NULL;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+  long saved;
+  int retcode = 0;
+
+  if( p_options->grid_path ) {
+    p_grid = open_grid_file( p_options->grid_path, p_options->res_x, p_options->res_y, min_x, min_y,
+                             step_x, step_y, p_options->iterations, p_render->smooth, p_render->precision,
+                             p_render->interior_checks, p_render->subdivide );
+    if( p_grid == NULL )
+      return -1;
+
+    p_data = create_parman_data_file( p_grid );
+    if( p_data == NULL )
+      return -1;
+
+    log_message("rendering %dx%d pixels to grid file %s, %ld of %ld tiles done before\n",
+                p_options->res_x, p_options->res_y, p_options->grid_path,
+                count_saved_tiles( p_grid ), (long)p_grid->p_header->nr_tiles );
+  }
+  else {
+    p_data = create_parman_data_hp( p_options->res_x, p_options->res_y, min_x, min_y,
+                                    p_options->res_x * step_x, p_options->res_y * step_y, p_options->iterations );
+    if( p_data == NULL )
+      return -1;
+  }
+
+  if( p_options->workers ) {
+    retcode = render_on_workers( p_data, p_options->workers, p_pool );
+  }
+  else {
+    p_job = start_rendering( p_data, p_pool );
+    if( p_job == NULL ) {
+      release_parman_data( p_data );
+      return -1;
+    }
+    wait_rendering( p_job );
+    release_rendering( p_job );
+  }
+
+  if( p_grid && ! retcode ) {
+    saved = count_saved_tiles( p_grid );
+    if( saved != (long)p_grid->p_header->nr_tiles ) {
+      log_error("%s,%d: only %ld of %ld tiles have been rendered!\n", __func__, __LINE__,
+                saved, (long)p_grid->p_header->nr_tiles );
+      retcode = -1;
+    }
+
+    if( ! retcode )
+      retcode = sync_grid_file( p_grid );
+  }
+  if( ! retcode )
+    retcode = write_grid_image( p_data, p_options, p_palette );
+
+  release_parman_data( p_data );
+  return retcode;
+}
+
+/*
+ * The view, resolution and iteration depth come from the grid file.
+ */
+static int color_grid_file( const t_batch_options* p_options )
+{
+  const t_palette* p_palette = NULL;
+  t_grid_file* p_grid;
+  t_parman_data* p_data;
+  char re[64], im[64];
+  int retcode;
+
+  if( p_options->format != IMAGE_FORMAT_RAW ) {
+    p_palette = get_palette( p_options->palette );
+    if( p_palette == NULL )
+      return -1;
+  }
+
+  p_grid = load_grid_file( p_options->load_path );
+  if( p_grid == NULL )
+    return -1;
+
+  p_data = create_parman_data_file( p_grid );
+  if( p_data == NULL )
+    return -1;
+
+  log_message("grid file %s: %dx%d pixels from %s, %s with step %Lg, %d iterations, %ld of %ld tiles rendered\n",
+              p_options->load_path, p_data->res_x, p_data->res_y,
+              bigfix_to_string( re, sizeof( re ), & p_data->hp_x, 40 ),
+              bigfix_to_string( im, sizeof( im ), & p_data->hp_y, 40 ), p_data->step_x, p_data->iterations,
+              count_saved_tiles( p_grid ), (long)p_grid->p_header->nr_tiles );
+
+  retcode = write_grid_image( p_data, p_options, p_palette );
+  release_parman_data( p_data );
+
+  return retcode;
+}
+
+int start_batch( t_thread_pool* p_pool, const t_batch_options* p_options )
+{
+  const t_parman_options saved_options = *get_parman_options();
+  t_parman_options options = saved_options;
+  const long double height = p_options->width * p_options->res_y / p_options->res_x;
+  const long double step_x = p_options->width / p_options->res_x;
+  const long double step_y = height / p_options->res_y;
+  t_parman_data view;
+  t_bigfix min_x, min_y;
+  const t_palette* p_palette = NULL;
+  t_image_file* p_file;
+  int retcode;
+
+  if( p_options->load_path )
+    return color_grid_file( p_options );
+
+  bigfix_add_ld( & min_x, & p_options->center_x, -p_options->width / 2 );
+  bigfix_add_ld( & min_y, & p_options->center_y, -height / 2 );
+
+  /* one kernel for all bands, chosen for the whole view */
+  if( options.precision == PARMAN_PRECISION_AUTO ) {
+    memset( & view, 0, sizeof( view ) );
+    view.res_x = p_options->res_x;
+    view.res_y = p_options->res_y;
+    view.init_x = bigfix_to_ld( & min_x );
+    view.init_y = bigfix_to_ld( & min_y );
+    view.step_x = step_x;
+    view.step_y = step_y;
+    options.precision = select_precision( & view );
+  }
+
+  /* every band is rendered once, previews and caching do not pay off */
+  options.progressive = 0;
+  options.p_tile_cache = NULL;
+  if( p_options->format != IMAGE_FORMAT_RAW ) {
+    p_palette = get_palette( p_options->palette );
+    if( p_palette == NULL )
+      return -1;
+  }
+
+  /* a whole grid is colored after rendering */
+  options.p_palette = ( p_options->grid_path || p_options->workers ) ? NULL : p_palette;
+  set_parman_options( & options );
+
+  if( p_options->grid_path || p_options->workers ) {
+    retcode = render_grid_file( p_pool, & min_x, & min_y, step_x, step_y, p_options, & options, p_palette );
+    set_parman_options( & saved_options );
+    return retcode;
+  }
+
+  p_file = create_image_file( p_options->path, p_options->format, p_options->res_x, p_options->res_y );
+  if( p_file == NULL ) {
+    set_parman_options( & saved_options );
+    return -1;
+  }
+
+  if( p_options->format == IMAGE_FORMAT_TIFF )
+    retcode = render_chunks( p_pool, p_file, & min_x, & min_y, step_x, step_y, p_options, & options );
+  else
+    retcode = render_bands( p_pool, p_file, & min_x, & min_y, step_x, step_y, p_options, & options );
+
+  if( ! retcode )
+    retcode = finish_image_file( p_file );
+  release_image_file( p_file );
+  set_parman_options( & saved_options );
+
+  return retcode;
+}
@@ -0,0 +1,68 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <scheduler.h>
+#include <bignum.h>
+#include <imagefile.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file batch.h
+    \brief rendering of image files without a window
+
+    The image is rendered in bands of rows which are written as soon as
+    they are complete, while the next band is already being rendered.
+    Only two bands are held in memory, whatever the size of the image.
+    Tiled TIFF files are rendered in square chunks instead, as many in
+    flight as the memory budget allows, so that even the width of the
+    image is not limited by the main memory.
+
+    Long renderings can go through a grid file instead, which holds the
+    iteration counts of the whole image and is resumed after a crash.
+    The image is colored from the grid file once it is complete, and a
+    grid file can be colored again without rendering. With worker
+    processes the whole grid is rendered by them, in memory or through a
+    grid file, and colored afterwards.
+ */
+
+typedef struct {
+  const char*           path;
+  t_image_format        format;
+  t_bigfix              center_x;       /*!< center of the view at full precision */
+  t_bigfix              center_y;
+  long double           width;          /*!< extent of the view along the real axis */
+  int                   res_x;
+  int                   res_y;
+  int                   iterations;
+  int                   palette;        /*!< index of the built in palette */
+  long                  band_budget;    /*!< bytes for the bands or chunks in flight */
+  const char*           grid_path;      /*!< render into or resume this grid file or NULL */
+  const char*           load_path;      /*!< color this grid file instead of the view or NULL */
+  const char*           workers;        /*!< comma separated worker addresses or NULL */
+  const char*           cost_map_path;  /*!< cost map of every completed zoom frame or NULL */
+} t_batch_options;
+
+
+/*!
+ * render the image described by the options with the current rendering
+ * options to a file
+ *
+ * \return 0 on success, -1 on error
+ */
+int start_batch( t_thread_pool* p_pool, const t_batch_options* p_options );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef BATCH_H */
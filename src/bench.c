@@ -0,0 +1,467 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+/*
+ * Benchmark of the rendering kernels and of the thread pool
+ *
+ * A fixed catalogue of views is rendered at several iteration depths
+ * with each of several thread counts. Every rendering is repeated and
+ * timed from start_rendering() to wait_rendering(), the best run
+ * counts. The results are written as JSON, one record per view, depth
+ * and thread count: wall time, pixels and iterations per second, the
+ * busy time of each worker and the scaling efficiency relative to the
+ * single threaded run. Iterations are those actually executed by the
+ * workers, pixels resolved by the interior checks or filled by
+ * subdivision add none; the number of pixels resolved by the checks is
+ * given separately.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <rendering.h>
+#include <kernel.h>
+#include <scheduler.h>
+#include <stats.h>
+#include <bignum.h>
+#include <log.h>
+
+#define BENCH_RES_X           1024
+#define BENCH_RES_Y           768
+#define BENCH_REPEAT          3
+
+/* iteration depths per view and thread counts per invocation */
+#define MAX_DEPTHS            4
+#define MAX_THREAD_COUNTS     16
+
+
+typedef struct {
+  const char*           name;
+  const char*           center_x;
+  const char*           center_y;
+  long double           width;
+  int                   iterations[ MAX_DEPTHS ];       /*!< terminated by 0 */
+} t_bench_view;
+
+static const t_bench_view bench_views[] = {
+  { "full-set", "-0.75", "0", 3.0L, { 1000, 10000 } },
+  { "seahorse-valley", "-0.743643887037158704752191506114774", "0.131825904205311970493132056385139",
+    1e-3L, { 1000, 10000 } },
+  /* period 28 minibrot on the real axis, perturbation engine */
+  { "deep-minibrot", "-1.99990000007152185767870547109203598741826476059598", "0",
+    2.5e-20L, { 10000, 50000 } },
+  /* within the period 3 bulb, resolved by periodicity detection */
+  { "all-interior", "-0.1226", "0.7449", 0.05L, { 1000, 10000 } },
+  { "all-exterior", "1", "1", 0.5L, { 1000, 10000 } }
+};
+
+#define NR_BENCH_VIEWS        ( sizeof( bench_views ) / sizeof( bench_views[0] ) )
+
+
+typedef struct {
+  const t_bench_view*   p_view;
+  int                   iterations;
+  int                   nr_threads;
+  const char*           kernel;
+  double                wall_s;         /*!< best of all repetitions */
+  double                median_s;
+  long                  nr_pixels;
+  long long             nr_iterations;  /*!< executed during the best repetition */
+  long                  nr_shortcut_pixels;     /*!< resolved by the interior checks */
+  double*               busy_s;         /*!< per worker during the best repetition */
+  long                  nr_steals;      /*!< tiles taken from other workers, best repetition */
+  double                efficiency;     /*!< negative without single threaded run */
+} t_bench_run;
+
+
+static double get_seconds( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int compare_doubles( const void* a, const void* b )
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+
+  return ( x > y ) - ( x < y );
+}
+
+static int run_view( t_thread_pool* p_pool, t_bench_run* r, const int res_x, const int res_y, const int repeat )
+{
+  const t_bench_view* v = r->p_view;
+  const long double height = v->width * res_y / res_x;
+  t_bigfix min_x, min_y;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+  t_pool_stats* p_stats;
+  double *times, start, seconds;
+  int k, w, retcode = 0;
+
+  if( bigfix_from_string( & min_x, v->center_x ) || bigfix_from_string( & min_y, v->center_y ) ) {
+    log_error("%s,%d: invalid center of view %s!\n", __func__, __LINE__, v->name );
+    return -1;
+  }
+  bigfix_add_ld( & min_x, & min_x, -v->width / 2 );
+  bigfix_add_ld( & min_y, & min_y, -height / 2 );
+
+  r->busy_s = calloc( p_pool->nr_threads, sizeof( double ) );
+  p_stats = create_pool_stats( p_pool );
+  times = malloc( repeat * sizeof( double ) );
+  if( r->busy_s == NULL || p_stats == NULL || times == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_pool_stats( p_stats );
+    free( times );
+    return -1;
+  }
+
+  for( k=0; k < repeat && ! retcode; ++k ) {
+    p_data = create_parman_data_hp( res_x, res_y, & min_x, & min_y, v->width, height, r->iterations );
+    if( p_data == NULL ) {
+      retcode = -1;
+      break;
+    }
+
+    reset_pool_stats( p_stats, p_pool );
+    start = get_seconds();
+    p_job = start_rendering( p_data, p_pool );
+    if( p_job == NULL ) {
+      release_parman_data( p_data );
+      retcode = -1;
+      break;
+    }
+    if( wait_rendering( p_job ) )
+      retcode = -1;
+    seconds = get_seconds() - start;
+    update_pool_stats( p_stats, p_pool );
+    release_rendering( p_job );
+    if( retcode ) {
+      log_error("%s,%d: rendering of view %s failed!\n", __func__, __LINE__, v->name );
+      release_parman_data( p_data );
+      break;
+    }
+
+    if( k == 0 || seconds < r->wall_s ) {
+      r->wall_s = seconds;
+      r->nr_iterations = p_stats->total.iterations;
+      r->nr_steals = p_stats->total.steals;
+      for( w=0; w < p_pool->nr_threads; ++w )
+        r->busy_s[w] = 1e-9 * p_stats->worker[w].busy_ns;
+    }
+    times[k] = seconds;
+
+    if( k == 0 ) {
+      r->kernel = precision_name( p_data->precision );
+      r->nr_pixels = (long)res_x * res_y;
+      r->nr_shortcut_pixels = p_data->nr_bulb_pixels + p_data->nr_periodic_pixels;
+    }
+    release_parman_data( p_data );
+  }
+
+  if( ! retcode ) {
+    qsort( times, repeat, sizeof( double ), compare_doubles );
+    r->median_s = times[ repeat / 2 ];
+  }
+  release_pool_stats( p_stats );
+  free( times );
+  if( retcode )
+    return -1;
+
+  log_message("%-16s %6d iterations %3d threads %-18s %9.4f s %9.2f Mpixel/s %7.3f Giteration/s\n",
+              v->name, r->iterations, r->nr_threads, r->kernel, r->wall_s,
+              1e-6 * r->nr_pixels / r->wall_s, 1e-9 * r->nr_iterations / r->wall_s );
+
+  return 0;
+}
+
+/* efficiency of every run relative to the single threaded run of the same view and depth */
+static void set_efficiencies( t_bench_run* runs, const int nr_runs )
+{
+  int i, j;
+
+  for( i=0; i < nr_runs; ++i ) {
+    runs[i].efficiency = -1;
+    for( j=0; j < nr_runs; ++j ) {
+      if( runs[j].nr_threads == 1 && runs[j].p_view == runs[i].p_view && runs[j].iterations == runs[i].iterations )
+        runs[i].efficiency = runs[j].wall_s / ( runs[i].nr_threads * runs[i].wall_s );
+    }
+  }
+}
+
+static void write_json( FILE* fp, const t_bench_run* runs, const int nr_runs, const int res_x, const int res_y,
+                        const int repeat )
+{
+  const t_parman_options* p_options = get_parman_options();
+  const t_bench_run* r;
+  int i, w;
+
+  fprintf( fp, "{\n" );
+  fprintf( fp, "  \"benchmark\": \"parmandel\",\n" );
+  fprintf( fp, "  \"version\": 1,\n" );
+  fprintf( fp, "  \"processors\": %ld,\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+  fprintf( fp, "  \"resolution\": [ %d, %d ],\n", res_x, res_y );
+  fprintf( fp, "  \"repeat\": %d,\n", repeat );
+  fprintf( fp, "  \"precision\": \"%s\",\n",
+           p_options->precision == PARMAN_PRECISION_AUTO ? "auto" : precision_name( p_options->precision ) );
+  fprintf( fp, "  \"interior_checks\": %s,\n", p_options->interior_checks ? "true" : "false" );
+  fprintf( fp, "  \"runs\": [\n" );
+
+  for( i=0; i < nr_runs; ++i ) {
+    r = & runs[i];
+    fprintf( fp, "    { \"view\": \"%s\", \"iterations\": %d, \"threads\": %d, \"kernel\": \"%s\",\n",
+             r->p_view->name, r->iterations, r->nr_threads, r->kernel );
+    fprintf( fp, "      \"wall_s\": %.6f, \"median_s\": %.6f, \"mpixels_per_s\": %.3f, \"giterations_per_s\": %.4f,\n",
+             r->wall_s, r->median_s, 1e-6 * r->nr_pixels / r->wall_s, 1e-9 * r->nr_iterations / r->wall_s );
+    fprintf( fp, "      \"pixels\": %ld, \"shortcut_pixels\": %ld, \"total_iterations\": %lld, \"steals\": %ld,\n"
+             "      \"busy_s\": [", r->nr_pixels, r->nr_shortcut_pixels, r->nr_iterations, r->nr_steals );
+    for( w=0; w < r->nr_threads; ++w )
+      fprintf( fp, "%s %.6f", w ? "," : "", r->busy_s[w] );
+    if( r->efficiency >= 0 )
+      fprintf( fp, " ],\n      \"efficiency\": %.4f }%s\n", r->efficiency, i + 1 < nr_runs ? "," : "" );
+    else
+      fprintf( fp, " ],\n      \"efficiency\": null }%s\n", i + 1 < nr_runs ? "," : "" );
+  }
+
+  fprintf( fp, "  ]\n}\n" );
+}
+
+/* \return number of thread counts in a comma separated list or -1 on error */
+static int parse_thread_counts( const char* list, int* counts )
+{
+  const char* s = list;
+  char* end;
+  int n = 0;
+
+  while( *s && n < MAX_THREAD_COUNTS ) {
+    counts[ n ] = (int)strtol( s, & end, 10 );
+    if( end == s || counts[ n ] < 1 || ( *end && *end != ',' ) )
+      return -1;
+    ++n;
+    s = *end ? end + 1 : end;
+  }
+
+  return n;
+}
+
+/* 1, 2, 4, ... up to the number of processors, which is always included */
+static int default_thread_counts( int* counts )
+{
+  const int nr_cpus = (int)sysconf( _SC_NPROCESSORS_ONLN );
+  int n = 0, t;
+
+  for( t=1; t < nr_cpus && n < MAX_THREAD_COUNTS - 1; t *= 2 )
+    counts[ n++ ] = t;
+  counts[ n++ ] = nr_cpus > 1 ? nr_cpus : 1;
+
+  return n;
+}
+
+static void help( char* name )
+{
+  unsigned int i;
+
+  printf("Benchmark of the Parallel Rendering of the Mandelbrot Set\n\n");
+  printf("Invocation: %s [ options ]\n\n", name );
+  printf("Options:\n");
+  printf("--threads\n-t\n");
+  printf("\tComma separated thread counts (default: 1, 2, 4, ... up to one per processor)\n\n");
+  printf("--iterations\n-i\n");
+  printf("\tRender all views at this depth only instead of their own depths\n\n");
+  printf("--view\n-v\n");
+  printf("\tRender only this view:");
+  for( i=0; i < NR_BENCH_VIEWS; ++i )
+    printf(" %s", bench_views[i].name );
+  printf("\n\n");
+  printf("--resolution\n-r\n");
+  printf("\tImage size in pixels as WIDTHxHEIGHT (default: %dx%d)\n\n", BENCH_RES_X, BENCH_RES_Y );
+  printf("--repeat\n-n\n");
+  printf("\tRenderings per view of which the fastest counts (default: %d)\n\n", BENCH_REPEAT );
+  printf("--precision\n-p\n");
+  printf("\tForce kernel tier as for parmandel (default: auto)\n\n");
+  printf("--no-interior-checks\n-c\n");
+  printf("\tIterate all pixels, also those recognized as inside the set\n\n");
+  printf("--output\n-o\n");
+  printf("\tWrite the JSON results to this file instead of the standard output\n\n");
+  printf("--help\n-h\n");
+  printf("\tThis help screen.\n\n");
+}
+
+
+int main( int argc, char* argv[] )
+{
+  int optindex, optchar;
+  const struct option long_options[] =
+  {
+    { "help", no_argument, NULL, 'h' },
+    { "threads", required_argument, NULL, 't' },
+    { "iterations", required_argument, NULL, 'i' },
+    { "view", required_argument, NULL, 'v' },
+    { "resolution", required_argument, NULL, 'r' },
+    { "repeat", required_argument, NULL, 'n' },
+    { "precision", required_argument, NULL, 'p' },
+    { "no-interior-checks", no_argument, NULL, 'c' },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+  };
+  t_parman_options options = *get_parman_options();
+  int thread_counts[ MAX_THREAD_COUNTS ];
+  int nr_thread_counts = 0;
+  int iterations = 0;
+  const char* view = NULL;
+  const char* output = NULL;
+  int res_x = BENCH_RES_X, res_y = BENCH_RES_Y;
+  int repeat = BENCH_REPEAT;
+  t_bench_run *runs, *r;
+  int nr_runs = 0, max_runs, precision, retcode = 0;
+  unsigned int i;
+  int t, d;
+  t_thread_pool* p_pool;
+  FILE* fp;
+
+  while( ( optchar = getopt_long( argc, argv, "hct:i:v:r:n:p:o:", long_options, &optindex ) ) != -1 )
+  {
+    switch( optchar )
+    {
+    case 'h':
+      help( argv[0] );
+      return -1;
+
+    case 't':
+      nr_thread_counts = parse_thread_counts( optarg, thread_counts );
+      if( nr_thread_counts <= 0 ) {
+        log_error("thread counts must be given as a comma separated list of positive numbers\n");
+        return -1;
+      }
+      break;
+
+    case 'i':
+      iterations = atoi( optarg );
+      if( iterations < PARMAN_MIN_ITERATIONS || iterations >= PARMAN_MAX_ITERATIONS ) {
+        log_error("number of iterations must be in range [%d:%d]\n", PARMAN_MIN_ITERATIONS, PARMAN_MAX_ITERATIONS );
+        return -1;
+      }
+      break;
+
+    case 'v':
+      view = optarg;
+      break;
+
+    case 'r':
+      if( sscanf( optarg, "%dx%d", & res_x, & res_y ) != 2 || res_x < 1 || res_y < 1 ) {
+        log_error("resolution must be given as WIDTHxHEIGHT\n");
+        return -1;
+      }
+      break;
+
+    case 'n':
+      repeat = atoi( optarg );
+      if( repeat < 1 ) {
+        log_error("number of repetitions must be positive\n");
+        return -1;
+      }
+      break;
+
+    case 'p':
+      precision = parse_precision( optarg );
+      if( precision < 0 ) {
+        log_error("unknown precision %s\n", optarg );
+        return -1;
+      }
+      options.precision = precision;
+      break;
+
+    case 'c':
+      options.interior_checks = 0;
+      break;
+
+    case 'o':
+      output = optarg;
+      break;
+
+    default:
+      fprintf( stderr, "input argument error!\n");
+      return -1;
+    }
+  }
+
+  if( nr_thread_counts == 0 )
+    nr_thread_counts = default_thread_counts( thread_counts );
+
+  for( i=0; view && i < NR_BENCH_VIEWS && strcmp( view, bench_views[i].name ); ++i )
+    ;
+  if( i == NR_BENCH_VIEWS ) {
+    log_error("unknown view %s\n", view );
+    return -1;
+  }
+
+  /* every rendering starts from scratch at full resolution */
+  options.progressive = 0;
+  options.smooth = 0;
+  options.p_tile_cache = NULL;
+  options.p_palette = NULL;
+  set_parman_options( & options );
+
+  max_runs = nr_thread_counts * NR_BENCH_VIEWS * MAX_DEPTHS;
+  runs = calloc( max_runs, sizeof( t_bench_run ) );
+  if( runs == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  for( t=0; t < nr_thread_counts && ! retcode; ++t ) {
+    p_pool = create_thread_pool( thread_counts[t] );
+    if( p_pool == NULL ) {
+      log_error("could not create rendering threads!\n");
+      retcode = -1;
+      break;
+    }
+
+    for( i=0; i < NR_BENCH_VIEWS && ! retcode; ++i ) {
+      if( view && strcmp( view, bench_views[i].name ) )
+        continue;
+
+      for( d=0; d < MAX_DEPTHS && bench_views[i].iterations[d] && ! retcode; ++d ) {
+        r = & runs[ nr_runs++ ];
+        r->p_view = & bench_views[i];
+        r->iterations = iterations ? iterations : bench_views[i].iterations[d];
+        r->nr_threads = p_pool->nr_threads;
+        retcode = run_view( p_pool, r, res_x, res_y, repeat );
+        if( iterations )
+          break;
+      }
+    }
+
+    release_thread_pool( p_pool );
+  }
+
+  if( ! retcode ) {
+    set_efficiencies( runs, nr_runs );
+    fp = output ? fopen( output, "w" ) : stdout;
+    if( fp == NULL ) {
+      log_error("could not create file %s\n", output );
+      retcode = -1;
+    }
+    else {
+      write_json( fp, runs, nr_runs, res_x, res_y, repeat );
+      if( fp != stdout && fclose( fp ) ) {
+        log_error("could not write file %s\n", output );
+        retcode = -1;
+      }
+    }
+  }
+
+  for( t=0; t < nr_runs; ++t )
+    free( runs[t].busy_s );
+  free( runs );
+
+  return retcode;
+}
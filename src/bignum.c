@@ -0,0 +1,276 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <bignum.h>
+
+#define N       BIGFIX_LIMBS
+#define TOP     ( BIGFIX_LIMBS - 1 )
+
+
+static void negate( t_bigfix* r )
+{
+  uint64_t carry = 1;
+  int i;
+
+  for( i=0; i < N; ++i ) {
+    carry += (uint32_t) ~r->limb[i];
+    r->limb[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+/* multiplication by a small factor is exact in two's complement */
+static void mul_small( t_bigfix* r, const uint32_t f )
+{
+  uint64_t carry = 0;
+  int i;
+
+  for( i=0; i < N; ++i ) {
+    carry += (uint64_t)r->limb[i] * f;
+    r->limb[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+static void div_small( t_bigfix* r, const uint32_t d )
+{
+  const int negative = bigfix_is_negative( r );
+  uint64_t rem = 0;
+  int i;
+
+  if( negative )
+    negate( r );
+
+  for( i=TOP; i >= 0; --i ) {
+    rem = ( rem << 32 ) | r->limb[i];
+    r->limb[i] = (uint32_t)( rem / d );
+    rem %= d;
+  }
+
+  if( negative )
+    negate( r );
+}
+
+int bigfix_is_negative( const t_bigfix* a )
+{
+  return ( a->limb[TOP] & 0x80000000U ) != 0;
+}
+
+void bigfix_add( t_bigfix* r, const t_bigfix* a, const t_bigfix* b )
+{
+  uint64_t carry = 0;
+  int i;
+
+  for( i=0; i < N; ++i ) {
+    carry += (uint64_t)a->limb[i] + b->limb[i];
+    r->limb[i] = (uint32_t)carry;
+    carry >>= 32;
+  }
+}
+
+void bigfix_sub( t_bigfix* r, const t_bigfix* a, const t_bigfix* b )
+{
+  t_bigfix nb = *b;
+
+  negate( & nb );
+  bigfix_add( r, a, & nb );
+}
+
+/*
+ * Schoolbook multiplication of the magnitudes. Partial products which
+ * only contribute below the least significant limb of the result are
+ * skipped, which truncates the result by at most a few units of the
+ * last place.
+ */
+void bigfix_mul( t_bigfix* r, const t_bigfix* a, const t_bigfix* b )
+{
+  t_bigfix ma = *a, mb = *b;
+  const int negative = bigfix_is_negative( a ) != bigfix_is_negative( b );
+  uint32_t prod[ 2 * N ];
+  uint64_t carry;
+  int i, j;
+
+  if( bigfix_is_negative( & ma ) )
+    negate( & ma );
+  if( bigfix_is_negative( & mb ) )
+    negate( & mb );
+
+  memset( prod, 0, sizeof( prod ) );
+  for( i=0; i < N; ++i ) {
+    if( ma.limb[i] == 0 )
+      continue;
+
+    carry = 0;
+    for( j = ( i < TOP - 1 ) ? TOP - 1 - i : 0; j < N; ++j ) {
+      carry += (uint64_t)ma.limb[i] * mb.limb[j] + prod[i+j];
+      prod[i+j] = (uint32_t)carry;
+      carry >>= 32;
+    }
+    prod[i+N] = (uint32_t)carry;
+  }
+
+  memcpy( r->limb, & prod[TOP], sizeof( r->limb ) );
+  if( negative )
+    negate( r );
+}
+
+void bigfix_from_ld( t_bigfix* r, const long double x )
+{
+  long double v = fabsl( x ), digit;
+  int i;
+
+  memset( r, 0, sizeof( t_bigfix ) );
+  for( i=TOP; i >= 0 && v > 0.0L; --i ) {
+    digit = floorl( v );
+    r->limb[i] = (uint32_t)digit;
+    v = ( v - digit ) * 4294967296.0L;
+  }
+
+  if( x < 0.0L )
+    negate( r );
+}
+
+long double bigfix_to_ld( const t_bigfix* a )
+{
+  t_bigfix m = *a;
+  long double v = 0.0L;
+  int i, top;
+
+  if( bigfix_is_negative( a ) )
+    negate( & m );
+
+  for( top = TOP; top >= 0 && m.limb[top] == 0; --top )
+    ;
+
+  /* three limbs from the leading nonzero one cover the 64 bit mantissa of long double */
+  for( i = top; i >= 0 && i > top - 3; --i )
+    v += ldexpl( (long double)m.limb[i], 32 * ( i - TOP ) );
+
+  return bigfix_is_negative( a ) ? -v : v;
+}
+
+void bigfix_add_ld( t_bigfix* r, const t_bigfix* a, const long double x )
+{
+  t_bigfix b;
+
+  bigfix_from_ld( & b, x );
+  bigfix_add( r, a, & b );
+}
+
+void bigfix_mul_int( t_bigfix* r, const t_bigfix* a, const int k )
+{
+  *r = *a;
+  mul_small( r, (uint32_t)( k < 0 ? -k : k ) );
+  if( k < 0 )
+    negate( r );
+}
+
+int bigfix_cmp( const t_bigfix* a, const t_bigfix* b )
+{
+  t_bigfix d;
+  int i;
+
+  bigfix_sub( & d, a, b );
+  if( bigfix_is_negative( & d ) )
+    return -1;
+
+  for( i=0; i < N; ++i ) {
+    if( d.limb[i] )
+      return 1;
+  }
+
+  return 0;
+}
+
+int bigfix_from_string( t_bigfix* r, const char* s )
+{
+  const char *p = s, *frac_start = NULL, *frac_end = NULL;
+  t_bigfix frac;
+  int negative = 0, digits = 0, exponent = 0;
+
+  memset( r, 0, sizeof( t_bigfix ) );
+  memset( & frac, 0, sizeof( t_bigfix ) );
+
+  while( isspace( (unsigned char)*p ) )
+    ++p;
+
+  if( *p == '-' || *p == '+' )
+    negative = ( *p++ == '-' );
+
+  for( ; isdigit( (unsigned char)*p ); ++p, ++digits ) {
+    mul_small( r, 10 );
+    r->limb[TOP] += *p - '0';
+  }
+
+  if( *p == '.' ) {
+    frac_start = ++p;
+    for( ; isdigit( (unsigned char)*p ); ++p, ++digits )
+      ;
+    frac_end = p;
+  }
+
+  if( digits == 0 )
+    return -1;
+
+  if( *p == 'e' || *p == 'E' ) {
+    char* end;
+    exponent = (int)strtol( p + 1, & end, 10 );
+    if( end == p + 1 )
+      return -1;
+    p = end;
+  }
+
+  if( *p != '\0' )
+    return -1;
+
+  /* accumulate the fraction from its least significant digit */
+  if( frac_start ) {
+    for( p = frac_end - 1; p >= frac_start; --p ) {
+      frac.limb[TOP] += *p - '0';
+      div_small( & frac, 10 );
+    }
+    bigfix_add( r, r, & frac );
+  }
+
+  for( ; exponent > 0; --exponent )
+    mul_small( r, 10 );
+  for( ; exponent < 0; ++exponent )
+    div_small( r, 10 );
+
+  if( negative )
+    negate( r );
+
+  return 0;
+}
+
+char* bigfix_to_string( char* buf, const int size, const t_bigfix* a, const int digits )
+{
+  t_bigfix m = *a;
+  int pos, i;
+
+  if( bigfix_is_negative( a ) )
+    negate( & m );
+
+  pos = snprintf( buf, size, "%s%u.", bigfix_is_negative( a ) ? "-" : "", m.limb[TOP] );
+  m.limb[TOP] = 0;
+
+  for( i=0; i < digits && pos < size - 1; ++i ) {
+    mul_small( & m, 10 );
+    buf[pos++] = '0' + m.limb[TOP];
+    m.limb[TOP] = 0;
+  }
+
+  if( pos < size )
+    buf[pos] = '\0';
+
+  return buf;
+}
@@ -0,0 +1,72 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file bignum.h
+    \brief fixed point numbers of high precision
+
+    Numbers are stored in two's complement as little endian array of
+    32 bit limbs. The most significant limb holds the signed integer
+    part, all others the fraction.
+ */
+
+#define BIGFIX_LIMBS          20
+#define BIGFIX_FRAC_BITS      ( 32 * ( BIGFIX_LIMBS - 1 ) )
+
+
+typedef struct {
+  uint32_t              limb[ BIGFIX_LIMBS ];
+} t_bigfix;
+
+
+void bigfix_from_ld( t_bigfix* r, const long double x );
+
+/*!
+ * \return a as long double with a full mantissa also for small magnitudes
+ * such as differences of nearby coordinates
+ */
+long double bigfix_to_ld( const t_bigfix* a );
+
+/*!
+ * parse a decimal number with optional sign, fraction and exponent
+ *
+ * \return 0 on success, -1 on syntax error
+ */
+int bigfix_from_string( t_bigfix* r, const char* s );
+
+/*!
+ * print a with the given number of fractional digits
+ */
+char* bigfix_to_string( char* buf, const int size, const t_bigfix* a, const int digits );
+
+void bigfix_add( t_bigfix* r, const t_bigfix* a, const t_bigfix* b );
+void bigfix_sub( t_bigfix* r, const t_bigfix* a, const t_bigfix* b );
+void bigfix_mul( t_bigfix* r, const t_bigfix* a, const t_bigfix* b );
+void bigfix_add_ld( t_bigfix* r, const t_bigfix* a, const long double x );
+
+/*!
+ * exact multiplication by an integer
+ */
+void bigfix_mul_int( t_bigfix* r, const t_bigfix* a, const int k );
+
+int bigfix_is_negative( const t_bigfix* a );
+int bigfix_cmp( const t_bigfix* a, const t_bigfix* b );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef BIGNUM_H */
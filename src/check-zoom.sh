@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Parallel Rendering of the Mandelbrot Set
+#
+# Renders a zoom sequence far below the resolution of long double and
+# compares the iteration counts of every frame with an independent
+# rendering of the same view. The width halves from frame to frame, so
+# every frame reuses pixels and the reference orbit of the one before,
+# and the widths are exact as hexadecimal floats.
+#
+# usage: check-zoom.sh [ parmandel binary ]
+
+PARMANDEL=${1:-./parmandel}
+CENTER_X=0
+CENTER_Y=1
+FIRST=80                # the first frame has a width of 2^-80
+LAST=116                # and the last one 2^-116, about 1.2e-35
+OPTIONS="--center-x $CENTER_X --center-y $CENTER_Y --resolution 64x48 --iterations 2000"
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$DIR"' EXIT
+
+"$PARMANDEL" $OPTIONS --batch "$DIR/zoom%03d.raw" --width 0x1p-$FIRST --zoom-to 0x1p-$LAST \
+             --octave-frames 1 > "$DIR/log" 2>&1 || { cat "$DIR/log"; exit 1; }
+
+failed=0
+k=0
+while [ $(( FIRST + k )) -le $LAST ]; do
+  frame=$( printf "%s/zoom%03d.raw" "$DIR" $k )
+  "$PARMANDEL" $OPTIONS --batch "$DIR/view.raw" --width 0x1p-$(( FIRST + k )) > "$DIR/log" 2>&1 \
+    || { cat "$DIR/log"; exit 1; }
+  if ! cmp -s "$frame" "$DIR/view.raw"; then
+    echo "frame $k of width 2^-$(( FIRST + k )) differs from its independent rendering"
+    failed=1
+  fi
+  k=$(( k + 1 ))
+done
+
+[ $failed -eq 0 ] && echo "all $k frames equal their independent renderings"
+exit $failed
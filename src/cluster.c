@@ -0,0 +1,1040 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+#include <cluster.h>
+#include <kernel.h>
+#include <perturbation.h>
+#include <log.h>
+
+/* "PMT2", start of every message */
+#define CLUSTER_MAGIC         0x32544d50
+
+/* seconds to complete a message which has started to arrive */
+#define CLUSTER_RECV_TIMEOUT  60
+
+/* upper bound for the payload of a message */
+#define CLUSTER_MAX_PAYLOAD   ( 1 << 28 )
+
+enum {
+  CLUSTER_MSG_TILE = 1,       /*!< coordinator asks for a square */
+  CLUSTER_MSG_RESULT          /*!< worker answers with its iteration counts */
+};
+
+/* magic, type, id and payload size */
+#define HEADER_SIZE           16
+#define LD_SIZE               16
+#define BIGFIX_SIZE           ( 4 * BIGFIX_LIMBS )
+#define REQUEST_SIZE          ( 7 * 4 + 4 * BIGFIX_SIZE + 2 * LD_SIZE )
+
+#define FLAG_SMOOTH           1
+#define FLAG_INTERIOR_CHECKS  2
+#define FLAG_SUBDIVIDE        4
+
+
+typedef struct {
+  int                   res_x;
+  int                   res_y;
+  int                   iterations;
+  int                   precision;
+  int                   flags;
+  t_bigfix              min_x;          /*!< origin of the square at full precision */
+  t_bigfix              min_y;
+  t_bigfix              view_x;         /*!< origin of the whole view */
+  t_bigfix              view_y;
+  int                   view_res_x;     /*!< resolution of the whole view */
+  int                   view_res_y;
+  long double           step_x;
+  long double           step_y;
+} t_tile_request;
+
+
+/* orbit and series of a whole view, kept for its next requests */
+typedef struct {
+  t_ref_orbit*          p_orbit;
+  t_tile_request        view;           /*!< request which has set it up */
+} t_view_orbit;
+
+
+typedef struct {
+  char                  address[256];
+  int                   fd;             /*!< -1 after a failure */
+  int                   outstanding[ CLUSTER_WINDOW ];
+  int                   nr_outstanding;
+  long                  nr_done;
+} t_worker_link;
+
+
+typedef struct {
+  t_parman_data*        p_data;
+  int                   across;         /*!< squares per row of the grid */
+  int                   nr_units;
+  char*                 done;
+  char*                 copies;         /*!< requests in flight per square */
+  int*                  queue;          /*!< ring of squares to deal out */
+  int                   head;
+  int                   queued;
+  long                  nr_todo;
+  long                  nr_done;
+  long                  nr_dispatched_again;
+  long                  nr_copies;
+  t_worker_link*        links;
+  int                   nr_links;
+  int                   nr_alive;
+} t_cluster;
+
+
+/* -- encoding, all numbers are little endian -- */
+
+static void put_le32( unsigned char* p, const uint32_t x )
+{
+  p[0] = x; p[1] = x >> 8; p[2] = x >> 16; p[3] = x >> 24;
+}
+
+static uint32_t get_le32( const unsigned char* p )
+{
+  return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+/*
+ * sign, binary exponent and 64 bit mantissa, which represents a long
+ * double of the x87 format exactly
+ */
+static void put_ld( unsigned char* p, const long double x )
+{
+  int e = 0;
+  const uint64_t m = (uint64_t)ldexpl( frexpl( fabsl( x ), & e ), 64 );
+
+  put_le32( p, (uint32_t)m );
+  put_le32( p + 4, (uint32_t)( m >> 32 ) );
+  put_le32( p + 8, (uint32_t)e );
+  put_le32( p + 12, signbit( x ) ? 1 : 0 );
+}
+
+static long double get_ld( const unsigned char* p )
+{
+  const uint64_t m = get_le32( p ) | ( (uint64_t)get_le32( p + 4 ) << 32 );
+  const long double x = ldexpl( (long double)m, (int32_t)get_le32( p + 8 ) - 64 );
+
+  return get_le32( p + 12 ) ? -x : x;
+}
+
+static void put_bigfix( unsigned char* p, const t_bigfix* a )
+{
+  int i;
+
+  for( i=0; i < BIGFIX_LIMBS; ++i )
+    put_le32( p + 4 * i, a->limb[i] );
+}
+
+static void get_bigfix( t_bigfix* a, const unsigned char* p )
+{
+  int i;
+
+  for( i=0; i < BIGFIX_LIMBS; ++i )
+    a->limb[i] = get_le32( p + 4 * i );
+}
+
+static void encode_request( unsigned char* p, const t_tile_request* r )
+{
+  put_le32( p, r->res_x );
+  put_le32( p + 4, r->res_y );
+  put_le32( p + 8, r->iterations );
+  put_le32( p + 12, r->precision );
+  put_le32( p + 16, r->flags );
+  put_le32( p + 20, r->view_res_x );
+  put_le32( p + 24, r->view_res_y );
+  p += 28;
+  put_bigfix( p, & r->min_x );
+  put_bigfix( p + BIGFIX_SIZE, & r->min_y );
+  put_bigfix( p + 2 * BIGFIX_SIZE, & r->view_x );
+  put_bigfix( p + 3 * BIGFIX_SIZE, & r->view_y );
+  p += 4 * BIGFIX_SIZE;
+  put_ld( p, r->step_x );
+  put_ld( p + LD_SIZE, r->step_y );
+}
+
+static int decode_request( t_tile_request* r, const unsigned char* p, const uint32_t size )
+{
+  if( size != REQUEST_SIZE )
+    return -1;
+
+  r->res_x = get_le32( p );
+  r->res_y = get_le32( p + 4 );
+  r->iterations = get_le32( p + 8 );
+  r->precision = get_le32( p + 12 );
+  r->flags = get_le32( p + 16 );
+  r->view_res_x = get_le32( p + 20 );
+  r->view_res_y = get_le32( p + 24 );
+  p += 28;
+  get_bigfix( & r->min_x, p );
+  get_bigfix( & r->min_y, p + BIGFIX_SIZE );
+  get_bigfix( & r->view_x, p + 2 * BIGFIX_SIZE );
+  get_bigfix( & r->view_y, p + 3 * BIGFIX_SIZE );
+  p += 4 * BIGFIX_SIZE;
+  r->step_x = get_ld( p );
+  r->step_y = get_ld( p + LD_SIZE );
+
+  if( r->res_x < 1 || r->res_y < 1 || r->res_x > CLUSTER_TILE_SIZE || r->res_y > CLUSTER_TILE_SIZE
+      || r->view_res_x < r->res_x || r->view_res_y < r->res_y
+      || r->iterations < 1 || r->precision < 0 || r->precision >= PARMAN_NR_PRECISIONS )
+    return -1;
+
+  return 0;
+}
+
+
+/* -- sockets -- */
+
+int write_full( const int fd, const void* buf, size_t n )
+{
+  const char* p = buf;
+  ssize_t sent;
+
+  while( n > 0 ) {
+    sent = send( fd, p, n, MSG_NOSIGNAL );
+    if( sent < 0 && errno == EINTR )
+      continue;
+    if( sent <= 0 )
+      return -1;
+    p += sent;
+    n -= sent;
+  }
+
+  return 0;
+}
+
+static int read_full( const int fd, void* buf, size_t n )
+{
+  char* p = buf;
+  ssize_t got;
+
+  while( n > 0 ) {
+    got = recv( fd, p, n, 0 );
+    if( got < 0 && errno == EINTR )
+      continue;
+    if( got <= 0 )
+      return -1;
+    p += got;
+    n -= got;
+  }
+
+  return 0;
+}
+
+static int send_message( const int fd, const uint32_t type, const uint32_t id, const unsigned char* payload,
+                         const uint32_t size )
+{
+  unsigned char header[ HEADER_SIZE ];
+
+  put_le32( header, CLUSTER_MAGIC );
+  put_le32( header + 4, type );
+  put_le32( header + 8, id );
+  put_le32( header + 12, size );
+
+  if( write_full( fd, header, HEADER_SIZE ) || write_full( fd, payload, size ) )
+    return -1;
+
+  return 0;
+}
+
+/*
+ * \return 0 and the payload which the caller has to free, -1 when the
+ * connection is closed or broken
+ */
+static int recv_message( const int fd, uint32_t* p_type, uint32_t* p_id, unsigned char** pp_payload,
+                         uint32_t* p_size )
+{
+  unsigned char header[ HEADER_SIZE ];
+
+  *pp_payload = NULL;
+  if( read_full( fd, header, HEADER_SIZE ) )
+    return -1;
+
+  *p_type = get_le32( header + 4 );
+  *p_id = get_le32( header + 8 );
+  *p_size = get_le32( header + 12 );
+  if( get_le32( header ) != CLUSTER_MAGIC || *p_size > CLUSTER_MAX_PAYLOAD ) {
+    log_error("%s,%d: protocol error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  *pp_payload = malloc( *p_size ? *p_size : 1 );
+  if( *pp_payload == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  if( read_full( fd, *pp_payload, *p_size ) ) {
+    free( *pp_payload );
+    *pp_payload = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void set_stream_options( const int fd, const int family )
+{
+  const struct timeval timeout = { CLUSTER_RECV_TIMEOUT, 0 };
+  int on = 1;
+
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, & timeout, sizeof( timeout ) );
+  if( family == AF_UNIX )
+    return;
+
+  /* requests are small and must not wait for more data */
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, & on, sizeof( on ) );
+
+  /* machines which are switched off are noticed within half a minute */
+  setsockopt( fd, SOL_SOCKET, SO_KEEPALIVE, & on, sizeof( on ) );
+#ifdef TCP_KEEPIDLE
+  on = 10;
+  setsockopt( fd, IPPROTO_TCP, TCP_KEEPIDLE, & on, sizeof( on ) );
+  on = 5;
+  setsockopt( fd, IPPROTO_TCP, TCP_KEEPINTVL, & on, sizeof( on ) );
+  on = 3;
+  setsockopt( fd, IPPROTO_TCP, TCP_KEEPCNT, & on, sizeof( on ) );
+#endif
+}
+
+static int open_unix_socket( const char* path, const int listening )
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if( strlen( path ) >= sizeof( addr.sun_path ) ) {
+    log_error("%s,%d: socket path %s is too long!\n", __func__, __LINE__, path );
+    return -1;
+  }
+
+  memset( & addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  strcpy( addr.sun_path, path );
+
+  fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if( fd < 0 ) {
+    log_error("%s,%d: could not create socket error %s!\n", __func__, __LINE__, strerror( errno ) );
+    return -1;
+  }
+
+  if( listening ) {
+    unlink( path );
+    if( bind( fd, (struct sockaddr *) & addr, sizeof( addr ) ) || listen( fd, SOMAXCONN ) ) {
+      log_error("%s,%d: could not listen at %s error %s!\n", __func__, __LINE__, path, strerror( errno ) );
+      close( fd );
+      return -1;
+    }
+  }
+  else if( connect( fd, (struct sockaddr *) & addr, sizeof( addr ) ) ) {
+    log_error("%s,%d: could not connect to %s error %s!\n", __func__, __LINE__, path, strerror( errno ) );
+    close( fd );
+    return -1;
+  }
+  else
+    set_stream_options( fd, AF_UNIX );
+
+  return fd;
+}
+
+static int open_tcp_socket( const char* address, const int listening )
+{
+  struct addrinfo hints, *p_list, *p_ai;
+  char host[256];
+  const char* port = strrchr( address, ':' );
+  int fd = -1, on = 1, err;
+
+  if( port ) {
+    snprintf( host, sizeof( host ), "%.*s", (int)( port - address ), address );
+    ++port;
+  }
+  else {
+    host[0] = '\0';
+    port = address;
+  }
+
+  memset( & hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+  err = getaddrinfo( host[0] ? host : NULL, port, & hints, & p_list );
+  if( err ) {
+    log_error("%s,%d: could not resolve %s error %s!\n", __func__, __LINE__, address, gai_strerror( err ) );
+    return -1;
+  }
+
+  for( p_ai = p_list; p_ai && fd < 0; p_ai = p_ai->ai_next ) {
+    fd = socket( p_ai->ai_family, p_ai->ai_socktype, p_ai->ai_protocol );
+    if( fd < 0 )
+      continue;
+
+    if( listening ) {
+      setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, & on, sizeof( on ) );
+      if( bind( fd, p_ai->ai_addr, p_ai->ai_addrlen ) || listen( fd, SOMAXCONN ) ) {
+        close( fd );
+        fd = -1;
+      }
+    }
+    else if( connect( fd, p_ai->ai_addr, p_ai->ai_addrlen ) ) {
+      close( fd );
+      fd = -1;
+    }
+  }
+  freeaddrinfo( p_list );
+
+  if( fd < 0 )
+    log_error("%s,%d: could not %s %s error %s!\n", __func__, __LINE__, listening ? "listen at" : "connect to",
+              address, strerror( errno ) );
+  else if( ! listening )
+    set_stream_options( fd, AF_INET );
+
+  return fd;
+}
+
+int open_socket( const char* address, const int listening )
+{
+  if( ! strncmp( address, "unix:", 5 ) )
+    return open_unix_socket( address + 5, listening );
+
+  return open_tcp_socket( address, listening );
+}
+
+
+/* -- rendering of one square -- */
+
+static int same_view( const t_tile_request* a, const t_tile_request* b )
+{
+  return ! bigfix_cmp( & a->view_x, & b->view_x ) && ! bigfix_cmp( & a->view_y, & b->view_y )
+    && a->view_res_x == b->view_res_x && a->view_res_y == b->view_res_y
+    && a->step_x == b->step_x && a->step_y == b->step_y && a->iterations == b->iterations;
+}
+
+/*
+ * The square is rendered with all threads of the pool. The reference
+ * orbit and series of the whole view are set up as the coordinator
+ * would do for a rendering in one piece and kept for the next request
+ * of the same view, so that all squares match a local rendering.
+ */
+static t_parman_data* render_request( t_thread_pool* p_pool, const t_tile_request* r, t_view_orbit* p_view )
+{
+  const t_parman_options saved_options = *get_parman_options();
+  t_parman_options options = saved_options;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+  volatile int stop = 0;
+
+  options.precision = r->precision;
+  options.interior_checks = ( r->flags & FLAG_INTERIOR_CHECKS ) != 0;
+  options.subdivide = ( r->flags & FLAG_SUBDIVIDE ) != 0;
+  options.smooth = ( r->flags & FLAG_SMOOTH ) != 0;
+  options.progressive = 0;
+  options.p_tile_cache = NULL;
+  options.p_palette = NULL;
+
+  set_parman_options( & options );
+  p_data = create_parman_data_hp( r->res_x, r->res_y, & r->min_x, & r->min_y, r->res_x * r->step_x,
+                                  r->res_y * r->step_y, r->iterations );
+  set_parman_options( & saved_options );
+  if( p_data == NULL )
+    return NULL;
+
+  /* the step of the coordinator, not the one recomputed from the width */
+  p_data->step_x = r->step_x;
+  p_data->step_y = r->step_y;
+
+  if( is_perturbation( p_data->precision ) ) {
+    if( p_view->p_orbit && ! same_view( & p_view->view, r ) ) {
+      release_ref_orbit( p_view->p_orbit );
+      p_view->p_orbit = NULL;
+    }
+
+    if( p_view->p_orbit == NULL ) {
+      p_view->p_orbit = create_view_orbit( & r->view_x, & r->view_y, r->step_x, r->step_y, r->view_res_x,
+                                           r->view_res_y, r->iterations, & stop );
+      p_view->view = *r;
+    }
+
+    if( p_view->p_orbit == NULL || attach_view_orbit( p_data, p_view->p_orbit ) ) {
+      release_parman_data( p_data );
+      return NULL;
+    }
+  }
+
+  p_job = start_rendering( p_data, p_pool );
+  if( p_job == NULL ) {
+    release_parman_data( p_data );
+    return NULL;
+  }
+  if( wait_rendering( p_job ) ) {
+    log_error("%s,%d: rendering of the square failed!\n", __func__, __LINE__ );
+    release_image( p_job );
+    return NULL;
+  }
+  release_rendering( p_job );
+
+  return p_data;
+}
+
+/*
+ * \return deflated iteration counts followed by the fractional counts,
+ * preceded by their size
+ */
+static unsigned char* encode_result( const t_parman_data* p, uint32_t* p_size )
+{
+  const long n = (long)p->res_x * p->res_y;
+  const uLong raw_size = n * 4 * ( p->smooth_grid ? 2 : 1 );
+  unsigned char *raw, *packed;
+  uLongf packed_size = compressBound( raw_size );
+  uint32_t bits;
+  long i;
+
+  raw = malloc( raw_size );
+  packed = malloc( 4 + packed_size );
+  if( raw == NULL || packed == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( raw );
+    free( packed );
+    return NULL;
+  }
+
+  for( i=0; i < n; ++i )
+    put_le32( raw + 4 * i, p->grid[i] );
+  for( i=0; p->smooth_grid && i < n; ++i ) {
+    memcpy( & bits, & p->smooth_grid[i], 4 );
+    put_le32( raw + 4 * ( n + i ), bits );
+  }
+
+  /* counts of neighbouring pixels are similar, the fastest level pays off */
+  if( compress2( packed + 4, & packed_size, raw, raw_size, 1 ) != Z_OK ) {
+    log_error("%s,%d: compression error!\n", __func__, __LINE__ );
+    free( raw );
+    free( packed );
+    return NULL;
+  }
+  put_le32( packed, raw_size );
+  free( raw );
+
+  *p_size = 4 + packed_size;
+  return packed;
+}
+
+
+/* -- worker -- */
+
+static void serve_coordinator( t_thread_pool* p_pool, const int fd, t_view_orbit* p_view )
+{
+  t_tile_request request;
+  t_parman_data* p_data;
+  unsigned char *payload, *result;
+  uint32_t type, id, size;
+  long nr_tiles = 0;
+  int retcode = 0;
+
+  while( ! retcode && ! recv_message( fd, & type, & id, & payload, & size ) ) {
+    if( type != CLUSTER_MSG_TILE || decode_request( & request, payload, size ) ) {
+      log_error("%s,%d: invalid request!\n", __func__, __LINE__ );
+      free( payload );
+      break;
+    }
+    free( payload );
+
+    p_data = render_request( p_pool, & request, p_view );
+    if( p_data == NULL )
+      break;
+
+    result = encode_result( p_data, & size );
+    release_parman_data( p_data );
+    if( result == NULL )
+      break;
+
+    retcode = send_message( fd, CLUSTER_MSG_RESULT, id, result, size );
+    free( result );
+    ++nr_tiles;
+  }
+
+  log_message("coordinator disconnected after %ld tiles\n", nr_tiles );
+}
+
+int start_worker( t_thread_pool* p_pool, const char* address )
+{
+  t_view_orbit view;
+  int listen_fd, fd;
+
+  memset( & view, 0, sizeof( t_view_orbit ) );
+
+  listen_fd = open_socket( address, 1 );
+  if( listen_fd < 0 )
+    return -1;
+
+  log_message("worker with %d threads listening at %s\n", p_pool->nr_threads, address );
+
+  for( ;; ) {
+    fd = accept( listen_fd, NULL, NULL );
+    if( fd < 0 ) {
+      if( errno == EINTR )
+        continue;
+      log_error("%s,%d: could not accept connection error %s!\n", __func__, __LINE__, strerror( errno ) );
+      break;
+    }
+
+    log_message("coordinator connected\n");
+    serve_coordinator( p_pool, fd, & view );
+    close( fd );
+  }
+
+  release_ref_orbit( view.p_orbit );
+  close( listen_fd );
+  return -1;
+}
+
+
+/* -- coordinator -- */
+
+static void get_unit_rect( const t_cluster* p, const int unit, int* p_x0, int* p_y0, int* p_w, int* p_h )
+{
+  const t_parman_data* p_data = p->p_data;
+
+  *p_x0 = ( unit % p->across ) * CLUSTER_TILE_SIZE;
+  *p_y0 = ( unit / p->across ) * CLUSTER_TILE_SIZE;
+  *p_w = ( *p_x0 + CLUSTER_TILE_SIZE <= p_data->res_x ) ? CLUSTER_TILE_SIZE : p_data->res_x - *p_x0;
+  *p_h = ( *p_y0 + CLUSTER_TILE_SIZE <= p_data->res_y ) ? CLUSTER_TILE_SIZE : p_data->res_y - *p_y0;
+}
+
+/*
+ * Grid row y lies at init_y + (res_y - y) * step_y, so the square of
+ * the rows [y0, y0 + h) has its origin res_y - y0 - h steps above.
+ */
+static void make_request( const t_cluster* p, const int unit, t_tile_request* r )
+{
+  const t_parman_data* p_data = p->p_data;
+  t_bigfix step;
+  int x0, y0;
+
+  memset( r, 0, sizeof( t_tile_request ) );
+  get_unit_rect( p, unit, & x0, & y0, & r->res_x, & r->res_y );
+  r->iterations = p_data->iterations;
+  r->precision = p_data->precision;
+  r->flags = ( p_data->smooth_grid ? FLAG_SMOOTH : 0 ) | ( p_data->interior_checks ? FLAG_INTERIOR_CHECKS : 0 )
+    | ( p_data->subdivide ? FLAG_SUBDIVIDE : 0 );
+
+  bigfix_from_ld( & step, p_data->step_x );
+  bigfix_mul_int( & r->min_x, & step, x0 );
+  bigfix_add( & r->min_x, & r->min_x, & p_data->hp_x );
+
+  bigfix_from_ld( & step, p_data->step_y );
+  bigfix_mul_int( & r->min_y, & step, p_data->res_y - y0 - r->res_y );
+  bigfix_add( & r->min_y, & r->min_y, & p_data->hp_y );
+
+  r->view_x = p_data->hp_x;
+  r->view_y = p_data->hp_y;
+  r->view_res_x = p_data->res_x;
+  r->view_res_y = p_data->res_y;
+  r->step_x = p_data->step_x;
+  r->step_y = p_data->step_y;
+}
+
+static int is_saved_unit( const t_cluster* p, const int unit )
+{
+  const t_parman_data* p_data = p->p_data;
+  const int tiles_across = ( p_data->res_x + TILE_SIZE - 1 ) / TILE_SIZE;
+  int x0, y0, w, h, tx, ty;
+
+  if( p_data->p_grid_file == NULL )
+    return 0;
+
+  get_unit_rect( p, unit, & x0, & y0, & w, & h );
+  for( ty = y0 / TILE_SIZE; ty * TILE_SIZE < y0 + h; ++ty )
+    for( tx = x0 / TILE_SIZE; tx * TILE_SIZE < x0 + w; ++tx )
+      if( ! is_saved_tile( p_data->p_grid_file, ty * tiles_across + tx ) )
+        return 0;
+
+  return 1;
+}
+
+static void store_unit( t_cluster* p, const int unit, const int* counts, const float* values )
+{
+  t_parman_data* p_data = p->p_data;
+  const int tiles_across = ( p_data->res_x + TILE_SIZE - 1 ) / TILE_SIZE;
+  int x0, y0, w, h, y, tx, ty;
+
+  get_unit_rect( p, unit, & x0, & y0, & w, & h );
+  for( y=0; y < h; ++y ) {
+    memcpy( & p_data->grid[ (long)( y0 + y ) * p_data->res_x + x0 ], & counts[ y * w ], w * sizeof( int ) );
+    if( p_data->smooth_grid )
+      memcpy( & p_data->smooth_grid[ (long)( y0 + y ) * p_data->res_x + x0 ], & values[ y * w ], w * sizeof( float ) );
+  }
+
+  if( p_data->p_grid_file ) {
+    for( ty = y0 / TILE_SIZE; ty * TILE_SIZE < y0 + h; ++ty )
+      for( tx = x0 / TILE_SIZE; tx * TILE_SIZE < x0 + w; ++tx )
+        mark_saved_tile( p_data->p_grid_file, ty * tiles_across + tx );
+  }
+
+  p->done[ unit ] = 1;
+  ++p->nr_done;
+}
+
+static int store_result( t_cluster* p, const int unit, const unsigned char* payload, const uint32_t size )
+{
+  const t_parman_data* p_data = p->p_data;
+  int x0, y0, w, h;
+  uLongf raw_size;
+  unsigned char* raw;
+  int* counts;
+  float* values;
+  long n, i;
+  uint32_t bits;
+
+  get_unit_rect( p, unit, & x0, & y0, & w, & h );
+  n = (long)w * h;
+  raw_size = n * 4 * ( p_data->smooth_grid ? 2 : 1 );
+
+  if( size < 4 || get_le32( payload ) != raw_size ) {
+    log_error("%s,%d: result of wrong size!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  raw = malloc( raw_size );
+  counts = malloc( n * sizeof( int ) );
+  values = malloc( n * sizeof( float ) );
+  if( raw == NULL || counts == NULL || values == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( raw ); free( counts ); free( values );
+    return -1;
+  }
+
+  if( uncompress( raw, & raw_size, payload + 4, size - 4 ) != Z_OK || raw_size != n * 4 * ( p_data->smooth_grid ? 2 : 1 ) ) {
+    log_error("%s,%d: corrupt result!\n", __func__, __LINE__ );
+    free( raw ); free( counts ); free( values );
+    return -1;
+  }
+
+  for( i=0; i < n; ++i )
+    counts[i] = (int)get_le32( raw + 4 * i );
+  for( i=0; p_data->smooth_grid && i < n; ++i ) {
+    bits = get_le32( raw + 4 * ( n + i ) );
+    memcpy( & values[i], & bits, 4 );
+  }
+
+  store_unit( p, unit, counts, values );
+  free( raw ); free( counts ); free( values );
+
+  return 0;
+}
+
+static void queue_unit( t_cluster* p, const int unit )
+{
+  p->queue[ ( p->head + p->queued ) % p->nr_units ] = unit;
+  ++p->queued;
+}
+
+static int dequeue_unit( t_cluster* p )
+{
+  const int unit = p->queue[ p->head ];
+
+  p->head = ( p->head + 1 ) % p->nr_units;
+  --p->queued;
+  return unit;
+}
+
+/*
+ * Squares which were only in flight at the failed worker are dealt out
+ * again, those with a copy at another worker wait for that one.
+ */
+static void fail_link( t_cluster* p, t_worker_link* l )
+{
+  int i, unit, again = 0;
+
+  close( l->fd );
+  l->fd = -1;
+  --p->nr_alive;
+
+  for( i=0; i < l->nr_outstanding; ++i ) {
+    unit = l->outstanding[i];
+    if( --p->copies[ unit ] == 0 && ! p->done[ unit ] ) {
+      queue_unit( p, unit );
+      ++again;
+    }
+  }
+  l->nr_outstanding = 0;
+  p->nr_dispatched_again += again;
+
+  log_error("%s,%d: worker %s failed, %d tiles are dealt out again, %d workers left!\n", __func__, __LINE__,
+            l->address, again, p->nr_alive );
+}
+
+static int send_unit( t_cluster* p, t_worker_link* l, const int unit )
+{
+  unsigned char payload[ REQUEST_SIZE ];
+  t_tile_request request;
+
+  make_request( p, unit, & request );
+  encode_request( payload, & request );
+
+  l->outstanding[ l->nr_outstanding++ ] = unit;
+  ++p->copies[ unit ];
+
+  if( send_message( l->fd, CLUSTER_MSG_TILE, unit, payload, REQUEST_SIZE ) ) {
+    fail_link( p, l );
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * When nothing is left to deal out, an idle worker gets a copy of a
+ * square which another one is still working on, whichever answers first
+ * wins. A stalled worker then delays the image by at most one square.
+ */
+static int find_copy( const t_cluster* p, const t_worker_link* l )
+{
+  const t_worker_link* o;
+  int i, k, unit;
+
+  for( i=0; i < p->nr_links; ++i ) {
+    o = & p->links[i];
+    if( o == l || o->fd < 0 )
+      continue;
+    for( k=0; k < o->nr_outstanding; ++k ) {
+      unit = o->outstanding[k];
+      if( ! p->done[ unit ] && p->copies[ unit ] == 1 )
+        return unit;
+    }
+  }
+
+  return -1;
+}
+
+static void deal_out( t_cluster* p )
+{
+  t_worker_link* l;
+  int i, unit;
+
+  for( i=0; i < p->nr_links; ++i ) {
+    l = & p->links[i];
+    while( l->fd >= 0 && l->nr_outstanding < CLUSTER_WINDOW ) {
+      if( p->queued ) {
+        unit = dequeue_unit( p );
+        if( p->done[ unit ] )
+          continue;
+      }
+      else if( l->nr_outstanding == 0 && ( unit = find_copy( p, l ) ) >= 0 )
+        ++p->nr_copies;
+      else
+        break;
+
+      send_unit( p, l, unit );
+    }
+  }
+}
+
+static int receive_result( t_cluster* p, t_worker_link* l )
+{
+  unsigned char* payload;
+  uint32_t type, id, size;
+  int i;
+
+  if( recv_message( l->fd, & type, & id, & payload, & size ) ) {
+    fail_link( p, l );
+    return -1;
+  }
+
+  for( i=0; i < l->nr_outstanding && l->outstanding[i] != (int)id; ++i )
+    ;
+  if( type != CLUSTER_MSG_RESULT || i == l->nr_outstanding ) {
+    log_error("%s,%d: unexpected message from worker %s!\n", __func__, __LINE__, l->address );
+    free( payload );
+    fail_link( p, l );
+    return -1;
+  }
+
+  /* the answer to a copy which came second is dropped */
+  if( ! p->done[ id ] && store_result( p, id, payload, size ) ) {
+    free( payload );
+    fail_link( p, l );
+    return -1;
+  }
+  free( payload );
+
+  l->outstanding[i] = l->outstanding[ --l->nr_outstanding ];
+  --p->copies[ id ];
+  ++l->nr_done;
+
+  return 0;
+}
+
+static int render_locally( t_cluster* p, t_thread_pool* p_pool )
+{
+  t_tile_request request;
+  t_parman_data* p_data;
+  t_view_orbit view;
+  int unit, retcode = 0;
+
+  memset( & view, 0, sizeof( t_view_orbit ) );
+  log_message("no worker left, rendering the remaining %ld tiles locally\n", p->nr_todo - p->nr_done );
+
+  while( p->queued && ! retcode ) {
+    unit = dequeue_unit( p );
+    if( p->done[ unit ] )
+      continue;
+
+    make_request( p, unit, & request );
+    p_data = render_request( p_pool, & request, & view );
+    if( p_data == NULL )
+      retcode = -1;
+    else {
+      store_unit( p, unit, p_data->grid, p_data->smooth_grid );
+      release_parman_data( p_data );
+    }
+  }
+
+  release_ref_orbit( view.p_orbit );
+  return retcode;
+}
+
+static int connect_workers( t_cluster* p, const char* addresses )
+{
+  t_worker_link* l;
+  const char* s;
+  const char* e;
+  int n;
+
+  for( n = 1, s = addresses; ( s = strchr( s, ',' ) ); ++s )
+    ++n;
+
+  p->links = calloc( n, sizeof( t_worker_link ) );
+  if( p->links == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  for( s = addresses; *s; s = *e ? e + 1 : e ) {
+    e = strchr( s, ',' );
+    if( e == NULL )
+      e = s + strlen( s );
+    if( e == s )
+      continue;
+
+    l = & p->links[ p->nr_links++ ];
+    snprintf( l->address, sizeof( l->address ), "%.*s", (int)( e - s ), s );
+    l->fd = open_socket( l->address, 0 );
+    if( l->fd >= 0 )
+      ++p->nr_alive;
+  }
+
+  return 0;
+}
+
+int render_on_workers( t_parman_data* p_data, const char* addresses, t_thread_pool* p_pool )
+{
+  t_cluster cluster;
+  t_cluster* p = & cluster;
+  struct pollfd* fds;
+  t_worker_link** polled;
+  int i, n, unit, retcode = 0;
+
+  memset( p, 0, sizeof( t_cluster ) );
+  p->p_data = p_data;
+  p->across = ( p_data->res_x + CLUSTER_TILE_SIZE - 1 ) / CLUSTER_TILE_SIZE;
+  p->nr_units = p->across * ( ( p_data->res_y + CLUSTER_TILE_SIZE - 1 ) / CLUSTER_TILE_SIZE );
+
+  p->done = calloc( p->nr_units, 1 );
+  p->copies = calloc( p->nr_units, 1 );
+  p->queue = malloc( p->nr_units * sizeof( int ) );
+  if( p->done == NULL || p->copies == NULL || p->queue == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    retcode = -1;
+  }
+  else
+    retcode = connect_workers( p, addresses );
+
+  fds = malloc( ( p->nr_links + 1 ) * sizeof( struct pollfd ) );
+  polled = malloc( ( p->nr_links + 1 ) * sizeof( t_worker_link* ) );
+  if( ! retcode && ( fds == NULL || polled == NULL ) ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    retcode = -1;
+  }
+
+  for( unit = 0; ! retcode && unit < p->nr_units; ++unit ) {
+    if( is_saved_unit( p, unit ) )
+      p->done[ unit ] = 1;
+    else {
+      queue_unit( p, unit );
+      ++p->nr_todo;
+    }
+  }
+
+  if( ! retcode )
+    log_message("rendering %ld of %d tiles of %dx%d pixels on %d of %d workers\n", p->nr_todo, p->nr_units,
+                CLUSTER_TILE_SIZE, CLUSTER_TILE_SIZE, p->nr_alive, p->nr_links );
+
+  while( ! retcode && p->nr_done < p->nr_todo ) {
+    deal_out( p );
+
+    if( p->nr_alive == 0 ) {
+      retcode = render_locally( p, p_pool );
+      break;
+    }
+
+    for( i = n = 0; i < p->nr_links; ++i ) {
+      if( p->links[i].fd >= 0 && p->links[i].nr_outstanding ) {
+        fds[n].fd = p->links[i].fd;
+        fds[n].events = POLLIN;
+        polled[n++] = & p->links[i];
+      }
+    }
+    if( n == 0 )
+      continue;
+
+    if( poll( fds, n, -1 ) < 0 ) {
+      if( errno == EINTR )
+        continue;
+      log_error("%s,%d: poll error %s!\n", __func__, __LINE__, strerror( errno ) );
+      retcode = -1;
+      break;
+    }
+
+    for( i=0; i < n; ++i ) {
+      if( fds[i].revents )
+        receive_result( p, polled[i] );
+    }
+  }
+
+  for( i=0; i < p->nr_links; ++i ) {
+    if( p->links[i].fd >= 0 )
+      close( p->links[i].fd );
+    if( ! retcode )
+      log_message("worker %s: %ld tiles%s\n", p->links[i].address, p->links[i].nr_done,
+                  p->links[i].fd >= 0 ? "" : ", failed" );
+  }
+  if( ! retcode )
+    log_message("%ld tiles dealt out again after failures, %ld copies for stalled workers\n",
+                p->nr_dispatched_again, p->nr_copies );
+
+  free( fds );
+  free( polled );
+  free( p->links );
+  free( p->queue );
+  free( p->copies );
+  free( p->done );
+
+  return retcode;
+}
@@ -0,0 +1,82 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+#include <scheduler.h>
+#include <rendering.h>
+#include <bignum.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file cluster.h
+    \brief rendering on worker processes of other machines
+
+    A coordinator cuts the grid into squares of CLUSTER_TILE_SIZE pixels
+    and deals them out to worker processes over TCP or Unix domain
+    sockets, a few at a time to each, so that no worker waits for the
+    network. A request carries the origin of the square and of the whole
+    view at full precision, the resolution of the view, the step, the
+    iteration depth and the kernel, the answer the deflated iteration
+    counts. Workers render each square with all their threads relative
+    to the reference orbit and series of the whole view, which they keep
+    between requests.
+
+    When a worker fails, its connection is closed and all squares it has
+    not answered yet are dealt out again to the remaining ones. The
+    coordinator renders the rest itself when no worker is left.
+
+    Addresses are unix:/path/to/socket, host:port or just a port.
+ */
+
+/*! edge length of the squares dealt out to the workers, a multiple of TILE_SIZE */
+#define CLUSTER_TILE_SIZE     ( 8 * TILE_SIZE )
+
+/*! squares in flight per worker */
+#define CLUSTER_WINDOW        3
+
+
+/*!
+ * render all tiles of the grid which are not yet saved in its grid file
+ * on the workers given by a comma separated list of addresses
+ *
+ * \return 0 on success, -1 on error
+ */
+int render_on_workers( t_parman_data* p_data, const char* addresses, t_thread_pool* p_pool );
+
+/*!
+ * serve the requests of coordinators at the given address, one
+ * coordinator after another, until an error occurs
+ *
+ * \return -1 on error
+ */
+int start_worker( t_thread_pool* p_pool, const char* address );
+
+/*!
+ * listen at or connect to a unix:/path, host:port or port address
+ *
+ * \return socket or -1 on error
+ */
+int open_socket( const char* address, const int listening );
+
+/*!
+ * send all bytes of the buffer, also when the peer has gone
+ *
+ * \return 0 on success, -1 on error
+ */
+int write_full( const int fd, const void* buf, size_t n );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef CLUSTER_H */
@@ -7,37 +7,49 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <log.h>
 #include <colormap.h>
 #include <cubic_interpol.h>
 
-void release_colormap( t_rgb* p)
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+void release_palette( t_palette* p )
 {
   free( p );
 }
 
-t_rgb* create_colormap( const int nr_support_points, const double* x, const t_rgb* support_points, const int size )
+t_palette* create_palette( const char* name, const int nr_support_points, const double* x,
+                           const t_rgb* support_points )
 {
-  t_rgb* p;
+  t_palette* p;
   int i, ci, s;
 
   const int n = nr_support_points;
   double a[n];
   double b[n], c[n], d[n];
-  int* p_col;
+  const int* p_col;
   double xk, yk;
 
-  p = malloc( sizeof(t_rgb) * size );
+  p = malloc( sizeof(t_palette) );
   if( p == NULL ) {
     log_error("%s, %d: out of memory error!\n", __func__, __LINE__ );
     return NULL;
   }
 
+  p->name = name;
+  for( i=0; i <= PALETTE_SIZE; ++i )
+    p->colors[i] = 0xff000000;
+
   for( ci=0; ci < 3; ++ci ) /* color index loop */
   {
     /* copy support points for color */
     for( s=0; s<n; ++s ) {
-      p_col = (int *) &support_points[s];
+      p_col = (const int *) &support_points[s];
       p_col += ci;
 
       a[s] = (double)(*p_col);
@@ -46,21 +58,191 @@ t_rgb* create_colormap( const int nr_support_points, const double* x, const t_rg
     /* determine coefficients of spline function */
     cubic_split_coef( n, x, a, b, c, d );
 
-    for( i=0; i < size-1; ++ i) {
-      p_col = (int *) &p[i];
-      p_col += ci;
-
-      xk = (double)i / (double)size;
+    /* red, green and blue go to bits 16, 8 and 0, the interior stays black */
+    for( i=0; i < PALETTE_SIZE; ++ i) {
+      xk = (double)i / (double)PALETTE_SIZE;
       yk = cubic_split_fun( xk, n, x, a, b, c, d );
-      *p_col = (int) ((yk >= 0.0) ? yk : 0.0 );
+      yk = (yk >= 0.0) ? yk : 0.0;
+      yk = (yk <= 255.0) ? yk : 255.0;
+      p->colors[i] |= (t_argb)yk << ( 16 - 8 * ci );
     }
-
-    p[size-1].r = 0; p[size-1].g = 0; p[size-1].b = 0;
   }
 
   return p;
 }
 
+
+/*
+ * Iteration counts are scaled to the palette by (PALETTE_SIZE / (iterations + 1)),
+ * the position the colormap of iterations + 1 entries used to sample
+ * the spline at.
+ */
+static inline float palette_scale( const int iterations )
+{
+  return (float)PALETTE_SIZE / (float)( iterations + 1 );
+}
+
+static void colorize_smooth_span_scalar( const t_palette* p_palette, const int iterations, const float* values,
+                                         t_argb* dst, const int n )
+{
+  const float scale = palette_scale( iterations );
+  float value;
+  int i, idx;
+
+  for( i=0; i < n; ++i ) {
+    value = values[i];
+    if( value >= iterations ) {
+      dst[i] = p_palette->colors[ PALETTE_SIZE ];
+      continue;
+    }
+
+    value = ( value >= 0.0f ) ? value * scale : 0.0f;
+    value = ( value <= PALETTE_SIZE - 1 ) ? value : PALETTE_SIZE - 1;
+    idx = (int)value;
+    dst[i] = blend_colors( p_palette->colors[ idx ],
+                           p_palette->colors[ idx + 1 < PALETTE_SIZE ? idx + 1 : idx ],
+                           (t_argb)( ( value - idx ) * 256.0f ) );
+  }
+}
+
+static void colorize_span_scalar( const t_palette* p_palette, const int iterations, const int* counts,
+                                  t_argb* dst, const int n )
+{
+  const float scale = palette_scale( iterations );
+  int i, count;
+
+  for( i=0; i < n; ++i ) {
+    count = counts[i];
+    if( count >= iterations )
+      dst[i] = p_palette->colors[ PALETTE_SIZE ];
+    else
+      dst[i] = p_palette->colors[ ( count > 0 ) ? (int)( count * scale ) : 0 ];
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * eight colors are fetched with one gather instruction, the packed
+ * palette makes every entry a single 32 bit element
+ */
+__attribute__((target("avx2")))
+static void colorize_span_avx2( const t_palette* p_palette, const int iterations, const int* counts,
+                                t_argb* dst, const int n )
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i last = _mm256_set1_epi32( iterations - 1 );
+  const __m256i interior = _mm256_set1_epi32( PALETTE_SIZE );
+  const __m256 scale = _mm256_set1_ps( palette_scale( iterations ) );
+  __m256i count, idx;
+  int i;
+
+  for( i=0; i + 8 <= n; i += 8 ) {
+    count = _mm256_max_epi32( _mm256_loadu_si256( (const __m256i *) & counts[i] ), zero );
+    idx = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_cvtepi32_ps( count ), scale ) );
+    idx = _mm256_blendv_epi8( idx, interior, _mm256_cmpgt_epi32( count, last ) );
+    _mm256_storeu_si256( (__m256i *) & dst[i],
+                         _mm256_i32gather_epi32( (const int *) p_palette->colors, idx, 4 ) );
+  }
+
+  colorize_span_scalar( p_palette, iterations, counts + i, dst + i, n - i );
+}
+
+__attribute__((target("avx2")))
+static void colorize_smooth_span_avx2( const t_palette* p_palette, const int iterations, const float* values,
+                                       t_argb* dst, const int n )
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 last = _mm256_set1_ps( PALETTE_SIZE - 1 );
+  const __m256 depth = _mm256_set1_ps( iterations );
+  const __m256 scale = _mm256_set1_ps( palette_scale( iterations ) );
+  const __m256 weight_scale = _mm256_set1_ps( 256.0f );
+  const __m256i last_idx = _mm256_set1_epi32( PALETTE_SIZE - 1 );
+  const __m256i one = _mm256_set1_epi32( 1 );
+  const __m256i full = _mm256_set1_epi32( 256 );
+  const __m256i rb_mask = _mm256_set1_epi32( 0xff00ff );
+  const __m256i g_mask = _mm256_set1_epi32( 0xff00 );
+  const __m256i alpha = _mm256_set1_epi32( 0xff000000 );
+  const __m256i interior = _mm256_set1_epi32( p_palette->colors[ PALETTE_SIZE ] );
+  __m256 value, inside;
+  __m256i idx, w, a, b, rb, g;
+  int i;
+
+  for( i=0; i + 8 <= n; i += 8 ) {
+    value = _mm256_loadu_ps( & values[i] );
+    inside = _mm256_cmp_ps( value, depth, _CMP_GE_OQ );
+    value = _mm256_min_ps( _mm256_max_ps( _mm256_mul_ps( value, scale ), zero ), last );
+    idx = _mm256_cvttps_epi32( value );
+    w = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( value, _mm256_cvtepi32_ps( idx ) ), weight_scale ) );
+    a = _mm256_i32gather_epi32( (const int *) p_palette->colors, idx, 4 );
+    b = _mm256_i32gather_epi32( (const int *) p_palette->colors,
+                                _mm256_min_epi32( _mm256_add_epi32( idx, one ), last_idx ), 4 );
+
+    rb = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( a, rb_mask ), _mm256_sub_epi32( full, w ) ),
+                           _mm256_mullo_epi32( _mm256_and_si256( b, rb_mask ), w ) );
+    g = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( a, g_mask ), _mm256_sub_epi32( full, w ) ),
+                          _mm256_mullo_epi32( _mm256_and_si256( b, g_mask ), w ) );
+    rb = _mm256_and_si256( _mm256_srli_epi32( rb, 8 ), rb_mask );
+    g = _mm256_and_si256( _mm256_srli_epi32( g, 8 ), g_mask );
+    a = _mm256_or_si256( alpha, _mm256_or_si256( rb, g ) );
+    _mm256_storeu_si256( (__m256i *) & dst[i], _mm256_blendv_epi8( a, interior, _mm256_castps_si256( inside ) ) );
+  }
+
+  colorize_smooth_span_scalar( p_palette, iterations, values + i, dst + i, n - i );
+}
+
+#endif /* #ifdef HAVE_X86_SIMD */
+
+typedef void (*t_colorize_fn)( const t_palette* p_palette, const int iterations, const int* counts, t_argb* dst,
+                               const int n );
+
+static t_colorize_fn get_colorize_fn( void )
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) )
+    return colorize_span_avx2;
+#endif
+
+  return colorize_span_scalar;
+}
+
+void colorize_span( const t_palette* p_palette, const int iterations, const int* counts, t_argb* dst,
+                    const int n )
+{
+  static t_colorize_fn colorize_fn = NULL;
+
+  if( colorize_fn == NULL )
+    colorize_fn = get_colorize_fn();
+
+  colorize_fn( p_palette, iterations, counts, dst, n );
+}
+
+typedef void (*t_colorize_smooth_fn)( const t_palette* p_palette, const int iterations, const float* values,
+                                      t_argb* dst, const int n );
+
+static t_colorize_smooth_fn get_colorize_smooth_fn( void )
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) )
+    return colorize_smooth_span_avx2;
+#endif
+
+  return colorize_smooth_span_scalar;
+}
+
+void colorize_smooth_span( const t_palette* p_palette, const int iterations, const float* values, t_argb* dst,
+                           const int n )
+{
+  static t_colorize_smooth_fn colorize_fn = NULL;
+
+  if( colorize_fn == NULL )
+    colorize_fn = get_colorize_smooth_fn();
+
+  colorize_fn( p_palette, iterations, values, dst, n );
+}
+
 static int test()
 {
   const int n = 5;
@@ -92,21 +274,96 @@ static int test()
   return 0;
 }
 
-/*
- * taken from: https://stackoverflow.com/a/25816111
- */
-t_rgb* create_default_colormap( const int size )
-{
-  const double x[] = { 0.0, 0.16, 0.42, 0.6425, 0.8575, 1.0 };
-  const int nr_support_points = sizeof(x) / sizeof(double);
-  const t_rgb support_points[] = {
-    { 0,   7,   100 },
-    { 32,  107, 203 },
-    { 237, 255, 255 },
-    { 255, 170, 0 },
-    { 0,   2,   0 },
-    { 0,   0,   0 }
-  };
-
-  return create_colormap( nr_support_points, x, support_points, size );
+
+/* built in palettes, support points at positions in [0:1] */
+
+#define MAX_SUPPORT_POINTS    8
+
+static const struct {
+  const char*           name;
+  int                   nr_support_points;
+  double                x[ MAX_SUPPORT_POINTS ];
+  t_rgb                 support_points[ MAX_SUPPORT_POINTS ];
+} palette_specs[] = {
+  /* taken from: https://stackoverflow.com/a/25816111 */
+  { "default", 6,
+    { 0.0, 0.16, 0.42, 0.6425, 0.8575, 1.0 },
+    { { 0,   7,   100 },
+      { 32,  107, 203 },
+      { 237, 255, 255 },
+      { 255, 170, 0 },
+      { 0,   2,   0 },
+      { 0,   0,   0 } } },
+  { "fire", 5,
+    { 0.0, 0.2, 0.45, 0.7, 1.0 },
+    { { 0,   0,   0 },
+      { 140, 10,  0 },
+      { 255, 120, 0 },
+      { 255, 240, 120 },
+      { 255, 255, 255 } } },
+  { "ocean", 5,
+    { 0.0, 0.25, 0.5, 0.75, 1.0 },
+    { { 0,   10,  40 },
+      { 0,   90,  140 },
+      { 90,  200, 220 },
+      { 230, 250, 255 },
+      { 0,   40,  80 } } },
+  { "gray", 3,
+    { 0.0, 0.5, 1.0 },
+    { { 0,   0,   0 },
+      { 128, 128, 128 },
+      { 255, 255, 255 } } }
+};
+
+#define NR_PALETTES   ( sizeof( palette_specs ) / sizeof( palette_specs[0] ) )
+
+static t_palette* palette_cache[ NR_PALETTES ];
+static pthread_mutex_t palette_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int get_nr_palettes( void )
+{
+  return NR_PALETTES;
+}
+
+const t_palette* get_palette( const int index )
+{
+  t_palette* p;
+
+  if( index < 0 || index >= (int)NR_PALETTES )
+    return NULL;
+
+  pthread_mutex_lock( & palette_cache_lock );
+  p = palette_cache[ index ];
+  if( p == NULL ) {
+    p = create_palette( palette_specs[ index ].name, palette_specs[ index ].nr_support_points,
+                        palette_specs[ index ].x, palette_specs[ index ].support_points );
+    palette_cache[ index ] = p;
+  }
+  pthread_mutex_unlock( & palette_cache_lock );
+
+  return p;
+}
+
+int find_palette( const char* name )
+{
+  int i;
+
+  for( i=0; i < (int)NR_PALETTES; ++i ) {
+    if( ! strcmp( name, palette_specs[i].name ) )
+      return i;
+  }
+
+  return -1;
+}
+
+void release_palette_cache( void )
+{
+  int i;
+
+  pthread_mutex_lock( & palette_cache_lock );
+  for( i=0; i < (int)NR_PALETTES; ++i ) {
+    release_palette( palette_cache[i] );
+    palette_cache[i] = NULL;
+  }
+  pthread_mutex_unlock( & palette_cache_lock );
 }
@@ -8,10 +8,15 @@
 #ifndef COLORMAP_H
 #define COLORMAP_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*! number of colors a spline is evaluated at, independent of the iteration depth */
+#define PALETTE_SIZE    4096
+
 typedef struct {
   int r;
   int g;
@@ -19,11 +24,72 @@ typedef struct {
 } t_rgb;
 
 
-void release_colormap( t_rgb* p);
+/*! color packed as 0xAARRGGBB, the layout of SDL_PIXELFORMAT_ARGB8888 */
+typedef uint32_t t_argb;
+
+
+/*!
+ * \return a blended towards b by w / 256, red and blue are blended
+ * together in one word, green on its own
+ */
+static inline t_argb blend_colors( const t_argb a, const t_argb b, const t_argb w )
+{
+  const t_argb rb = ( ( a & 0xff00ff ) * ( 256 - w ) + ( b & 0xff00ff ) * w ) >> 8;
+  const t_argb g = ( ( a & 0xff00 ) * ( 256 - w ) + ( b & 0xff00 ) * w ) >> 8;
+
+  return 0xff000000 | ( rb & 0xff00ff ) | ( g & 0xff00 );
+}
+
+
+/*!
+ * spline through color support points sampled at PALETTE_SIZE positions
+ * in [0:1), iteration counts are mapped onto it when colorizing
+ */
+typedef struct {
+  const char*           name;
+  t_argb                colors[ PALETTE_SIZE + 1 ];     /*!< last entry is the interior color */
+} t_palette;
+
+
+void release_palette( t_palette* p );
+
+t_palette* create_palette( const char* name, const int nr_support_points, const double* x,
+                           const t_rgb* support_points );
+
+/*!
+ * \return number of built in palettes
+ */
+int get_nr_palettes( void );
+
+/*!
+ * \return built in palette with the given index, it is evaluated on the
+ * first request and shared afterwards, NULL when out of memory
+ */
+const t_palette* get_palette( const int index );
+
+/*!
+ * \return index of the built in palette with the given name or -1 if there is none
+ */
+int find_palette( const char* name );
+
+/*!
+ * release all built in palettes which have been evaluated
+ */
+void release_palette_cache( void );
 
-t_rgb* create_colormap( const int nr_support_points, const double* x, const t_rgb* support_points, const int size );
+/*!
+ * look up the colors of n iteration counts of an image with the given
+ * iteration depth, counts which reach the depth get the interior color
+ */
+void colorize_span( const t_palette* p_palette, const int iterations, const int* counts, t_argb* dst,
+                    const int n );
 
-t_rgb* create_default_colormap( const int size );
+/*!
+ * look up the colors of n fractional iteration counts, interpolating
+ * linearly between adjacent entries of the palette
+ */
+void colorize_smooth_span( const t_palette* p_palette, const int iterations, const float* values, t_argb* dst,
+                           const int n );
 
 #ifdef __cplusplus
 }
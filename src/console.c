@@ -9,20 +9,21 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <rendering.h>
+#include <stats.h>
+#include <costmap.h>
 #include <log.h>
 
 
-int start_head_less( const int nr_threads )
+int start_head_less( t_thread_pool* p_pool, const char* cost_map_path )
 {
   t_parman_data*    p_data;
-  t_parman_threads* p_threads;
+  t_parman_job*     p_job;
+  t_pool_stats*     p_stats;
 
   const int res_x = 160;
   const int res_y = 50;
   const int iterations = 1000000;
 
-  int retcode, i, j, all_done;
-
 
   p_data = create_parman_data( res_x, res_y,
                        -2.0 /* min_x */,
@@ -33,26 +34,34 @@ int start_head_less( const int nr_threads )
   if( p_data == NULL )
     return -1;
 
-  p_threads = start_rendering( p_data, nr_threads );
-  if( p_threads == NULL )
+  p_stats = create_pool_stats( p_pool );
+  if( p_stats == NULL )
+    return -1;
+
+  p_job = start_rendering( p_data, p_pool );
+  if( p_job == NULL ) {
+    release_pool_stats( p_stats );
     return -1;
+  }
 
   while( 1 ) {
     print_mandel( p_data );
     usleep( 500000 );
 
-    for( j=0, all_done = 1; j<nr_threads; ++j ) {
-      all_done = all_done && p_threads->thread[j].state.done;
-    }
-
-    if( all_done ) {
+    if( has_rendering_completed( p_job ) == PARMAN_NR_PASSES ) {
       print_mandel( p_data );
+      log_rendering_stats( p_data );
+      update_pool_stats( p_stats, p_pool );
+      log_pool_stats( p_stats );
+      if( cost_map_path )
+        write_cost_map( p_data, cost_map_path );
       break;
     }
   }
 
-  release_rendering( p_threads );
+  release_rendering( p_job );
   release_parman_data( p_data );
+  release_pool_stats( p_stats );
 
   return 0;
 }
@@ -8,11 +8,13 @@
 #ifndef CONSOLE_H
 #define CONSOLE_H
 
+#include <scheduler.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int start_head_less( const int nr_threads );
+int start_head_less( t_thread_pool* p_pool, const char* cost_map_path );
 
 #ifdef __cplusplus
 }
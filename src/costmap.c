@@ -0,0 +1,202 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <costmap.h>
+#include <log.h>
+
+/* sample points per tile along each axis for predictions */
+#define COST_SAMPLES    4
+
+/* largest error of the origin offsets in pixels of p_src */
+#define COST_MAX_OFFSET_ERROR  1e-3L
+
+
+static int get_tiles_x( const t_parman_data* p )
+{
+  return ( p->res_x + TILE_SIZE - 1 ) / TILE_SIZE;
+}
+
+static int get_tiles_y( const t_parman_data* p )
+{
+  return ( p->res_y + TILE_SIZE - 1 ) / TILE_SIZE;
+}
+
+/*
+ * cost of the pixel of p_src at column xs and row ys, its iterations
+ * when the pixel is known or the mean cost of the pixels of its tile
+ */
+static long get_pixel_cost( const t_parman_data* p_src, const int self, const int xs, const int ys )
+{
+  int x0, y0, w, h;
+
+  if( self )
+    return p_src->grid[ ys * p_src->res_x + xs ] + 1;
+
+  x0 = xs - xs % TILE_SIZE;
+  y0 = ys - ys % TILE_SIZE;
+  w = ( x0 + TILE_SIZE <= p_src->res_x ) ? TILE_SIZE : p_src->res_x - x0;
+  h = ( y0 + TILE_SIZE <= p_src->res_y ) ? TILE_SIZE : p_src->res_y - y0;
+
+  return p_src->tile_cost[ ( y0 / TILE_SIZE ) * get_tiles_x( p_src ) + x0 / TILE_SIZE ] / ( w * h );
+}
+
+/*
+ * offset a - b of two origins in long double, -1 when long double does
+ * not resolve it to a fraction of step, i.e. the views lie too far apart
+ * compared to their pixels to line up sample points with p_src
+ */
+static int get_origin_offset( long double* p_offset, const t_bigfix* a, const t_bigfix* b,
+                              const long double step )
+{
+  t_bigfix d, back;
+
+  bigfix_sub( & d, a, b );
+  *p_offset = bigfix_to_ld( & d );
+  bigfix_from_ld( & back, *p_offset );
+  bigfix_sub( & d, & d, & back );
+
+  return ( fabsl( bigfix_to_ld( & d ) ) <= COST_MAX_OFFSET_ERROR * fabsl( step ) ) ? 0 : -1;
+}
+
+/*
+ * Pixel x, y of p_dst lies at column ( dx0 + x * step_x ) / step_x' and
+ * row res_y' - ( dy0 + ( res_y - y ) * step_y ) / step_y' of p_src, where
+ * dx0 and dy0 are the offsets of the origins. Sample points are placed
+ * on even rows and columns, which are known when p_dst predicts itself.
+ */
+int predict_tile_cost( t_parman_data* p_dst, const t_parman_data* p_src )
+{
+  const int self = ( p_dst == p_src );
+  const int tiles_x = get_tiles_x( p_dst );
+  const int nr_tiles = count_tiles( p_dst->res_x, p_dst->res_y );
+  long double dx0, dy0, xs, ys;
+  long* cost;
+  long sum, total = 0;
+  int t, i, j, x0, y0, w, h, x, y, nr_samples, nr_known = 0;
+
+  if( ! self && p_src->tile_cost == NULL )
+    return -1;
+
+  if( self )
+    dx0 = dy0 = 0;
+  else if( get_origin_offset( & dx0, & p_dst->hp_x, & p_src->hp_x, p_src->step_x ) ||
+           get_origin_offset( & dy0, & p_dst->hp_y, & p_src->hp_y, p_src->step_y ) )
+    return -1;
+
+  cost = malloc( nr_tiles * sizeof( long ) );
+  if( cost == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  for( t=0; t < nr_tiles; ++t ) {
+    x0 = ( t % tiles_x ) * TILE_SIZE;
+    y0 = ( t / tiles_x ) * TILE_SIZE;
+    w = ( x0 + TILE_SIZE <= p_dst->res_x ) ? TILE_SIZE : p_dst->res_x - x0;
+    h = ( y0 + TILE_SIZE <= p_dst->res_y ) ? TILE_SIZE : p_dst->res_y - y0;
+    sum = 0;
+    nr_samples = 0;
+
+    for( j=0; j < COST_SAMPLES; ++j ) {
+      for( i=0; i < COST_SAMPLES; ++i ) {
+        x = x0 + ( ( ( 2 * i + 1 ) * w / ( 2 * COST_SAMPLES ) ) & ~1 );
+        y = y0 + ( ( ( 2 * j + 1 ) * h / ( 2 * COST_SAMPLES ) ) & ~1 );
+        if( self ) {
+          xs = x;
+          ys = y;
+        }
+        else {
+          xs = ( dx0 + x * p_dst->step_x ) / p_src->step_x;
+          ys = p_src->res_y - ( dy0 + ( p_dst->res_y - y ) * p_dst->step_y ) / p_src->step_y;
+          if( xs < 0 || ys < 0 || xs >= p_src->res_x || ys >= p_src->res_y )
+            continue;
+        }
+        sum += get_pixel_cost( p_src, self, (int)xs, (int)ys );
+        ++nr_samples;
+      }
+    }
+
+    if( nr_samples ) {
+      cost[t] = sum * w * h / nr_samples;
+      total += cost[t];
+      ++nr_known;
+    }
+    else
+      cost[t] = -1;
+  }
+
+  if( nr_known == 0 ) {
+    free( cost );
+    return -1;
+  }
+
+  for( t=0; t < nr_tiles; ++t ) {
+    if( cost[t] < 0 )
+      cost[t] = total / nr_known;
+  }
+
+  free( p_dst->predicted_cost );
+  p_dst->predicted_cost = cost;
+
+  return 0;
+}
+
+/*
+ * The image is stored top down as the display shows it, grid rows and
+ * thus tile rows run bottom up.
+ */
+int write_cost_map( const t_parman_data* p, const char* path )
+{
+  const int tiles_x = get_tiles_x( p ), tiles_y = get_tiles_y( p );
+  const int nr_tiles = tiles_x * tiles_y;
+  unsigned char* row;
+  double scale;
+  long max_cost = 0;
+  FILE* fp;
+  int t, x, y, retcode = 0;
+
+  if( p->tile_cost == NULL )
+    return -1;
+
+  for( t=0; t < nr_tiles; ++t ) {
+    if( p->tile_cost[t] > max_cost )
+      max_cost = p->tile_cost[t];
+  }
+  scale = ( max_cost > 0 ) ? 255.0 / log1p( (double)max_cost ) : 0;
+
+  row = malloc( tiles_x );
+  if( row == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  fp = fopen( path, "wb" );
+  if( fp == NULL ) {
+    log_error("%s,%d: could not create file %s!\n", __func__, __LINE__, path );
+    free( row );
+    return -1;
+  }
+
+  fprintf( fp, "P5\n%d %d\n255\n", tiles_x, tiles_y );
+  for( y = tiles_y - 1; y >= 0; --y ) {
+    for( x=0; x < tiles_x; ++x )
+      row[x] = (unsigned char)lround( scale * log1p( (double)p->tile_cost[ y * tiles_x + x ] ) );
+    fwrite( row, 1, tiles_x, fp );
+  }
+
+  if( fclose( fp ) ) {
+    log_error("%s,%d: could not write file %s!\n", __func__, __LINE__, path );
+    retcode = -1;
+  }
+  free( row );
+
+  return retcode;
+}
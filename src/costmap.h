@@ -0,0 +1,59 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef COSTMAP_H
+#define COSTMAP_H
+
+#include <rendering.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file costmap.h
+    \brief expected rendering cost of every tile
+
+    The cost of a pixel differs by orders of magnitude between the
+    exterior, where orbits escape after a few iterations, and the
+    interior of the set. Every span adds its iterations plus one per
+    pixel to the cost of its tile in tile_cost, so that the map of a
+    frame fills while it is rendered.
+
+    A pass of progressive rendering deals its tiles out by the cost
+    measured in the earlier passes, the expensive tiles first. The first
+    pass of a frame is dealt out by predicted_cost when a previous frame
+    of an overlapping view or known pixels of the frame itself give an
+    estimate, see predict_tile_cost().
+ */
+
+
+/*!
+ * estimate the cost of every tile of p_dst before it is rendered from
+ * the tile costs of the rendered frame p_src, or from the known pixels
+ * in even rows and columns of p_dst itself when both are the same
+ *
+ * Tiles outside of p_src get the mean cost of the others.
+ *
+ * \return 0 on success, -1 when nothing is known about the cost or the
+ *         pixels of p_dst cannot be placed on the lattice of p_src
+ */
+int predict_tile_cost( t_parman_data* p_dst, const t_parman_data* p_src );
+
+/*!
+ * write the measured cost of every tile as gray PGM image with one
+ * logarithmically scaled pixel per tile, brighter is more expensive
+ *
+ * \return 0 on success, -1 on error
+ */
+int write_cost_map( const t_parman_data* p, const char* path );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef COSTMAP_H */
@@ -0,0 +1,495 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <expmap.h>
+#include <animation.h>
+#include <rendering.h>
+#include <perturbation.h>
+#include <colormap.h>
+#include <imagefile.h>
+#include <log.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Row t of the strip lies at the radius r_max * exp( -t / c ) and column
+ * u at the angle u / c, with c = res_x / ( 2 pi ). A pixel of a frame at
+ * the distance rho from the center, in pixels of the frame, lands on
+ * row T + depth with depth = -c ln rho, where T only depends on the
+ * frame. Angle and depth of the pixels are computed once for all frames.
+ */
+typedef struct {
+  t_thread_pool*        p_pool;
+  const t_batch_options* p_options;
+  int                   frames_per_octave;
+  int                   res_x;          /*!< columns of the strip */
+  int                   nr_rows;        /*!< rows of the whole strip */
+  long double           c;              /*!< rows per e-fold of the radius */
+  long double           r_max;          /*!< radius of row 0 */
+  t_ref_orbit*          p_orbit;        /*!< orbit of the center shared by all bands */
+  int                   nr_slots;       /*!< rows held in memory */
+  int                   mask;           /*!< row number to offset table index */
+  int*                  row_offset;     /*!< offset of each held row in rows */
+  t_argb*               rows;
+  int                   rows_done;      /*!< rows of the strip stored so far */
+  int*                  angle;          /*!< column of the strip per frame pixel in 1/256 */
+  float*                depth;          /*!< row of the strip per frame pixel relative to T */
+  float                 min_depth;
+  float                 max_depth;
+} t_expmap;
+
+
+/*!
+ * synthesis of one frame by the workers of a thread pool
+ */
+typedef struct {
+  t_tile_job            job;
+  const t_expmap*       p_map;
+  t_parman_data*        p_frame;
+  int                   t_int;          /*!< integral part of the row T of the frame */
+  float                 t_frac;
+} t_remap_job;
+
+
+typedef void (*t_remap_fn)( const t_expmap* p, const int* angle, const float* depth, t_argb* dst, const int n,
+                            const int t_int, const float t_frac );
+
+
+/*
+ * The row and its weight are computed with the same float operations in
+ * both versions, so that they give identical frames.
+ */
+static void remap_span_scalar( const t_expmap* p, const int* angle, const float* depth, t_argb* dst, const int n,
+                               const int t_int, const float t_frac )
+{
+  const float lo = (float)( -t_int );
+  const float hi = (float)( p->nr_rows - 2 - t_int );
+  const t_argb* rows = p->rows;
+  float t, tf;
+  int i, row, wy, col0, col1, wx, off0, off1;
+
+  for( i=0; i < n; ++i ) {
+    t = t_frac + depth[i];
+    t = ( t > lo ) ? t : lo;
+    t = ( t < hi ) ? t : hi;
+    tf = floorf( t );
+    row = (int)tf + t_int;
+    wy = (int)( ( t - tf ) * 256.0f );
+
+    col0 = angle[i] >> 8;
+    wx = angle[i] & 255;
+    col1 = ( col0 + 1 == p->res_x ) ? 0 : col0 + 1;
+
+    off0 = p->row_offset[ row & p->mask ];
+    off1 = p->row_offset[ ( row + 1 ) & p->mask ];
+    dst[i] = blend_colors( blend_colors( rows[ off0 + col0 ], rows[ off0 + col1 ], wx ),
+                           blend_colors( rows[ off1 + col0 ], rows[ off1 + col1 ], wx ), wy );
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("avx2")))
+static inline __m256i blend_colors_avx2( const __m256i a, const __m256i b, const __m256i w )
+{
+  const __m256i full = _mm256_set1_epi32( 256 );
+  const __m256i rb_mask = _mm256_set1_epi32( 0xff00ff );
+  const __m256i g_mask = _mm256_set1_epi32( 0xff00 );
+  const __m256i alpha = _mm256_set1_epi32( 0xff000000 );
+  const __m256i v = _mm256_sub_epi32( full, w );
+  __m256i rb, g;
+
+  rb = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( a, rb_mask ), v ),
+                         _mm256_mullo_epi32( _mm256_and_si256( b, rb_mask ), w ) );
+  g = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( a, g_mask ), v ),
+                        _mm256_mullo_epi32( _mm256_and_si256( b, g_mask ), w ) );
+  rb = _mm256_and_si256( _mm256_srli_epi32( rb, 8 ), rb_mask );
+  g = _mm256_and_si256( _mm256_srli_epi32( g, 8 ), g_mask );
+
+  return _mm256_or_si256( alpha, _mm256_or_si256( rb, g ) );
+}
+
+__attribute__((target("avx2")))
+static void remap_span_avx2( const t_expmap* p, const int* angle, const float* depth, t_argb* dst, const int n,
+                             const int t_int, const float t_frac )
+{
+  const __m256 lo = _mm256_set1_ps( (float)( -t_int ) );
+  const __m256 hi = _mm256_set1_ps( (float)( p->nr_rows - 2 - t_int ) );
+  const __m256 frac = _mm256_set1_ps( t_frac );
+  const __m256 weight_scale = _mm256_set1_ps( 256.0f );
+  const __m256i base = _mm256_set1_epi32( t_int );
+  const __m256i mask = _mm256_set1_epi32( p->mask );
+  const __m256i low_byte = _mm256_set1_epi32( 255 );
+  const __m256i one = _mm256_set1_epi32( 1 );
+  const __m256i res_x = _mm256_set1_epi32( p->res_x );
+  const int* rows = (const int *)p->rows;
+  __m256 t, tf;
+  __m256i row, wy, col0, col1, wx, off0, off1, top, bottom;
+  int i;
+
+  for( i=0; i + 8 <= n; i += 8 ) {
+    t = _mm256_add_ps( frac, _mm256_loadu_ps( & depth[i] ) );
+    t = _mm256_min_ps( _mm256_max_ps( t, lo ), hi );
+    tf = _mm256_floor_ps( t );
+    row = _mm256_add_epi32( _mm256_cvttps_epi32( tf ), base );
+    wy = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( t, tf ), weight_scale ) );
+
+    col0 = _mm256_loadu_si256( (const __m256i *) & angle[i] );
+    wx = _mm256_and_si256( col0, low_byte );
+    col0 = _mm256_srli_epi32( col0, 8 );
+    col1 = _mm256_add_epi32( col0, one );
+    col1 = _mm256_andnot_si256( _mm256_cmpeq_epi32( col1, res_x ), col1 );
+
+    off0 = _mm256_i32gather_epi32( p->row_offset, _mm256_and_si256( row, mask ), 4 );
+    off1 = _mm256_i32gather_epi32( p->row_offset, _mm256_and_si256( _mm256_add_epi32( row, one ), mask ), 4 );
+    top = blend_colors_avx2( _mm256_i32gather_epi32( rows, _mm256_add_epi32( off0, col0 ), 4 ),
+                             _mm256_i32gather_epi32( rows, _mm256_add_epi32( off0, col1 ), 4 ), wx );
+    bottom = blend_colors_avx2( _mm256_i32gather_epi32( rows, _mm256_add_epi32( off1, col0 ), 4 ),
+                                _mm256_i32gather_epi32( rows, _mm256_add_epi32( off1, col1 ), 4 ), wx );
+    _mm256_storeu_si256( (__m256i *) & dst[i], blend_colors_avx2( top, bottom, wy ) );
+  }
+
+  remap_span_scalar( p, angle + i, depth + i, dst + i, n - i, t_int, t_frac );
+}
+
+#endif /* #ifdef HAVE_X86_SIMD */
+
+static t_remap_fn get_remap_fn( void )
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx2" ) )
+    return remap_span_avx2;
+#endif
+
+  return remap_span_scalar;
+}
+
+static int remap_tile( t_tile_job* p_tile_job, const t_tile* p_tile, const int worker )
+{
+  static t_remap_fn remap_fn = NULL;
+  const t_remap_job* p_job = (const t_remap_job *)p_tile_job;
+  const t_expmap* p_map = p_job->p_map;
+  const int res_x = p_job->p_frame->res_x;
+  long i;
+  int y;
+
+  (void)worker;
+  if( remap_fn == NULL )
+    remap_fn = get_remap_fn();
+
+  for( y = p_tile->y; y < p_tile->y + p_tile->h; ++y ) {
+    i = (long)y * res_x + p_tile->x;
+    remap_fn( p_map, & p_map->angle[i], & p_map->depth[i], & p_job->p_frame->image[i], p_tile->w,
+              p_job->t_int, p_job->t_frac );
+  }
+
+  return 0;
+}
+
+
+/*
+ * \return row T of frame k split into its integral and fractional part
+ */
+static void get_frame_row( const t_expmap* p, const int k, int* p_int, float* p_frac )
+{
+  const t_batch_options* p_options = p->p_options;
+  const long double scale = get_zoom_width( p_options->width, k, p->frames_per_octave ) / p_options->res_x;
+  const long double t = p->c * ( logl( p->r_max ) - logl( scale ) );
+
+  *p_int = (int)floorl( t );
+  *p_frac = (float)( t - *p_int );
+}
+
+/*
+ * \return last row of the strip which frame k needs
+ */
+static int get_last_row( const t_expmap* p, const int k )
+{
+  int t_int;
+  float t_frac;
+
+  get_frame_row( p, k, & t_int, & t_frac );
+  return t_int + (int)floorf( t_frac + p->max_depth ) + 1;
+}
+
+static int write_frame( t_expmap* p, const int k, t_parman_data* p_frame )
+{
+  t_remap_job job;
+  int retcode;
+
+  memset( & job, 0, sizeof( job ) );
+  init_tile_job( & job.job, remap_tile );
+  job.p_map = p;
+  job.p_frame = p_frame;
+  get_frame_row( p, k, & job.t_int, & job.t_frac );
+
+  retcode = submit_tile_job( p->p_pool, & job.job, p_frame->res_x, p_frame->res_y );
+  wait_tile_job( & job.job );
+  destroy_tile_job( & job.job );
+
+  if( ! retcode )
+    retcode = write_zoom_frame( p->p_options, k, p_frame );
+
+  return retcode;
+}
+
+
+/*
+ * The band covers the rows [a, a + n) of the strip, its grid row 0 is
+ * the innermost one.
+ */
+static t_parman_job* start_band( t_expmap* p, const int a, const int n )
+{
+  const t_batch_options* p_options = p->p_options;
+  const long double radius = p->r_max * expl( -(long double)( a + n - 1 ) / p->c );
+  const long double step = radius / p->c;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+
+  p_data = create_parman_data_hp( p->res_x, n, & p_options->center_x, & p_options->center_y,
+                                  p->res_x * step, n * step, p_options->iterations );
+  if( p_data == NULL )
+    return NULL;
+
+  p_data->expmap_radius = (double)radius;
+  p_data->p_orbit = share_ref_orbit( p->p_orbit );
+  if( p_data->p_orbit == NULL ) {
+    release_parman_data( p_data );
+    return NULL;
+  }
+
+  p_job = start_rendering( p_data, p->p_pool );
+  if( p_job == NULL )
+    release_parman_data( p_data );
+
+  return p_job;
+}
+
+/*
+ * the image rows of a band run from the outside inwards like the strip
+ */
+static void append_band( t_expmap* p, const t_parman_data* p_band )
+{
+  int r, row, slot;
+
+  for( r=0; r < p_band->res_y; ++r ) {
+    row = p->rows_done + r;
+    slot = row % p->nr_slots;
+    p->row_offset[ row & p->mask ] = slot * p->res_x;
+    memcpy( & p->rows[ (long)slot * p->res_x ], & p_band->image[ (long)r * p->res_x ], p->res_x * sizeof( t_argb ) );
+  }
+
+  p->rows_done += p_band->res_y;
+}
+
+static void init_frame_pixels( t_expmap* p )
+{
+  const int res_x = p->p_options->res_x;
+  const int res_y = p->p_options->res_y;
+  double px, py, rho, u;
+  long i;
+  int x, y, col;
+
+  p->min_depth = INFINITY;
+  p->max_depth = -INFINITY;
+
+  for( y=0; y < res_y; ++y ) {
+    for( x=0; x < res_x; ++x ) {
+      i = (long)y * res_x + x;
+      /* the imaginary part grows downwards like in the rendered images */
+      px = x - 0.5 * res_x + 0.5;
+      py = y - 0.5 * res_y + 0.5;
+      rho = fmax( hypot( px, py ), 0.5 );
+
+      u = atan2( py, px ) * (double)p->c;
+      if( u < 0 )
+        u += p->res_x;
+      col = (int)( u * 256 );
+      if( col >= p->res_x * 256 )
+        col -= p->res_x * 256;
+      p->angle[i] = col;
+
+      p->depth[i] = (float)( -(double)p->c * log( rho ) );
+      p->min_depth = fminf( p->min_depth, p->depth[i] );
+      p->max_depth = fmaxf( p->max_depth, p->depth[i] );
+    }
+  }
+}
+
+static long get_pixel_bytes( const t_parman_options* p_render )
+{
+  return sizeof( int ) + sizeof( t_argb ) + ( p_render->smooth ? sizeof( float ) : 0 );
+}
+
+static void release_expmap( t_expmap* p )
+{
+  free( p->row_offset );
+  free( p->rows );
+  free( p->angle );
+  free( p->depth );
+  release_ref_orbit( p->p_orbit );
+}
+
+/*
+ * Frames are written as soon as the strip reaches their innermost row,
+ * while the next band is being rendered. A band overwrites only rows
+ * which lie before the first row of every frame not written yet, because
+ * the slots hold the rows of a whole frame and two bands.
+ */
+static int render_expmap( t_expmap* p, const int band_rows, const int nr_frames )
+{
+  const t_batch_options* p_options = p->p_options;
+  t_parman_data frame;
+  t_parman_job *p_job, *p_next;
+  int a, k, retcode = 0;
+
+  memset( & frame, 0, sizeof( frame ) );
+  frame.res_x = p_options->res_x;
+  frame.res_y = p_options->res_y;
+  frame.image = malloc( (long)frame.res_x * frame.res_y * sizeof( t_argb ) );
+  if( frame.image == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  p_next = start_band( p, 0, ( band_rows < p->nr_rows ) ? band_rows : p->nr_rows );
+  if( p_next == NULL )
+    retcode = -1;
+
+  for( a = 0, k = 0; a < p->nr_rows && ! retcode; a += band_rows ) {
+    p_job = p_next;
+    p_next = NULL;
+
+    if( a + band_rows < p->nr_rows ) {
+      p_next = start_band( p, a + band_rows,
+                           ( a + 2 * band_rows <= p->nr_rows ) ? band_rows : p->nr_rows - a - band_rows );
+      if( p_next == NULL )
+        retcode = -1;
+    }
+
+    wait_rendering( p_job );
+    if( ! retcode )
+      append_band( p, get_image_data( p_job ) );
+    release_image( p_job );
+
+    for( ; k < nr_frames && ! retcode && ( p->rows_done == p->nr_rows || get_last_row( p, k ) < p->rows_done ); ++k ) {
+      retcode = write_frame( p, k, & frame );
+      log_message("frame %d of %d: width %Lg from rows up to %d of %d\n", k + 1, nr_frames,
+                  get_zoom_width( p_options->width, k, p->frames_per_octave ), get_last_row( p, k ), p->nr_rows );
+    }
+  }
+
+  if( p_next )
+    release_image( p_next );
+  free( frame.image );
+
+  return retcode;
+}
+
+int start_expmap_animation( t_thread_pool* p_pool, const t_batch_options* p_options,
+                            const long double end_width, const int frames_per_octave )
+{
+  const t_parman_options saved_options = *get_parman_options();
+  t_parman_options options = saved_options;
+  const int nr_frames = get_nr_zoom_frames( p_options->width, end_width, frames_per_octave );
+  const long double radius = 0.5L * hypotl( p_options->res_x, p_options->res_y );
+  const long double last_scale = get_zoom_width( p_options->width, nr_frames - 1, frames_per_octave ) / p_options->res_x;
+  long band_rows, frame_rows, pixels;
+  t_expmap map;
+  int stop = 0, retcode;
+
+  if( p_options->format == IMAGE_FORMAT_RAW ) {
+    log_error("%s,%d: frames of an exponential map are remapped colors, raw counts are not supported!\n",
+              __func__, __LINE__ );
+    return -1;
+  }
+
+  memset( & map, 0, sizeof( map ) );
+  map.p_pool = p_pool;
+  map.p_options = p_options;
+  map.frames_per_octave = frames_per_octave;
+
+  /* one column per pixel along the circle through the corners of the frame */
+  map.res_x = (int)ceill( 2 * M_PI * radius );
+  map.res_x = ( map.res_x + TILE_SIZE - 1 ) / TILE_SIZE * TILE_SIZE;
+  map.c = map.res_x / ( 2 * M_PI );
+  map.r_max = p_options->width / p_options->res_x * radius;
+  map.nr_rows = (int)ceill( map.c * logl( map.r_max / ( 0.5L * last_scale ) ) ) + 2;
+
+  options.progressive = 0;
+  options.p_tile_cache = NULL;
+  options.p_palette = get_palette( p_options->palette );
+  if( options.p_palette == NULL )
+    return -1;
+
+  pixels = (long)p_options->res_x * p_options->res_y;
+  map.angle = malloc( pixels * sizeof( int ) );
+  map.depth = malloc( pixels * sizeof( float ) );
+  if( map.angle == NULL || map.depth == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_expmap( & map );
+    return -1;
+  }
+  init_frame_pixels( & map );
+
+  band_rows = p_options->band_budget / ( 2 * get_pixel_bytes( & options ) * map.res_x );
+  band_rows -= band_rows % TILE_SIZE;
+  if( band_rows < TILE_SIZE )
+    band_rows = TILE_SIZE;
+
+  /* a frame spans the rows from its corners down to half a pixel at its center */
+  frame_rows = (long)ceilf( map.max_depth - map.min_depth ) + 3;
+  map.nr_slots = frame_rows + band_rows + 2;
+  if( map.nr_slots > map.nr_rows )
+    map.nr_slots = map.nr_rows;
+  for( map.mask = 1; map.mask < map.nr_slots; map.mask <<= 1 )
+    ;
+  map.mask -= 1;
+
+  if( (long)map.nr_slots * map.res_x > INT_MAX ) {
+    log_error("%s,%d: exponential map with %d rows of %d pixels is too large!\n", __func__, __LINE__,
+              map.nr_slots, map.res_x );
+    release_expmap( & map );
+    return -1;
+  }
+
+  map.row_offset = calloc( map.mask + 1, sizeof( int ) );
+  map.rows = malloc( (long)map.nr_slots * map.res_x * sizeof( t_argb ) );
+  if( map.row_offset == NULL || map.rows == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_expmap( & map );
+    return -1;
+  }
+
+  map.p_orbit = create_ref_orbit( & p_options->center_x, & p_options->center_y, p_options->iterations, & stop );
+  if( map.p_orbit == NULL ) {
+    release_expmap( & map );
+    return -1;
+  }
+
+  set_parman_options( & options );
+  log_message("rendering %d frames of %dx%d pixels, %d per octave, from an exponential map of %dx%d pixels"
+              " in bands of %ld rows, %d rows held, to %s\n", nr_frames, p_options->res_x, p_options->res_y,
+              frames_per_octave, map.res_x, map.nr_rows, band_rows, map.nr_slots, p_options->path );
+
+  retcode = render_expmap( & map, band_rows, nr_frames );
+
+  release_expmap( & map );
+  set_parman_options( & saved_options );
+
+  return retcode;
+}
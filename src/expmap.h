@@ -0,0 +1,52 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef EXPMAP_H
+#define EXPMAP_H
+
+#include <scheduler.h>
+#include <batch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file expmap.h
+    \brief zoom sequences remapped from an exponential map
+
+    An exponential map samples the plane around the center of the zoom
+    in polar coordinates: each column is an angle and each row a radius,
+    the radius shrinking by the same factor from one row to the next so
+    that all pixels are square. One strip of such rows reaches from the
+    corners of the first frame down to below a pixel of the last one and
+    is rendered only once. Every frame of the zoom is a window of this
+    strip which is transformed back to cartesian coordinates by bilinear
+    interpolation, eight pixels per AVX2 gather instruction.
+
+    The strip is rendered in bands of rows which are colored right away.
+    Only the rows needed by the frames which are not written yet are
+    kept, so the memory does not grow with the zoom depth.
+ */
+
+
+/*!
+ * render the zoom from the view of the batch options to the given end
+ * width like start_animation() but remap all frames from one
+ * exponential map, the path of the batch options is a printf pattern for
+ * the frame number or - for a stream of images on the standard output
+ *
+ * \return 0 on success, -1 on error
+ */
+int start_expmap_animation( t_thread_pool* p_pool, const t_batch_options* p_options,
+                            const long double end_width, const int frames_per_octave );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef EXPMAP_H */
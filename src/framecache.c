@@ -0,0 +1,85 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <framecache.h>
+#include <log.h>
+
+
+void release_frame_cache( t_frame_cache* p )
+{
+  int i;
+
+  if( p ) {
+    for( i=0; i < p->nr_frames; ++i )
+      release_parman_data( p->frame[i] );
+    free( p->frame );
+    free( p );
+  }
+}
+
+t_frame_cache* create_frame_cache( const int capacity )
+{
+  t_frame_cache* p = malloc( sizeof( t_frame_cache ) );
+
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_frame_cache ) );
+
+  p->frame = malloc( capacity * sizeof( t_parman_data* ) );
+  if( p->frame == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( p );
+    return NULL;
+  }
+  p->capacity = capacity;
+
+  return p;
+}
+
+void cache_frame( t_frame_cache* p, t_parman_data* p_data )
+{
+  if( p->nr_frames == p->capacity ) {
+    release_parman_data( p->frame[0] );
+    memmove( & p->frame[0], & p->frame[1], ( p->nr_frames - 1 ) * sizeof( t_parman_data* ) );
+    --p->nr_frames;
+  }
+
+  mark_rendered( p_data, 0, 0, p_data->res_x, p_data->res_y );
+  p->frame[ p->nr_frames++ ] = p_data;
+}
+
+t_parman_data* take_cached_frame( t_frame_cache* p,
+                                  const int res_x,
+                                  const int res_y,
+                                  const t_bigfix* min_x,
+                                  const t_bigfix* min_y,
+                                  const long double width,
+                                  const long double height,
+                                  const int iterations )
+{
+  t_parman_data* p_data;
+  int i;
+
+  for( i = p->nr_frames - 1; i >= 0; --i ) {
+    p_data = p->frame[i];
+    if( p_data->res_x == res_x && p_data->res_y == res_y && p_data->iterations == iterations
+        && ! bigfix_cmp( & p_data->hp_x, min_x ) && ! bigfix_cmp( & p_data->hp_y, min_y )
+        && same_step( p_data->step_x, width / (long double)res_x )
+        && same_step( p_data->step_y, height / (long double)res_y ) ) {
+      memmove( & p->frame[i], & p->frame[i+1], ( p->nr_frames - i - 1 ) * sizeof( t_parman_data* ) );
+      --p->nr_frames;
+      return p_data;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,61 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <rendering.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file framecache.h
+    \brief completely rendered frames kept for returning to earlier views
+
+    Frames are looked up by resolution, origin, step and iteration
+    depth. A frame is handed out to its user on a hit and must be put
+    back with cache_frame() when the view is left again.
+ */
+
+
+typedef struct {
+  t_parman_data**       frame;          /*!< least recently used first */
+  int                   nr_frames;
+  int                   capacity;
+} t_frame_cache;
+
+
+void release_frame_cache( t_frame_cache* p );
+t_frame_cache* create_frame_cache( const int capacity );
+
+/*!
+ * store a completely rendered frame, the cache takes ownership and
+ * releases the least recently used frame when it is full
+ */
+void cache_frame( t_frame_cache* p, t_parman_data* p_data );
+
+/*!
+ * remove the frame with the given view parameters from the cache
+ *
+ * \return frame or NULL when there is none
+ */
+t_parman_data* take_cached_frame( t_frame_cache* p,
+                                  const int res_x,
+                                  const int res_y,
+                                  const t_bigfix* min_x,
+                                  const t_bigfix* min_y,
+                                  const long double width,
+                                  const long double height,
+                                  const int iterations );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef FRAMECACHE_H */
@@ -0,0 +1,253 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gridfile.h>
+#include <scheduler.h>
+#include <log.h>
+
+/* the grid starts at a multiple of this offset */
+#define GRID_FILE_ALIGN       4096
+
+
+static size_t get_grid_offset( const long nr_tiles )
+{
+  const size_t end = sizeof( t_grid_header ) + nr_tiles;
+
+  return ( end + GRID_FILE_ALIGN - 1 ) / GRID_FILE_ALIGN * GRID_FILE_ALIGN;
+}
+
+static size_t get_file_size( const t_grid_header* p_header )
+{
+  const size_t pixels = (size_t)p_header->res_x * p_header->res_y;
+
+  return p_header->grid_offset + pixels * sizeof( int ) + ( p_header->smooth ? pixels * sizeof( float ) : 0 );
+}
+
+static int same_view_step( const long double a, const long double b )
+{
+  return fabsl( a - b ) <= fabsl( a ) * 1e-15L;
+}
+
+/*
+ * \return 0 when the header is consistent with itself and with the size
+ * of the file
+ */
+static int check_header( const t_grid_header* p_header, const size_t size )
+{
+  if( size < sizeof( t_grid_header )
+      || memcmp( p_header->magic, GRID_FILE_MAGIC, sizeof( p_header->magic ) )
+      || p_header->version != GRID_FILE_VERSION || p_header->header_size != sizeof( t_grid_header )
+      || p_header->res_x < 1 || p_header->res_y < 1
+      || p_header->nr_tiles != (uint64_t)count_tiles( p_header->res_x, p_header->res_y )
+      || p_header->grid_offset != get_grid_offset( p_header->nr_tiles )
+      || get_file_size( p_header ) != size )
+    return -1;
+
+  return 0;
+}
+
+static t_grid_file* map_grid_file( const int fd, const size_t size, const int prot, const int flags )
+{
+  t_grid_file* p;
+
+  p = malloc( sizeof( t_grid_file ) );
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    close( fd );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_grid_file ) );
+  p->fd = fd;
+
+  p->map = mmap( NULL, size, prot, flags, fd, 0 );
+  if( p->map == MAP_FAILED ) {
+    log_error("%s,%d: could not map %zu bytes error %s!\n", __func__, __LINE__, size, strerror( errno ) );
+    p->map = NULL;
+    release_grid_file( p );
+    return NULL;
+  }
+  p->size = size;
+  p->p_header = (t_grid_header *)p->map;
+
+  return p;
+}
+
+static void init_pointers( t_grid_file* p )
+{
+  const size_t pixels = (size_t)p->p_header->res_x * p->p_header->res_y;
+
+  p->tile_done = (volatile char *)( p->map + sizeof( t_grid_header ) );
+  p->grid = (int *)( p->map + p->p_header->grid_offset );
+  p->smooth_grid = p->p_header->smooth ? (float *)( p->grid + pixels ) : NULL;
+}
+
+void release_grid_file( t_grid_file* p )
+{
+  if( p ) {
+    if( p->map )
+      munmap( p->map, p->size );
+    if( p->fd >= 0 )
+      close( p->fd );
+    free( p );
+  }
+}
+
+t_grid_file* open_grid_file( const char* path, const int res_x, const int res_y,
+                             const t_bigfix* min_x, const t_bigfix* min_y,
+                             const long double step_x, const long double step_y,
+                             const int iterations, const int smooth, const int precision,
+                             const int interior_checks, const int subdivide )
+{
+  t_grid_header header;
+  t_grid_file* p;
+  struct stat st;
+  int fd, created;
+
+  fd = open( path, O_RDWR | O_CREAT, 0644 );
+  if( fd < 0 || fstat( fd, & st ) ) {
+    log_error("%s,%d: could not open %s error %s!\n", __func__, __LINE__, path, strerror( errno ) );
+    if( fd >= 0 )
+      close( fd );
+    return NULL;
+  }
+
+  /* padding bytes are cleared so that equal views give equal files */
+  memset( & header, 0, sizeof( header ) );
+  memcpy( header.magic, GRID_FILE_MAGIC, sizeof( header.magic ) );
+  header.version = GRID_FILE_VERSION;
+  header.header_size = sizeof( t_grid_header );
+  header.res_x = res_x;
+  header.res_y = res_y;
+  header.iterations = iterations;
+  header.smooth = smooth ? 1 : 0;
+  header.precision = precision;
+  header.interior_checks = interior_checks ? 1 : 0;
+  header.subdivide = subdivide ? 1 : 0;
+  header.hp_x = *min_x;
+  header.hp_y = *min_y;
+  header.step_x = step_x;
+  header.step_y = step_y;
+  header.nr_tiles = count_tiles( res_x, res_y );
+  header.grid_offset = get_grid_offset( header.nr_tiles );
+
+  created = ( st.st_size == 0 );
+  if( created ) {
+    /* the file is sparse, tiles occupy the disk once they are rendered */
+    if( ftruncate( fd, get_file_size( & header ) ) || pwrite( fd, & header, sizeof( header ), 0 ) != sizeof( header ) ) {
+      log_error("%s,%d: could not create %s error %s!\n", __func__, __LINE__, path, strerror( errno ) );
+      close( fd );
+      return NULL;
+    }
+    st.st_size = get_file_size( & header );
+  }
+
+  p = map_grid_file( fd, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED );
+  if( p == NULL )
+    return NULL;
+
+  if( ! created ) {
+    if( check_header( p->p_header, p->size ) || p->p_header->res_x != res_x || p->p_header->res_y != res_y
+        || p->p_header->iterations != iterations || p->p_header->smooth != header.smooth
+        || bigfix_cmp( & p->p_header->hp_x, min_x ) || bigfix_cmp( & p->p_header->hp_y, min_y )
+        || ! same_view_step( p->p_header->step_x, step_x ) || ! same_view_step( p->p_header->step_y, step_y ) ) {
+      log_error("%s,%d: %s holds a different view!\n", __func__, __LINE__, path );
+      release_grid_file( p );
+      return NULL;
+    }
+
+    /* tiles of two kernels would not fit together */
+    if( p->p_header->precision != precision || p->p_header->interior_checks != header.interior_checks
+        || p->p_header->subdivide != header.subdivide ) {
+      log_error("%s,%d: %s has been rendered with other kernel options!\n", __func__, __LINE__, path );
+      release_grid_file( p );
+      return NULL;
+    }
+  }
+
+  init_pointers( p );
+  return p;
+}
+
+t_grid_file* load_grid_file( const char* path )
+{
+  t_grid_file* p;
+  struct stat st;
+  int fd;
+
+  fd = open( path, O_RDONLY );
+  if( fd < 0 || fstat( fd, & st ) ) {
+    log_error("%s,%d: could not open %s error %s!\n", __func__, __LINE__, path, strerror( errno ) );
+    if( fd >= 0 )
+      close( fd );
+    return NULL;
+  }
+
+  if( st.st_size < (off_t)sizeof( t_grid_header ) ) {
+    log_error("%s,%d: %s is not a grid file!\n", __func__, __LINE__, path );
+    close( fd );
+    return NULL;
+  }
+
+  /* private pages, a stray write never reaches the file */
+  p = map_grid_file( fd, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE );
+  if( p == NULL )
+    return NULL;
+
+  if( check_header( p->p_header, p->size ) ) {
+    log_error("%s,%d: %s is not a grid file!\n", __func__, __LINE__, path );
+    release_grid_file( p );
+    return NULL;
+  }
+
+  init_pointers( p );
+  return p;
+}
+
+void mark_saved_tile( t_grid_file* p, const int index )
+{
+  /*
+   * the flag must not be stored before the pixels, which protects the
+   * file against the death of the process; the kernel writes the pages
+   * back in any order, see sync_grid_file()
+   */
+  __sync_synchronize();
+  p->tile_done[ index ] = 1;
+}
+
+int is_saved_tile( const t_grid_file* p, const int index )
+{
+  return p->tile_done[ index ];
+}
+
+long count_saved_tiles( const t_grid_file* p )
+{
+  long i, n = 0;
+
+  for( i=0; i < (long)p->p_header->nr_tiles; ++i )
+    n += ( p->tile_done[i] != 0 );
+
+  return n;
+}
+
+int sync_grid_file( t_grid_file* p )
+{
+  if( msync( p->map, p->size, MS_SYNC ) ) {
+    log_error("%s,%d: could not write grid error %s!\n", __func__, __LINE__, strerror( errno ) );
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef GRIDFILE_H
+#define GRIDFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <bignum.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file gridfile.h
+    \brief iteration grids mapped from a file
+
+    The file starts with a header which describes the view at full
+    precision, followed by one completion flag per tile, the iteration
+    counts and optionally the fractional counts, all in native byte
+    order. The renderer writes the grid directly through a shared memory
+    mapping and flags each tile once it is complete, so the file is a
+    valid checkpoint at any time: when the process dies, a restart with
+    the same view and kernel options skips all flagged tiles. Pages of
+    the mapping reach the disk in any order though, so after a crash of
+    the system the file is only consistent up to the last
+    sync_grid_file(). A finished file is mapped in no time for
+    recoloring or inspection.
+ */
+
+#define GRID_FILE_MAGIC       "PARMGRID"
+#define GRID_FILE_VERSION     2
+
+typedef struct {
+  char                  magic[8];
+  uint32_t              version;
+  uint32_t              header_size;
+  int32_t               res_x;
+  int32_t               res_y;
+  int32_t               iterations;
+  int32_t               smooth;         /*!< fractional counts follow the grid */
+  int32_t               precision;      /*!< kernel tier, never PARMAN_PRECISION_AUTO */
+  int32_t               interior_checks;
+  int32_t               subdivide;
+  t_bigfix              hp_x;           /*!< origin of the grid at full precision */
+  t_bigfix              hp_y;
+  long double           step_x;
+  long double           step_y;
+  uint64_t              nr_tiles;
+  uint64_t              grid_offset;    /*!< page aligned start of the iteration counts */
+} t_grid_header;
+
+
+typedef struct s_grid_file {
+  int                   fd;
+  unsigned char*        map;
+  size_t                size;
+  t_grid_header*        p_header;       /*!< points into the mapping */
+  volatile char*        tile_done;      /*!< completion flag per tile */
+  int*                  grid;
+  float*                smooth_grid;    /*!< fractional counts or NULL */
+} t_grid_file;
+
+
+void release_grid_file( t_grid_file* p );
+
+/*!
+ * map the grid file of the given view for rendering, the file is
+ * created when it does not exist and resumed when it describes the
+ * same view rendered with the same kernel tier and options, a file of
+ * any other view or with other options is an error
+ *
+ * \return mapped file or NULL on error
+ */
+t_grid_file* open_grid_file( const char* path, const int res_x, const int res_y,
+                             const t_bigfix* min_x, const t_bigfix* min_y,
+                             const long double step_x, const long double step_y,
+                             const int iterations, const int smooth, const int precision,
+                             const int interior_checks, const int subdivide );
+
+/*!
+ * map an existing grid file for reading, changes to the grid are not
+ * written back
+ *
+ * \return mapped file or NULL on error
+ */
+t_grid_file* load_grid_file( const char* path );
+
+/*!
+ * flag a tile as complete after all its pixels have been stored
+ */
+void mark_saved_tile( t_grid_file* p, const int index );
+
+int is_saved_tile( const t_grid_file* p, const int index );
+
+long count_saved_tiles( const t_grid_file* p );
+
+/*!
+ * flush the mapping to the disk
+ *
+ * \return 0 on success, -1 on error
+ */
+int sync_grid_file( t_grid_file* p );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef GRIDFILE_H */
@@ -0,0 +1,493 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <imagefile.h>
+#include <log.h>
+
+/* size of the compressed data collected for one IDAT chunk */
+#define PNG_CHUNK_SIZE    65536
+
+/* BigTIFF field types */
+#define TIFF_SHORT        3
+#define TIFF_LONG         4
+#define TIFF_LONG8        16
+
+/* entries of the image file directory */
+#define TIFF_NR_TAGS      11
+
+
+/*
+ * PNG image data is one zlib stream which is split into IDAT chunks
+ * whenever the output buffer is full
+ */
+typedef struct s_png_stream {
+  z_stream              zs;
+  unsigned char         out[ PNG_CHUNK_SIZE ];
+} t_png_stream;
+
+
+static void put_be32( unsigned char* p, const unsigned long v )
+{
+  p[0] = ( v >> 24 ) & 0xff;
+  p[1] = ( v >> 16 ) & 0xff;
+  p[2] = ( v >> 8 ) & 0xff;
+  p[3] = v & 0xff;
+}
+
+static int write_png_chunk( FILE* fp, const char* type, const unsigned char* data, const unsigned long len )
+{
+  unsigned char buf[4];
+  unsigned long crc;
+
+  crc = crc32( 0L, (const Bytef *) type, 4 );
+  if( len )
+    crc = crc32( crc, data, len );
+
+  put_be32( buf, len );
+  if( fwrite( buf, 1, 4, fp ) != 4 || fwrite( type, 1, 4, fp ) != 4 )
+    return -1;
+  if( len && fwrite( data, 1, len, fp ) != len )
+    return -1;
+  put_be32( buf, crc );
+  if( fwrite( buf, 1, 4, fp ) != 4 )
+    return -1;
+
+  return 0;
+}
+
+static int write_png_header( t_image_file* p )
+{
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  unsigned char ihdr[13];
+
+  put_be32( & ihdr[0], p->width );
+  put_be32( & ihdr[4], p->height );
+  ihdr[8] = 8;          /* bit depth */
+  ihdr[9] = 2;          /* truecolor */
+  ihdr[10] = 0;         /* deflate */
+  ihdr[11] = 0;         /* adaptive filtering */
+  ihdr[12] = 0;         /* no interlace */
+
+  if( fwrite( signature, 1, sizeof( signature ), p->fp ) != sizeof( signature ) )
+    return -1;
+
+  return write_png_chunk( p->fp, "IHDR", ihdr, sizeof( ihdr ) );
+}
+
+/*
+ * feed len bytes into the zlib stream and emit an IDAT chunk for every
+ * full output buffer, flush is Z_FINISH for the end of the image
+ */
+static int deflate_png( t_image_file* p, const unsigned char* data, const int len, const int flush )
+{
+  t_png_stream* s = p->p_png;
+  int retcode;
+
+  s->zs.next_in = (Bytef *) data;
+  s->zs.avail_in = len;
+
+  do {
+    retcode = deflate( & s->zs, flush );
+    if( retcode == Z_STREAM_ERROR )
+      return -1;
+
+    if( s->zs.avail_out == 0 || ( flush == Z_FINISH && s->zs.avail_out < PNG_CHUNK_SIZE ) ) {
+      if( write_png_chunk( p->fp, "IDAT", s->out, PNG_CHUNK_SIZE - s->zs.avail_out ) )
+        return -1;
+      s->zs.next_out = s->out;
+      s->zs.avail_out = PNG_CHUNK_SIZE;
+    }
+  } while( s->zs.avail_in > 0 || ( flush == Z_FINISH && retcode != Z_STREAM_END ) );
+
+  return 0;
+}
+
+
+/*
+ * BigTIFF, little endian: magic 43, 8 byte offsets and the position of
+ * the directory which is filled in by finish_image_file()
+ */
+static int write_tiff_header( t_image_file* p )
+{
+  static const unsigned char header[16] = { 'I', 'I', 43, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+  return fwrite( header, 1, sizeof( header ), p->fp ) != sizeof( header );
+}
+
+static void put_le( unsigned char* p, uint64_t v, const int bytes )
+{
+  int i;
+
+  for( i=0; i < bytes; ++i, v >>= 8 )
+    p[i] = v & 0xff;
+}
+
+static void put_tiff_tag( unsigned char* p, const int tag, const int type, const uint64_t count,
+                          const uint64_t value )
+{
+  put_le( p, tag, 2 );
+  put_le( p + 2, type, 2 );
+  put_le( p + 4, count, 8 );
+  put_le( p + 12, value, 8 );
+}
+
+/*
+ * the tile positions and sizes are stored behind the last tile, an array
+ * of one element directly within the directory entry
+ */
+static int write_tiff_directory( t_image_file* p )
+{
+  unsigned char dir[ 8 + TIFF_NR_TAGS * 20 + 8 ];
+  unsigned char buf[8];
+  uint64_t offsets_pos, sizes_pos, dir_pos;
+  long i;
+
+  offsets_pos = ftello( p->fp );
+  for( i=0; i < p->nr_tiles; ++i ) {
+    put_le( buf, p->tile_offsets[i], 8 );
+    if( fwrite( buf, 1, 8, p->fp ) != 8 )
+      return -1;
+  }
+
+  sizes_pos = ftello( p->fp );
+  for( i=0; i < p->nr_tiles; ++i ) {
+    put_le( buf, p->tile_sizes[i], 8 );
+    if( fwrite( buf, 1, 8, p->fp ) != 8 )
+      return -1;
+  }
+
+  if( p->nr_tiles == 1 ) {
+    offsets_pos = p->tile_offsets[0];
+    sizes_pos = p->tile_sizes[0];
+  }
+
+  dir_pos = ftello( p->fp );
+  memset( dir, 0, sizeof( dir ) );
+  put_le( dir, TIFF_NR_TAGS, 8 );
+  put_tiff_tag( dir + 8 + 0 * 20, 256, TIFF_LONG, 1, p->width );
+  put_tiff_tag( dir + 8 + 1 * 20, 257, TIFF_LONG, 1, p->height );
+  put_tiff_tag( dir + 8 + 2 * 20, 258, TIFF_SHORT, 3, 8 | ( 8 << 16 ) | ( (uint64_t)8 << 32 ) );
+  put_tiff_tag( dir + 8 + 3 * 20, 259, TIFF_SHORT, 1, 8 );          /* deflate */
+  put_tiff_tag( dir + 8 + 4 * 20, 262, TIFF_SHORT, 1, 2 );          /* RGB */
+  put_tiff_tag( dir + 8 + 5 * 20, 277, TIFF_SHORT, 1, 3 );
+  put_tiff_tag( dir + 8 + 6 * 20, 284, TIFF_SHORT, 1, 1 );          /* interleaved */
+  put_tiff_tag( dir + 8 + 7 * 20, 322, TIFF_LONG, 1, TIFF_TILE_SIZE );
+  put_tiff_tag( dir + 8 + 8 * 20, 323, TIFF_LONG, 1, TIFF_TILE_SIZE );
+  put_tiff_tag( dir + 8 + 9 * 20, 324, TIFF_LONG8, p->nr_tiles, offsets_pos );
+  put_tiff_tag( dir + 8 + 10 * 20, 325, TIFF_LONG8, p->nr_tiles, sizes_pos );
+  if( fwrite( dir, 1, sizeof( dir ), p->fp ) != sizeof( dir ) )
+    return -1;
+
+  put_le( buf, dir_pos, 8 );
+  if( fseeko( p->fp, 8, SEEK_SET ) || fwrite( buf, 1, 8, p->fp ) != 8 )
+    return -1;
+
+  return 0;
+}
+
+static int create_tiff_tiles( t_image_file* p )
+{
+  const int tiles_down = ( p->height + TIFF_TILE_SIZE - 1 ) / TIFF_TILE_SIZE;
+
+  p->tiles_across = ( p->width + TIFF_TILE_SIZE - 1 ) / TIFF_TILE_SIZE;
+  p->nr_tiles = (long)p->tiles_across * tiles_down;
+  p->packed_size = compressBound( 3 * TIFF_TILE_SIZE * TIFF_TILE_SIZE );
+
+  p->tile_offsets = calloc( p->nr_tiles, sizeof( uint64_t ) );
+  p->tile_sizes = calloc( p->nr_tiles, sizeof( uint64_t ) );
+  p->tile = malloc( 3 * TIFF_TILE_SIZE * TIFF_TILE_SIZE );
+  p->packed = malloc( p->packed_size );
+  if( p->tile_offsets == NULL || p->tile_sizes == NULL || p->tile == NULL || p->packed == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * tiles on the right and bottom edge are padded with black to their full
+ * size as the format demands
+ */
+static int write_tiff_tile( t_image_file* p, const t_parman_data* p_chunk, const int x0, const int y0,
+                            const int tx, const int ty )
+{
+  const int lx = tx * TIFF_TILE_SIZE - x0, ly = ty * TIFF_TILE_SIZE - y0;
+  const int w = ( lx + TIFF_TILE_SIZE <= p_chunk->res_x ) ? TIFF_TILE_SIZE : p_chunk->res_x - lx;
+  const int h = ( ly + TIFF_TILE_SIZE <= p_chunk->res_y ) ? TIFF_TILE_SIZE : p_chunk->res_y - ly;
+  const long index = (long)ty * p->tiles_across + tx;
+  unsigned char* line;
+  const t_argb* row;
+  uLongf size = p->packed_size;
+  int x, y;
+
+  memset( p->tile, 0, 3 * TIFF_TILE_SIZE * TIFF_TILE_SIZE );
+  for( y=0; y < h; ++y ) {
+    row = & p_chunk->image[ ( ly + y ) * p_chunk->res_x + lx ];
+    line = & p->tile[ 3 * y * TIFF_TILE_SIZE ];
+    for( x=0; x < w; ++x ) {
+      line[ 3 * x ] = ( row[x] >> 16 ) & 0xff;
+      line[ 3 * x + 1 ] = ( row[x] >> 8 ) & 0xff;
+      line[ 3 * x + 2 ] = row[x] & 0xff;
+    }
+  }
+
+  if( compress2( p->packed, & size, p->tile, 3 * TIFF_TILE_SIZE * TIFF_TILE_SIZE, Z_DEFAULT_COMPRESSION ) != Z_OK )
+    return -1;
+
+  p->tile_offsets[ index ] = ftello( p->fp );
+  p->tile_sizes[ index ] = size;
+  if( fwrite( p->packed, 1, size, p->fp ) != size )
+    return -1;
+
+  ++p->tiles_written;
+  return 0;
+}
+
+
+int parse_image_format( const char* path )
+{
+  const char* ext = strrchr( path, '.' );
+
+  if( ext == NULL )
+    return -1;
+  if( ! strcmp( ext, ".ppm" ) )
+    return IMAGE_FORMAT_PPM;
+  if( ! strcmp( ext, ".png" ) )
+    return IMAGE_FORMAT_PNG;
+  if( ! strcmp( ext, ".raw" ) )
+    return IMAGE_FORMAT_RAW;
+  if( ! strcmp( ext, ".tif" ) || ! strcmp( ext, ".tiff" ) )
+    return IMAGE_FORMAT_TIFF;
+  if( ! strcmp( ext, ".rgb" ) )
+    return IMAGE_FORMAT_RGB;
+
+  return -1;
+}
+
+void release_image_file( t_image_file* p )
+{
+  if( p ) {
+    if( p->p_png ) {
+      deflateEnd( & p->p_png->zs );
+      free( p->p_png );
+    }
+    if( p->fp && p->fp != stdout )
+      fclose( p->fp );
+    free( p->line );
+    free( p->tile_offsets );
+    free( p->tile_sizes );
+    free( p->tile );
+    free( p->packed );
+    free( p );
+  }
+}
+
+t_image_file* create_image_stream( FILE* fp, const t_image_format format, const int width, const int height )
+{
+  t_image_file* p;
+  int retcode = 0;
+
+  p = malloc( sizeof( t_image_file ) );
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    if( fp != stdout )
+      fclose( fp );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_image_file ) );
+  p->fp = fp;
+  p->format = format;
+  p->width = width;
+  p->height = height;
+
+  /* a filter type byte, then three bytes per pixel or one count */
+  p->line = malloc( 1 + width * ( format == IMAGE_FORMAT_RAW ? sizeof( int ) : 3 ) );
+  if( p->line == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_image_file( p );
+    return NULL;
+  }
+
+  switch( format ) {
+  case IMAGE_FORMAT_PPM:
+    retcode = fprintf( p->fp, "P6\n%d %d\n255\n", width, height ) < 0;
+    break;
+
+  case IMAGE_FORMAT_PNG:
+    p->p_png = malloc( sizeof( t_png_stream ) );
+    if( p->p_png == NULL ) {
+      log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+      release_image_file( p );
+      return NULL;
+    }
+    memset( & p->p_png->zs, 0, sizeof( z_stream ) );
+    if( deflateInit( & p->p_png->zs, Z_DEFAULT_COMPRESSION ) != Z_OK ) {
+      log_error("%s,%d: could not initialize compression!\n", __func__, __LINE__ );
+      free( p->p_png );
+      p->p_png = NULL;
+      release_image_file( p );
+      return NULL;
+    }
+    p->p_png->zs.next_out = p->p_png->out;
+    p->p_png->zs.avail_out = PNG_CHUNK_SIZE;
+    retcode = write_png_header( p );
+    break;
+
+  case IMAGE_FORMAT_RAW:
+  case IMAGE_FORMAT_RGB:
+    break;
+
+  case IMAGE_FORMAT_TIFF:
+    if( create_tiff_tiles( p ) ) {
+      release_image_file( p );
+      return NULL;
+    }
+    retcode = write_tiff_header( p );
+    break;
+  }
+
+  if( retcode ) {
+    log_error("%s,%d: could not write image header!\n", __func__, __LINE__ );
+    release_image_file( p );
+    return NULL;
+  }
+
+  return p;
+}
+
+t_image_file* create_image_file( const char* path, const t_image_format format, const int width, const int height )
+{
+  FILE* fp = strcmp( path, "-" ) ? fopen( path, "wb" ) : stdout;
+
+  if( fp == NULL ) {
+    log_error("%s,%d: could not create file %s!\n", __func__, __LINE__, path );
+    return NULL;
+  }
+
+  return create_image_stream( fp, format, width, height );
+}
+
+/*
+ * The image of a band is stored top down like the file, its grid bottom
+ * up.
+ */
+int write_image_band( t_image_file* p, const t_parman_data* p_band )
+{
+  unsigned char* line = p->line;
+  const t_argb* row;
+  int r, x, len, retcode = 0;
+
+  if( p_band->res_x != p->width || p->rows + p_band->res_y > p->height || p->format == IMAGE_FORMAT_TIFF
+      || ( p->format != IMAGE_FORMAT_RAW && p_band->image == NULL ) ) {
+    log_error("%s,%d: band does not fit into the image!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  for( r=0; r < p_band->res_y && ! retcode; ++r ) {
+    switch( p->format ) {
+    case IMAGE_FORMAT_PPM:
+    case IMAGE_FORMAT_PNG:
+    case IMAGE_FORMAT_RGB:
+      row = & p_band->image[ r * p_band->res_x ];
+      line[0] = 0;      /* PNG filter type none */
+      for( x=0; x < p->width; ++x ) {
+        line[ 1 + 3 * x ] = ( row[x] >> 16 ) & 0xff;
+        line[ 2 + 3 * x ] = ( row[x] >> 8 ) & 0xff;
+        line[ 3 + 3 * x ] = row[x] & 0xff;
+      }
+      len = 3 * p->width;
+      if( p->format == IMAGE_FORMAT_PNG )
+        retcode = deflate_png( p, line, len + 1, Z_NO_FLUSH );
+      else
+        retcode = fwrite( line + 1, 1, len, p->fp ) != len;
+      break;
+
+    case IMAGE_FORMAT_RAW:
+      len = p->width;
+      retcode = fwrite( & p_band->grid[ ( p_band->res_y - 1 - r ) * p_band->res_x ], sizeof( int ), len, p->fp ) != len;
+      break;
+
+    case IMAGE_FORMAT_TIFF:
+      break;
+    }
+  }
+
+  if( retcode ) {
+    log_error("%s,%d: could not write image row %d!\n", __func__, __LINE__, p->rows + r );
+    return -1;
+  }
+
+  p->rows += p_band->res_y;
+  return 0;
+}
+
+int write_image_chunk( t_image_file* p, const t_parman_data* p_chunk, const int x0, const int y0 )
+{
+  const int tx0 = x0 / TIFF_TILE_SIZE, ty0 = y0 / TIFF_TILE_SIZE;
+  const int tx1 = ( x0 + p_chunk->res_x + TIFF_TILE_SIZE - 1 ) / TIFF_TILE_SIZE;
+  const int ty1 = ( y0 + p_chunk->res_y + TIFF_TILE_SIZE - 1 ) / TIFF_TILE_SIZE;
+  int tx, ty;
+
+  if( p->format != IMAGE_FORMAT_TIFF || p_chunk->image == NULL || x0 % TIFF_TILE_SIZE || y0 % TIFF_TILE_SIZE
+      || x0 + p_chunk->res_x > p->width || y0 + p_chunk->res_y > p->height
+      || ( x0 + p_chunk->res_x < p->width && p_chunk->res_x % TIFF_TILE_SIZE )
+      || ( y0 + p_chunk->res_y < p->height && p_chunk->res_y % TIFF_TILE_SIZE ) ) {
+    log_error("%s,%d: chunk does not match the tiles of the image!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  for( ty = ty0; ty < ty1; ++ty ) {
+    for( tx = tx0; tx < tx1; ++tx ) {
+      if( write_tiff_tile( p, p_chunk, x0, y0, tx, ty ) ) {
+        log_error("%s,%d: could not write tile %d,%d!\n", __func__, __LINE__, tx, ty );
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int finish_image_file( t_image_file* p )
+{
+  int retcode = 0;
+
+  if( p->format == IMAGE_FORMAT_TIFF ) {
+    if( p->tiles_written != p->nr_tiles ) {
+      log_error("%s,%d: only %ld of %ld tiles have been written!\n", __func__, __LINE__,
+                p->tiles_written, p->nr_tiles );
+      retcode = -1;
+    }
+    else
+      retcode = write_tiff_directory( p );
+  }
+  else if( p->rows != p->height ) {
+    log_error("%s,%d: only %d of %d rows have been written!\n", __func__, __LINE__, p->rows, p->height );
+    retcode = -1;
+  }
+
+  if( ! retcode && p->format == IMAGE_FORMAT_PNG ) {
+    retcode = deflate_png( p, NULL, 0, Z_FINISH );
+    if( ! retcode )
+      retcode = write_png_chunk( p->fp, "IEND", NULL, 0 );
+  }
+
+  /* the standard output stays open for the next image of a stream */
+  if( ( p->fp == stdout ) ? fflush( p->fp ) : fclose( p->fp ) )
+    retcode = -1;
+  p->fp = NULL;
+
+  if( retcode )
+    log_error("%s,%d: could not finish image file!\n", __func__, __LINE__ );
+
+  return retcode;
+}
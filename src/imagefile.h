@@ -0,0 +1,118 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef IMAGEFILE_H
+#define IMAGEFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <rendering.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file imagefile.h
+    \brief image files which are written band by band
+
+    The rows of an image are appended in bands from top to bottom, so
+    that an image never has to be held in memory as a whole. Color
+    formats take the colored image of a band, the raw format stores the
+    iteration counts as native 32 bit integers without any header. The
+    path - denotes the standard output, so that a stream of images, e.g.
+    in the headerless RGB format, can be piped into a video encoder.
+
+    Tiled BigTIFF files are written in rectangular chunks instead, in
+    any order. Each chunk is cut into deflated tiles of TIFF_TILE_SIZE
+    pixels whose positions are collected and written with the directory
+    at the end of the file.
+ */
+
+/*! edge length of the tiles of a TIFF file in pixels */
+#define TIFF_TILE_SIZE    256
+
+typedef enum {
+  IMAGE_FORMAT_PPM = 0,
+  IMAGE_FORMAT_PNG,
+  IMAGE_FORMAT_RAW,
+  IMAGE_FORMAT_TIFF,
+  IMAGE_FORMAT_RGB                      /*!< 24 bit pixels without header for video encoders */
+} t_image_format;
+
+
+struct s_png_stream;
+
+typedef struct {
+  FILE*                 fp;
+  t_image_format        format;
+  int                   width;
+  int                   height;
+  int                   rows;           /*!< rows written so far */
+  unsigned char*        line;           /*!< one converted row */
+  struct s_png_stream*  p_png;
+  int                   tiles_across;   /*!< TIFF tiles per row of tiles */
+  long                  nr_tiles;
+  long                  tiles_written;
+  uint64_t*             tile_offsets;
+  uint64_t*             tile_sizes;
+  unsigned char*        tile;           /*!< one uncompressed TIFF tile */
+  unsigned char*        packed;         /*!< one compressed TIFF tile */
+  unsigned long         packed_size;
+} t_image_file;
+
+
+/*!
+ * \return format derived from the file extension .ppm, .png, .raw, .tif
+ * or .rgb or -1 for any other extension
+ */
+int parse_image_format( const char* path );
+
+/*!
+ * create the file and write its header
+ *
+ * \return image file or NULL on error
+ */
+t_image_file* create_image_file( const char* path, const t_image_format format, const int width, const int height );
+
+/*!
+ * like create_image_file() but write to an open stream, e.g. one of
+ * open_memstream(), which is closed together with the image file
+ *
+ * \return image file or NULL on error
+ */
+t_image_file* create_image_stream( FILE* fp, const t_image_format format, const int width, const int height );
+
+/*!
+ * append all rows of a rendered band with the width of the image
+ *
+ * \return 0 on success, -1 on write error
+ */
+int write_image_band( t_image_file* p, const t_parman_data* p_band );
+
+/*!
+ * write all TIFF tiles of a rendered chunk whose upper left pixel lies
+ * at column x0 and row y0 of the image, both multiples of TIFF_TILE_SIZE
+ *
+ * \return 0 on success, -1 on write error
+ */
+int write_image_chunk( t_image_file* p, const t_parman_data* p_chunk, const int x0, const int y0 );
+
+/*!
+ * write the trailer and close the file once all rows or tiles have been appended
+ *
+ * \return 0 on success, -1 on write error
+ */
+int finish_image_file( t_image_file* p );
+
+void release_image_file( t_image_file* p );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef IMAGEFILE_H */
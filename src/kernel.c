@@ -0,0 +1,734 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <kernel.h>
+#include <perturbation.h>
+#include <log.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define SQUARE(x)     ( (x)*(x) )
+
+/* check for cancellation only every STOP_CHECK_MASK+1 iterations */
+#define STOP_CHECK_MASK   0xff
+
+/* mantissa bits beyond pixel resolution to absorb rounding along the orbit */
+#define PRECISION_GUARD_BITS  10
+
+/* upper bound for the distance of an orbit to its saved point to count as periodic */
+#define PERIODICITY_EPSILON   1e-12L
+
+/* escape radius for fractional iteration counts and the steps to reach it */
+#define SMOOTH_BAILOUT        256.0
+#define SMOOTH_MAX_STEPS      64
+
+
+int in_main_cardioid_or_bulb( const long double cr, const long double ci )
+{
+  const long double xq = cr - 0.25L;
+  const long double q = xq * xq + ci * ci;
+
+  if( q * ( q + xq ) <= 0.25L * ci * ci )
+    return 1;
+
+  return SQUARE( cr + 1.0L ) + ci * ci <= 0.0625L;
+}
+
+/*
+ * All kernels detect cycles with Brent's method: the orbit is compared
+ * against a saved point which is replaced after 1, 2, 4, 8, ...
+ * iterations, so that a cycle of any period is found within twice the
+ * iterations it takes the orbit to settle.
+ */
+long double periodicity_threshold( const t_parman_data* p )
+{
+  const long double eps = fminl( fminl( fabsl( p->step_x ), fabsl( p->step_y ) ) / 1024.0L,
+                                 PERIODICITY_EPSILON );
+
+  return eps * eps;
+}
+
+
+void get_expmap_offset( const t_parman_data* p, const int x, const int y, double* p_dcr, double* p_dci )
+{
+  const double r = p->expmap_radius * exp( 2 * M_PI * y / p->res_x );
+  const double phi = 2 * M_PI * x / p->res_x;
+
+  *p_dcr = r * cos( phi );
+  *p_dci = r * sin( phi );
+}
+
+
+/*
+ * Beyond SMOOTH_BAILOUT the number of iterations m and log|z| are tied
+ * together, so that m - log2( log|z| / log SMOOTH_BAILOUT ) is continuous
+ * in c. Escaped orbits are continued up to there, which gives the same
+ * value as iterating with this bailout in the first place.
+ */
+void store_smooth( t_parman_data* p, const int x, const int y, const int count, double zr, double zi )
+{
+  double cr = (double)( p->init_x  +  x * p->step_x );
+  double ci = (double)( p->init_y  +  (p->res_y - y) * p->step_y );
+  double temp, mu, dcr, dci;
+  int m, k;
+
+  if( p->expmap_radius > 0 ) {
+    get_expmap_offset( p, x, y, & dcr, & dci );
+    cr = (double)p->init_x + dcr;
+    ci = (double)p->init_y + dci;
+  }
+
+  if( count >= p->iterations ) {
+    p->smooth_grid[ y * p->res_x + x ] = p->iterations;
+    return;
+  }
+
+  m = count + 1;
+  for( k=0; k < SMOOTH_MAX_STEPS && SQUARE(zr) + SQUARE(zi) < SQUARE(SMOOTH_BAILOUT); ++k, ++m ) {
+    temp = zr * zr - zi * zi + cr;
+    zi = 2 * zr * zi + ci;
+    zr = temp;
+  }
+
+  mu = m - 1 - log2( 0.5 * log( SQUARE(zr) + SQUARE(zi) ) / log( SMOOTH_BAILOUT ) );
+  mu = ( mu > 0.0 ) ? mu : 0.0;
+  mu = ( mu < p->iterations - 1 ) ? mu : p->iterations - 1;
+  p->smooth_grid[ y * p->res_x + x ] = (float)mu;
+}
+
+
+/* pixels resolved by the interior checks on this thread, see take_interior_pixels() */
+static __thread long nr_thread_interior_pixels;
+
+void add_interior_stats( t_parman_data* p, const long nr_bulb, const long nr_periodic )
+{
+  nr_thread_interior_pixels += nr_bulb + nr_periodic;
+  if( nr_bulb )
+    __sync_fetch_and_add( & p->nr_bulb_pixels, nr_bulb );
+  if( nr_periodic )
+    __sync_fetch_and_add( & p->nr_periodic_pixels, nr_periodic );
+}
+
+long take_interior_pixels( void )
+{
+  const long nr_pixels = nr_thread_interior_pixels;
+
+  nr_thread_interior_pixels = 0;
+  return nr_pixels;
+}
+
+
+/*
+ * one pixel at a time, instantiated for double, long double and the
+ * software emulated quad precision type. Pixel coordinates are computed
+ * in ctype which must be at least as wide as long double.
+ */
+#define SCALAR_SPAN_KERNEL( name, type, ctype )                                 \
+static int name( t_parman_data* p, const int y, const int x0, const int n, const int dx, \
+                 volatile int* p_stop )                                         \
+{                                                                               \
+  int* p_grid = & p->grid[ y * p->res_x ];                                      \
+  const int max_iter = p->iterations;                                           \
+  const ctype cy = (ctype)p->init_y  +  (p->res_y - y) * (ctype)p->step_y;      \
+  const type ci = cy;                                                           \
+  const int checks = p->interior_checks;                                        \
+  const int smooth = p->smooth_grid != NULL;                                    \
+  const type eps2 = periodicity_threshold( p );                                 \
+  type z, zi, c, temp, saved_r, saved_i;                                        \
+  ctype cx;                                                                     \
+  long nr_bulb = 0, nr_periodic = 0;                                            \
+  int k, x, iter, lam, power;                                                   \
+                                                                                \
+  for( k=0, x=x0; k < n; ++k, x += dx ) {                                       \
+    cx = (ctype)p->init_x  +  x * (ctype)p->step_x;                             \
+    if( checks && in_main_cardioid_or_bulb( cx, cy ) ) {                        \
+      p_grid[x] = max_iter;                                                     \
+      if( smooth )                                                              \
+        store_smooth( p, x, y, max_iter, 0, 0 );                                \
+      ++nr_bulb;                                                                \
+      continue;                                                                 \
+    }                                                                           \
+                                                                                \
+    z  = 0; zi = 0;                                                             \
+    saved_r = 0; saved_i = 0;                                                   \
+    lam = 0; power = 1;                                                         \
+    c  = cx;                                                                    \
+    iter = 0;                                                                   \
+                                                                                \
+    do {                                                                        \
+      temp = z * z - zi * zi + c;                                               \
+      zi = 2 * z * zi + ci;                                                     \
+      z = temp;                                                                 \
+                                                                                \
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )                          \
+        return -1;                                                              \
+                                                                                \
+      if( checks ) {                                                            \
+        if( SQUARE(z - saved_r) + SQUARE(zi - saved_i) < eps2 ) {               \
+          iter = max_iter;                                                      \
+          ++nr_periodic;                                                        \
+          break;                                                                \
+        }                                                                       \
+        if( ++lam == power ) {                                                  \
+          saved_r = z; saved_i = zi;                                            \
+          power <<= 1; lam = 0;                                                 \
+        }                                                                       \
+      }                                                                         \
+    } while( (SQUARE(z) + SQUARE(zi)) < 4.0 && ++iter < max_iter );             \
+                                                                                \
+    p_grid[x] = iter;                                                           \
+    if( smooth )                                                                \
+      store_smooth( p, x, y, iter, (double)z, (double)zi );                     \
+  }                                                                             \
+                                                                                \
+  add_interior_stats( p, nr_bulb, nr_periodic );                                \
+  return 0;                                                                     \
+}
+
+SCALAR_SPAN_KERNEL( span_long_double, long double, long double )
+SCALAR_SPAN_KERNEL( span_double, double, long double )
+#ifdef __SIZEOF_FLOAT128__
+SCALAR_SPAN_KERNEL( span_float128, __float128, __float128 )
+#endif
+
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * Vectorized kernels iterate a group of pixels in lock step. Lanes which
+ * have escaped are masked out of the iteration count and the group is
+ * done as soon as no lane is active anymore. Coordinates are computed in
+ * long double and rounded once, so that they match the scalar kernel.
+ */
+
+__attribute__((target("avx2,fma")))
+static int span_float_avx2( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                            volatile int* p_stop )
+{
+  int* p_grid = & p->grid[ y * p->res_x ];
+  const int max_iter = p->iterations;
+  const __m256 four = _mm256_set1_ps( 4.0f );
+  const __m256 one = _mm256_set1_ps( 1.0f );
+  const long double cy = p->init_y  +  (p->res_y - y) * p->step_y;
+  const __m256 ci = _mm256_set1_ps( (float)cy );
+  const __m256 eps2 = _mm256_set1_ps( (float)periodicity_threshold( p ) );
+  const __m256 maxv = _mm256_set1_ps( max_iter );
+  const int checks = p->interior_checks;
+  const int smooth = p->smooth_grid != NULL;
+  __m256 c, zr, zi, zr2, zi2, cnt, saved_r, saved_i, active, periodic, bounded, esc_r, esc_i;
+  float lane_c[8], lane_cnt[8], lane_zr[8], lane_zi[8];
+  long nr_bulb = 0, nr_periodic = 0;
+  int k, l, x, iter, lam, power, periodic_lanes, inside;
+
+  for( k=0; k < n; k += 8 ) {
+    for( l=0; l < 8; ++l ) {
+      x = x0 + ( (k + l < n) ? k + l : n - 1 ) * dx;
+      lane_c[l] = (float)( p->init_x  +  x * p->step_x );
+      inside = checks && in_main_cardioid_or_bulb( p->init_x  +  x * p->step_x, cy );
+      lane_cnt[l] = inside ? max_iter : 0;
+      nr_bulb += inside && k + l < n;
+    }
+
+    c = _mm256_loadu_ps( lane_c );
+    zr = _mm256_setzero_ps();
+    zi = _mm256_setzero_ps();
+    cnt = _mm256_loadu_ps( lane_cnt );
+    active = _mm256_cmp_ps( cnt, _mm256_setzero_ps(), _CMP_EQ_OQ );
+    saved_r = _mm256_setzero_ps();
+    saved_i = _mm256_setzero_ps();
+    esc_r = _mm256_setzero_ps();
+    esc_i = _mm256_setzero_ps();
+    lam = 0; power = 1; periodic_lanes = 0;
+
+    for( iter=0; iter < max_iter; ++iter ) {
+      zr2 = _mm256_mul_ps( zr, zr );
+      zi2 = _mm256_mul_ps( zi, zi );
+      zi = _mm256_fmadd_ps( _mm256_add_ps( zr, zr ), zi, ci );
+      zr = _mm256_add_ps( _mm256_sub_ps( zr2, zi2 ), c );
+
+      zr2 = _mm256_mul_ps( zr, zr );
+      zi2 = _mm256_mul_ps( zi, zi );
+      bounded = _mm256_cmp_ps( _mm256_add_ps( zr2, zi2 ), four, _CMP_LT_OQ );
+      if( smooth ) {
+        esc_r = _mm256_blendv_ps( esc_r, zr, _mm256_andnot_ps( bounded, active ) );
+        esc_i = _mm256_blendv_ps( esc_i, zi, _mm256_andnot_ps( bounded, active ) );
+      }
+      active = _mm256_and_ps( active, bounded );
+      if( _mm256_movemask_ps( active ) == 0 )
+        break;
+      cnt = _mm256_add_ps( cnt, _mm256_and_ps( active, one ) );
+
+      if( checks ) {
+        zr2 = _mm256_sub_ps( zr, saved_r );
+        zi2 = _mm256_sub_ps( zi, saved_i );
+        periodic = _mm256_cmp_ps( _mm256_fmadd_ps( zr2, zr2, _mm256_mul_ps( zi2, zi2 ) ), eps2, _CMP_LT_OQ );
+        periodic = _mm256_and_ps( active, periodic );
+        if( _mm256_movemask_ps( periodic ) ) {
+          cnt = _mm256_blendv_ps( cnt, maxv, periodic );
+          active = _mm256_andnot_ps( periodic, active );
+          periodic_lanes |= _mm256_movemask_ps( periodic );
+        }
+        if( ++lam == power ) {
+          saved_r = zr; saved_i = zi;
+          power <<= 1; lam = 0;
+        }
+      }
+
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )
+        return -1;
+    }
+
+    nr_periodic += __builtin_popcount( periodic_lanes & ( ( 1 << ( n - k < 8 ? n - k : 8 ) ) - 1 ) );
+    _mm256_storeu_ps( lane_cnt, cnt );
+    for( l=0; l < 8 && k + l < n; ++l )
+      p_grid[ x0 + (k + l) * dx ] = (int)lane_cnt[l];
+
+    if( smooth ) {
+      _mm256_storeu_ps( lane_zr, esc_r );
+      _mm256_storeu_ps( lane_zi, esc_i );
+      for( l=0; l < 8 && k + l < n; ++l )
+        store_smooth( p, x0 + (k + l) * dx, y, (int)lane_cnt[l], lane_zr[l], lane_zi[l] );
+    }
+  }
+
+  add_interior_stats( p, nr_bulb, nr_periodic );
+  return 0;
+}
+
+__attribute__((target("avx512f")))
+static int span_float_avx512( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                              volatile int* p_stop )
+{
+  int* p_grid = & p->grid[ y * p->res_x ];
+  const int max_iter = p->iterations;
+  const __m512 four = _mm512_set1_ps( 4.0f );
+  const __m512 one = _mm512_set1_ps( 1.0f );
+  const long double cy = p->init_y  +  (p->res_y - y) * p->step_y;
+  const __m512 ci = _mm512_set1_ps( (float)cy );
+  const __m512 eps2 = _mm512_set1_ps( (float)periodicity_threshold( p ) );
+  const __m512 maxv = _mm512_set1_ps( max_iter );
+  const int checks = p->interior_checks;
+  const int smooth = p->smooth_grid != NULL;
+  __m512 c, zr, zi, zr2, zi2, cnt, saved_r, saved_i, esc_r, esc_i;
+  __mmask16 active, bounded;
+  float lane_c[16], lane_cnt[16], lane_zr[16], lane_zi[16];
+  long nr_bulb = 0, nr_periodic = 0;
+  int k, l, x, iter, lam, power, periodic_lanes, inside;
+
+  for( k=0; k < n; k += 16 ) {
+    for( l=0; l < 16; ++l ) {
+      x = x0 + ( (k + l < n) ? k + l : n - 1 ) * dx;
+      lane_c[l] = (float)( p->init_x  +  x * p->step_x );
+      inside = checks && in_main_cardioid_or_bulb( p->init_x  +  x * p->step_x, cy );
+      lane_cnt[l] = inside ? max_iter : 0;
+      nr_bulb += inside && k + l < n;
+    }
+
+    c = _mm512_loadu_ps( lane_c );
+    zr = _mm512_setzero_ps();
+    zi = _mm512_setzero_ps();
+    cnt = _mm512_loadu_ps( lane_cnt );
+    active = _mm512_cmp_ps_mask( cnt, _mm512_setzero_ps(), _CMP_EQ_OQ );
+    saved_r = _mm512_setzero_ps();
+    saved_i = _mm512_setzero_ps();
+    esc_r = _mm512_setzero_ps();
+    esc_i = _mm512_setzero_ps();
+    lam = 0; power = 1; periodic_lanes = 0;
+
+    for( iter=0; iter < max_iter; ++iter ) {
+      zr2 = _mm512_mul_ps( zr, zr );
+      zi2 = _mm512_mul_ps( zi, zi );
+      zi = _mm512_fmadd_ps( _mm512_add_ps( zr, zr ), zi, ci );
+      zr = _mm512_add_ps( _mm512_sub_ps( zr2, zi2 ), c );
+
+      zr2 = _mm512_mul_ps( zr, zr );
+      zi2 = _mm512_mul_ps( zi, zi );
+      bounded = _mm512_mask_cmp_ps_mask( active, _mm512_add_ps( zr2, zi2 ), four, _CMP_LT_OQ );
+      if( smooth ) {
+        esc_r = _mm512_mask_mov_ps( esc_r, active & ~bounded, zr );
+        esc_i = _mm512_mask_mov_ps( esc_i, active & ~bounded, zi );
+      }
+      active = bounded;
+      if( active == 0 )
+        break;
+      cnt = _mm512_mask_add_ps( cnt, active, cnt, one );
+
+      if( checks ) {
+        __mmask16 periodic;
+
+        zr2 = _mm512_sub_ps( zr, saved_r );
+        zi2 = _mm512_sub_ps( zi, saved_i );
+        periodic = _mm512_mask_cmp_ps_mask( active, _mm512_fmadd_ps( zr2, zr2, _mm512_mul_ps( zi2, zi2 ) ),
+                                              eps2, _CMP_LT_OQ );
+        if( periodic ) {
+          cnt = _mm512_mask_mov_ps( cnt, periodic, maxv );
+          active &= ~periodic;
+          periodic_lanes |= periodic;
+        }
+        if( ++lam == power ) {
+          saved_r = zr; saved_i = zi;
+          power <<= 1; lam = 0;
+        }
+      }
+
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )
+        return -1;
+    }
+
+    nr_periodic += __builtin_popcount( periodic_lanes & ( ( 1 << ( n - k < 16 ? n - k : 16 ) ) - 1 ) );
+    _mm512_storeu_ps( lane_cnt, cnt );
+    for( l=0; l < 16 && k + l < n; ++l )
+      p_grid[ x0 + (k + l) * dx ] = (int)lane_cnt[l];
+
+    if( smooth ) {
+      _mm512_storeu_ps( lane_zr, esc_r );
+      _mm512_storeu_ps( lane_zi, esc_i );
+      for( l=0; l < 16 && k + l < n; ++l )
+        store_smooth( p, x0 + (k + l) * dx, y, (int)lane_cnt[l], lane_zr[l], lane_zi[l] );
+    }
+  }
+
+  add_interior_stats( p, nr_bulb, nr_periodic );
+  return 0;
+}
+
+__attribute__((target("avx2,fma")))
+static int span_double_avx2( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                             volatile int* p_stop )
+{
+  int* p_grid = & p->grid[ y * p->res_x ];
+  const int max_iter = p->iterations;
+  const __m256d four = _mm256_set1_pd( 4.0 );
+  const __m256d one = _mm256_set1_pd( 1.0 );
+  const long double cy = p->init_y  +  (p->res_y - y) * p->step_y;
+  const __m256d ci = _mm256_set1_pd( (double)cy );
+  const __m256d eps2 = _mm256_set1_pd( (double)periodicity_threshold( p ) );
+  const __m256d maxv = _mm256_set1_pd( max_iter );
+  const int checks = p->interior_checks;
+  const int smooth = p->smooth_grid != NULL;
+  __m256d c, zr, zi, zr2, zi2, cnt, saved_r, saved_i, active, periodic, bounded, esc_r, esc_i;
+  double lane_c[4], lane_cnt[4], lane_zr[4], lane_zi[4];
+  long nr_bulb = 0, nr_periodic = 0;
+  int k, l, x, iter, lam, power, periodic_lanes, inside;
+
+  for( k=0; k < n; k += 4 ) {
+    for( l=0; l < 4; ++l ) {
+      x = x0 + ( (k + l < n) ? k + l : n - 1 ) * dx;
+      lane_c[l] = (double)( p->init_x  +  x * p->step_x );
+      inside = checks && in_main_cardioid_or_bulb( p->init_x  +  x * p->step_x, cy );
+      lane_cnt[l] = inside ? max_iter : 0;
+      nr_bulb += inside && k + l < n;
+    }
+
+    c = _mm256_loadu_pd( lane_c );
+    zr = _mm256_setzero_pd();
+    zi = _mm256_setzero_pd();
+    cnt = _mm256_loadu_pd( lane_cnt );
+    active = _mm256_cmp_pd( cnt, _mm256_setzero_pd(), _CMP_EQ_OQ );
+    saved_r = _mm256_setzero_pd();
+    saved_i = _mm256_setzero_pd();
+    esc_r = _mm256_setzero_pd();
+    esc_i = _mm256_setzero_pd();
+    lam = 0; power = 1; periodic_lanes = 0;
+
+    for( iter=0; iter < max_iter; ++iter ) {
+      zr2 = _mm256_mul_pd( zr, zr );
+      zi2 = _mm256_mul_pd( zi, zi );
+      zi = _mm256_fmadd_pd( _mm256_add_pd( zr, zr ), zi, ci );
+      zr = _mm256_add_pd( _mm256_sub_pd( zr2, zi2 ), c );
+
+      zr2 = _mm256_mul_pd( zr, zr );
+      zi2 = _mm256_mul_pd( zi, zi );
+      bounded = _mm256_cmp_pd( _mm256_add_pd( zr2, zi2 ), four, _CMP_LT_OQ );
+      if( smooth ) {
+        esc_r = _mm256_blendv_pd( esc_r, zr, _mm256_andnot_pd( bounded, active ) );
+        esc_i = _mm256_blendv_pd( esc_i, zi, _mm256_andnot_pd( bounded, active ) );
+      }
+      active = _mm256_and_pd( active, bounded );
+      if( _mm256_movemask_pd( active ) == 0 )
+        break;
+      cnt = _mm256_add_pd( cnt, _mm256_and_pd( active, one ) );
+
+      if( checks ) {
+        zr2 = _mm256_sub_pd( zr, saved_r );
+        zi2 = _mm256_sub_pd( zi, saved_i );
+        periodic = _mm256_cmp_pd( _mm256_fmadd_pd( zr2, zr2, _mm256_mul_pd( zi2, zi2 ) ), eps2, _CMP_LT_OQ );
+        periodic = _mm256_and_pd( active, periodic );
+        if( _mm256_movemask_pd( periodic ) ) {
+          cnt = _mm256_blendv_pd( cnt, maxv, periodic );
+          active = _mm256_andnot_pd( periodic, active );
+          periodic_lanes |= _mm256_movemask_pd( periodic );
+        }
+        if( ++lam == power ) {
+          saved_r = zr; saved_i = zi;
+          power <<= 1; lam = 0;
+        }
+      }
+
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )
+        return -1;
+    }
+
+    nr_periodic += __builtin_popcount( periodic_lanes & ( ( 1 << ( n - k < 4 ? n - k : 4 ) ) - 1 ) );
+    _mm256_storeu_pd( lane_cnt, cnt );
+    for( l=0; l < 4 && k + l < n; ++l )
+      p_grid[ x0 + (k + l) * dx ] = (int)lane_cnt[l];
+
+    if( smooth ) {
+      _mm256_storeu_pd( lane_zr, esc_r );
+      _mm256_storeu_pd( lane_zi, esc_i );
+      for( l=0; l < 4 && k + l < n; ++l )
+        store_smooth( p, x0 + (k + l) * dx, y, (int)lane_cnt[l], lane_zr[l], lane_zi[l] );
+    }
+  }
+
+  add_interior_stats( p, nr_bulb, nr_periodic );
+  return 0;
+}
+
+__attribute__((target("avx512f")))
+static int span_double_avx512( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                               volatile int* p_stop )
+{
+  int* p_grid = & p->grid[ y * p->res_x ];
+  const int max_iter = p->iterations;
+  const __m512d four = _mm512_set1_pd( 4.0 );
+  const __m512d one = _mm512_set1_pd( 1.0 );
+  const long double cy = p->init_y  +  (p->res_y - y) * p->step_y;
+  const __m512d ci = _mm512_set1_pd( (double)cy );
+  const __m512d eps2 = _mm512_set1_pd( (double)periodicity_threshold( p ) );
+  const __m512d maxv = _mm512_set1_pd( max_iter );
+  const int checks = p->interior_checks;
+  const int smooth = p->smooth_grid != NULL;
+  __m512d c, zr, zi, zr2, zi2, cnt, saved_r, saved_i, esc_r, esc_i;
+  __mmask8 active, bounded;
+  double lane_c[8], lane_cnt[8], lane_zr[8], lane_zi[8];
+  long nr_bulb = 0, nr_periodic = 0;
+  int k, l, x, iter, lam, power, periodic_lanes, inside;
+
+  for( k=0; k < n; k += 8 ) {
+    for( l=0; l < 8; ++l ) {
+      x = x0 + ( (k + l < n) ? k + l : n - 1 ) * dx;
+      lane_c[l] = (double)( p->init_x  +  x * p->step_x );
+      inside = checks && in_main_cardioid_or_bulb( p->init_x  +  x * p->step_x, cy );
+      lane_cnt[l] = inside ? max_iter : 0;
+      nr_bulb += inside && k + l < n;
+    }
+
+    c = _mm512_loadu_pd( lane_c );
+    zr = _mm512_setzero_pd();
+    zi = _mm512_setzero_pd();
+    cnt = _mm512_loadu_pd( lane_cnt );
+    active = _mm512_cmp_pd_mask( cnt, _mm512_setzero_pd(), _CMP_EQ_OQ );
+    saved_r = _mm512_setzero_pd();
+    saved_i = _mm512_setzero_pd();
+    esc_r = _mm512_setzero_pd();
+    esc_i = _mm512_setzero_pd();
+    lam = 0; power = 1; periodic_lanes = 0;
+
+    for( iter=0; iter < max_iter; ++iter ) {
+      zr2 = _mm512_mul_pd( zr, zr );
+      zi2 = _mm512_mul_pd( zi, zi );
+      zi = _mm512_fmadd_pd( _mm512_add_pd( zr, zr ), zi, ci );
+      zr = _mm512_add_pd( _mm512_sub_pd( zr2, zi2 ), c );
+
+      zr2 = _mm512_mul_pd( zr, zr );
+      zi2 = _mm512_mul_pd( zi, zi );
+      bounded = _mm512_mask_cmp_pd_mask( active, _mm512_add_pd( zr2, zi2 ), four, _CMP_LT_OQ );
+      if( smooth ) {
+        esc_r = _mm512_mask_mov_pd( esc_r, active & ~bounded, zr );
+        esc_i = _mm512_mask_mov_pd( esc_i, active & ~bounded, zi );
+      }
+      active = bounded;
+      if( active == 0 )
+        break;
+      cnt = _mm512_mask_add_pd( cnt, active, cnt, one );
+
+      if( checks ) {
+        __mmask8 periodic;
+
+        zr2 = _mm512_sub_pd( zr, saved_r );
+        zi2 = _mm512_sub_pd( zi, saved_i );
+        periodic = _mm512_mask_cmp_pd_mask( active, _mm512_fmadd_pd( zr2, zr2, _mm512_mul_pd( zi2, zi2 ) ),
+                                              eps2, _CMP_LT_OQ );
+        if( periodic ) {
+          cnt = _mm512_mask_mov_pd( cnt, periodic, maxv );
+          active &= ~periodic;
+          periodic_lanes |= periodic;
+        }
+        if( ++lam == power ) {
+          saved_r = zr; saved_i = zi;
+          power <<= 1; lam = 0;
+        }
+      }
+
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )
+        return -1;
+    }
+
+    nr_periodic += __builtin_popcount( periodic_lanes & ( ( 1 << ( n - k < 8 ? n - k : 8 ) ) - 1 ) );
+    _mm512_storeu_pd( lane_cnt, cnt );
+    for( l=0; l < 8 && k + l < n; ++l )
+      p_grid[ x0 + (k + l) * dx ] = (int)lane_cnt[l];
+
+    if( smooth ) {
+      _mm512_storeu_pd( lane_zr, esc_r );
+      _mm512_storeu_pd( lane_zi, esc_i );
+      for( l=0; l < 8 && k + l < n; ++l )
+        store_smooth( p, x0 + (k + l) * dx, y, (int)lane_cnt[l], lane_zr[l], lane_zi[l] );
+    }
+  }
+
+  add_interior_stats( p, nr_bulb, nr_periodic );
+  return 0;
+}
+
+#endif /* #ifdef HAVE_X86_SIMD */
+
+
+static const char* precision_names[ PARMAN_NR_PRECISIONS ] = {
+  "auto",
+  "float-avx2",
+  "float-avx512",
+  "double",
+  "avx2",
+  "avx512",
+  "longdouble",
+  "float128",
+  "perturbation",
+  "perturbation-avx2"
+};
+
+
+/*
+ * tiers ordered by cost, the first supported one with sufficient
+ * mantissa bits is used for automatic selection. Beyond long double the
+ * perturbation tiers take over, quad precision is only used on demand.
+ */
+static const struct {
+  t_parman_precision    precision;
+  int                   mantissa_bits;
+} precision_ladder[] = {
+  { PARMAN_PRECISION_FLOAT_AVX512,      FLT_MANT_DIG },
+  { PARMAN_PRECISION_FLOAT_AVX2,        FLT_MANT_DIG },
+  { PARMAN_PRECISION_DOUBLE_AVX512,     DBL_MANT_DIG },
+  { PARMAN_PRECISION_DOUBLE_AVX2,       DBL_MANT_DIG },
+  { PARMAN_PRECISION_DOUBLE,            DBL_MANT_DIG },
+  { PARMAN_PRECISION_LONG_DOUBLE,       LDBL_MANT_DIG },
+  { PARMAN_PRECISION_PERTURBATION_AVX2, BIGFIX_FRAC_BITS },
+  { PARMAN_PRECISION_PERTURBATION,      BIGFIX_FRAC_BITS },
+};
+
+int is_perturbation( const t_parman_precision precision )
+{
+  return precision == PARMAN_PRECISION_PERTURBATION || precision == PARMAN_PRECISION_PERTURBATION_AVX2;
+}
+
+const char* precision_name( const t_parman_precision precision )
+{
+  if( precision < 0 || precision >= PARMAN_NR_PRECISIONS )
+    return "unknown";
+
+  return precision_names[ precision ];
+}
+
+int parse_precision( const char* name )
+{
+  int i;
+
+  for( i=0; i < PARMAN_NR_PRECISIONS; ++i ) {
+    if( ! strcmp( name, precision_names[i] ) )
+      return i;
+  }
+
+  return -1;
+}
+
+t_span_kernel get_span_kernel( const t_parman_precision precision )
+{
+  switch( precision ) {
+  case PARMAN_PRECISION_DOUBLE:
+    return span_double;
+
+#ifdef HAVE_X86_SIMD
+  case PARMAN_PRECISION_FLOAT_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ? span_float_avx2 : NULL;
+
+  case PARMAN_PRECISION_FLOAT_AVX512:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx512f" ) ? span_float_avx512 : NULL;
+
+  case PARMAN_PRECISION_DOUBLE_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ? span_double_avx2 : NULL;
+
+  case PARMAN_PRECISION_DOUBLE_AVX512:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx512f" ) ? span_double_avx512 : NULL;
+#endif
+
+  case PARMAN_PRECISION_LONG_DOUBLE:
+    return span_long_double;
+
+#ifdef __SIZEOF_FLOAT128__
+  case PARMAN_PRECISION_FLOAT128:
+    return span_float128;
+#endif
+
+  case PARMAN_PRECISION_PERTURBATION:
+  case PARMAN_PRECISION_PERTURBATION_AVX2:
+    return get_perturbation_kernel( precision );
+
+  default:
+    return NULL;
+  }
+}
+
+/*
+ * Adjacent pixels are resolved when the step is larger than the spacing
+ * of representable numbers at the largest coordinate of the view. The
+ * number of mantissa bits this takes plus some guard bits decides which
+ * tier of the ladder is sufficient.
+ */
+t_parman_precision select_precision( const t_parman_data* p )
+{
+  const long double max_x = fmaxl( fabsl( p->init_x ), fabsl( p->init_x + p->res_x * p->step_x ) );
+  const long double max_y = fmaxl( fabsl( p->init_y ), fabsl( p->init_y + p->res_y * p->step_y ) );
+  const long double step = fminl( fabsl( p->step_x ), fabsl( p->step_y ) );
+  const long double magnitude = fmaxl( fmaxl( max_x, max_y ), 2.0L );
+  const int nr_tiers = sizeof( precision_ladder ) / sizeof( precision_ladder[0] );
+  t_parman_precision precision = PARMAN_PRECISION_LONG_DOUBLE;
+  int required_bits, i;
+
+  required_bits = (int)ceill( log2l( magnitude / step ) ) + PRECISION_GUARD_BITS;
+
+  for( i=0; i < nr_tiers; ++i ) {
+    if( get_span_kernel( precision_ladder[i].precision ) ) {
+      precision = precision_ladder[i].precision;
+      if( precision_ladder[i].mantissa_bits >= required_bits )
+        break;
+    }
+  }
+
+  if( i == nr_tiers )
+    log_error("%s,%d: %d mantissa bits required, image will be distorted with %s kernel!\n",
+              __func__, __LINE__, required_bits, precision_name( precision ) );
+  else
+    log_message("step %Lg requires %d mantissa bits, using %s kernel\n",
+                step, required_bits, precision_name( precision ) );
+
+  return precision;
+}
@@ -0,0 +1,85 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <rendering.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file kernel.h
+    \brief escape-time iteration kernels
+ */
+
+/*!
+ * \return kernel for the given tier or NULL if not supported by the processor
+ */
+t_span_kernel get_span_kernel( const t_parman_precision precision );
+
+/*!
+ * resolve PARMAN_PRECISION_AUTO to the tier which is used for the given image
+ */
+t_parman_precision select_precision( const t_parman_data* p );
+
+/*!
+ * \return true for the tiers which iterate differences to a reference orbit
+ */
+int is_perturbation( const t_parman_precision precision );
+
+/*!
+ * \return true when c lies within the main cardioid or the period-2 bulb
+ */
+int in_main_cardioid_or_bulb( const long double cr, const long double ci );
+
+/*!
+ * squared distance below which an orbit is considered to be periodic,
+ * small compared to the pixel size of the image
+ */
+long double periodicity_threshold( const t_parman_data* p );
+
+/*!
+ * add the pixels resolved by interior checks within one span to the
+ * counters of the frame
+ */
+void add_interior_stats( t_parman_data* p, const long nr_bulb, const long nr_periodic );
+
+/*!
+ * \return pixels resolved by interior checks on the calling thread since
+ * the last call, these have not been iterated up to the maximum depth
+ */
+long take_interior_pixels( void );
+
+/*!
+ * offset of a pixel of an exponential map to its center (init_x, init_y):
+ * column x is the angle 2 pi x / res_x and row y lies at the radius
+ * expmap_radius * exp( 2 pi y / res_x ), so that pixels are square
+ */
+void get_expmap_offset( const t_parman_data* p, const int x, const int y, double* p_dcr, double* p_dci );
+
+/*!
+ * store the fractional iteration count of the pixel whose orbit has
+ * left the escape radius of 2 after count iterations at z, or the
+ * iteration depth for interior pixels
+ */
+void store_smooth( t_parman_data* p, const int x, const int y, const int count, double zr, double zi );
+
+const char* precision_name( const t_parman_precision precision );
+
+/*!
+ * \return tier with the given name or -1 if there is none
+ */
+int parse_precision( const char* name );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef KERNEL_H */
@@ -8,18 +8,34 @@
 #include <unistd.h>
 #include <sdlif.h>
 #include <console.h>
+#include <batch.h>
+#include <animation.h>
+#include <expmap.h>
+#include <cluster.h>
+#include <server.h>
+#include <stats.h>
+#include <kernel.h>
 #include <log.h>
 #include <getopt.h>
 
 #define MAX_THREADS     1000
-#define MAX_ITERATIONS  1000000
 
-static int start_gui( const int nr_threads, const int iterations )
+/* default memory budget of the tile cache in megabytes */
+#define TILE_CACHE_MB   64
+
+/* default number of frames of a zoom sequence which halve the width */
+#define OCTAVE_FRAMES   30
+
+/* default memory budget of the bands in flight when rendering to a file in megabytes */
+#define BATCH_BAND_MB   64
+
+static int start_gui( t_thread_pool* p_pool, const int iterations, const int palette,
+                      const char* cost_map_path )
 {
   t_gui* p_gui;
   int retcode, i, j, all_done;
 
-  p_gui = create_gui( nr_threads, iterations );
+  p_gui = create_gui( p_pool, iterations, palette, cost_map_path );
   if( p_gui == NULL ) {
     return -1;
   }
@@ -28,7 +44,9 @@ static int start_gui( const int nr_threads, const int iterations )
   printf("Created by Otto Linnemann\n\n");
   printf("Copyright 2019 GNU General Public Licence. All rights reserved\n\n");
   printf("Drag with left mouse key the area to enlarge.\n");
-  printf("Use right mouse key or two finger tap on the Mac to zoom out.\n\n");
+  printf("Use right mouse key or two finger tap on the Mac to zoom out.\n");
+  printf("Press p to switch the palette, + and - to double or halve the iterations.\n");
+  printf("Press s to show the busy time of every thread.\n\n");
 
   while( ! p_gui->done ) {
     // printf("looping ...\n");
@@ -51,7 +69,69 @@ static void help( char* name )
   printf("--iterations\n-i\n");
   printf("\tMaximum number of iterations\n\n");
   printf("--threads\n-t\n");
-  printf("\tNumber of processing threads\n\n");
+  printf("\tNumber of processing threads, defaults to one per processor\n\n");
+  printf("--precision\n-p\n");
+  printf("\tForce kernel tier: float-avx2, float-avx512, double, avx2, avx512,\n");
+  printf("\tlongdouble, float128, perturbation or perturbation-avx2\n");
+  printf("\t(default: auto, chosen from the zoom depth)\n\n");
+  printf("--no-interior-checks\n-c\n");
+  printf("\tIterate all pixels, also those recognized as inside the set\n\n");
+  printf("--subdivide\n-s\n");
+  printf("\tFill rectangles with uniform border instead of iterating their pixels\n\n");
+  printf("--smooth\n-f\n");
+  printf("\tColor with fractional iteration counts instead of bands,\n");
+  printf("\tthis disables the tile cache\n\n");
+  printf("--palette\n-l\n");
+  printf("\tColor palette: default, fire, ocean or gray\n\n");
+  printf("--tile-cache\n-m\n");
+  printf("\tMemory budget in megabytes for tiles shared between frames,\n");
+  printf("\t0 disables the tile cache (default: %d)\n\n", TILE_CACHE_MB );
+  printf("--batch\n-b\n");
+  printf("\tRender to a file instead of a window, the format is chosen by the\n");
+  printf("\textension .ppm, .png, .tif (tiled BigTIFF of any size), .rgb (24 bit\n");
+  printf("\tpixels without header) or .raw (iteration counts as 32 bit integers),\n");
+  printf("\t- writes RGB pixels to the standard output\n\n");
+  printf("--zoom-to\n-z\n");
+  printf("\tRender a zoom sequence into the center down to this width, the file\n");
+  printf("\tgiven by --batch is a pattern for the frame number such as zoom%%05d.png\n\n");
+  printf("--octave-frames\n-k\n");
+  printf("\tNumber of frames of a zoom sequence which halve the width (default: %d)\n\n", OCTAVE_FRAMES );
+  printf("--expmap\n-a\n");
+  printf("\tRender a zoom sequence once as an exponential map and remap all\n");
+  printf("\tframes from it, much faster but interpolated\n\n");
+  printf("--grid\n-g\n");
+  printf("\tRender the file given by --batch through this grid file of iteration\n");
+  printf("\tcounts, an interrupted rendering of the same view is resumed\n\n");
+  printf("--load\n-o\n");
+  printf("\tColor the iterations of this grid file into the file given by --batch\n");
+  printf("\tinstead of rendering, the view is taken from the grid file\n\n");
+  printf("--workers\n-j\n");
+  printf("\tRender the file given by --batch on worker processes at these comma\n");
+  printf("\tseparated addresses such as host:7000,unix:/tmp/worker.sock\n\n");
+  printf("--worker\n-u\n");
+  printf("\tServe as worker process at this address, e.g. 7000 or unix:/tmp/worker.sock\n\n");
+  printf("--serve\n-v\n");
+  printf("\tServe map tiles /z/x/y.png over HTTP at this address, e.g. 8080\n\n");
+  printf("--tile-dir\n-d\n");
+  printf("\tKeep the tiles served over HTTP also in this directory\n\n");
+  printf("--memory\n-e\n");
+  printf("\tMemory budget in megabytes for the pixels in flight when rendering\n");
+  printf("\tto a file or for the tiles kept by --serve (default: %d)\n\n", BATCH_BAND_MB );
+  printf("--center-x\n-x\n");
+  printf("--center-y\n-y\n");
+  printf("\tCenter of the rendered view at full precision (default: -0.75 and 0)\n\n");
+  printf("--width\n-w\n");
+  printf("\tWidth of the rendered view (default: 3)\n\n");
+  printf("--resolution\n-r\n");
+  printf("\tImage size in pixels as WIDTHxHEIGHT (default: 1920x1080)\n\n");
+  printf("--stats\n-q\n");
+  printf("\tWrite the work of every thread during the whole run as JSON to this file\n\n");
+  printf("--trace\n-T\n");
+  printf("\tWrite every tile processed by the threads to this file in the Chrome\n");
+  printf("\ttrace event format, e.g. for chrome://tracing or ui.perfetto.dev\n\n");
+  printf("--cost-map\n-C\n");
+  printf("\tWrite the cost of every tile of each completed frame of the window,\n");
+  printf("\tthe console or a zoom sequence to this PGM file, one pixel per tile\n\n");
   printf("--nogui\n-n\n");
   printf("\tInvoke with text console\n\n");
   printf("--help\n-h\n");
@@ -68,12 +148,61 @@ int main(int argc, char* argv[])
     { "threads", required_argument, NULL, 't' },
     { "iterations", required_argument, NULL, 'i' },
     { "nogui", no_argument, NULL, 'n' },
+    { "precision", required_argument, NULL, 'p' },
+    { "no-interior-checks", no_argument, NULL, 'c' },
+    { "subdivide", no_argument, NULL, 's' },
+    { "smooth", no_argument, NULL, 'f' },
+    { "tile-cache", required_argument, NULL, 'm' },
+    { "palette", required_argument, NULL, 'l' },
+    { "batch", required_argument, NULL, 'b' },
+    { "center-x", required_argument, NULL, 'x' },
+    { "center-y", required_argument, NULL, 'y' },
+    { "width", required_argument, NULL, 'w' },
+    { "resolution", required_argument, NULL, 'r' },
+    { "memory", required_argument, NULL, 'e' },
+    { "grid", required_argument, NULL, 'g' },
+    { "load", required_argument, NULL, 'o' },
+    { "zoom-to", required_argument, NULL, 'z' },
+    { "octave-frames", required_argument, NULL, 'k' },
+    { "expmap", no_argument, NULL, 'a' },
+    { "workers", required_argument, NULL, 'j' },
+    { "worker", required_argument, NULL, 'u' },
+    { "serve", required_argument, NULL, 'v' },
+    { "tile-dir", required_argument, NULL, 'd' },
+    { "stats", required_argument, NULL, 'q' },
+    { "trace", required_argument, NULL, 'T' },
+    { "cost-map", required_argument, NULL, 'C' },
+    { NULL, 0, NULL, 0 }
   };
-  int nr_threads = 200;
+  int nr_threads = 0;
   int iterations = 1000;
   int headless = 0;
+  int precision;
+  int tile_cache_mb = TILE_CACHE_MB;
+  int palette = 0;
+  long double zoom_to = 0;
+  int octave_frames = OCTAVE_FRAMES;
+  int expmap = 0;
+  const char* worker_address = NULL;
+  const char* serve_address = NULL;
+  const char* tile_dir = NULL;
+  const char* stats_path = NULL;
+  const char* trace_path = NULL;
+  t_batch_options batch = {
+    .width = 3.0L,
+    .res_x = 1920,
+    .res_y = 1080,
+    .band_budget = BATCH_BAND_MB * 1024L * 1024L
+  };
+  t_tile_cache* p_tile_cache = NULL;
+  t_parman_options options = *get_parman_options();
+  t_thread_pool* p_pool;
+  t_pool_stats* p_stats = NULL;
+  int retcode;
 
-  while( ( optchar = getopt_long( argc, argv, "hnt:i:", long_options, &optindex ) ) != -1 )
+  bigfix_from_ld( & batch.center_x, -0.75L );
+
+  while( ( optchar = getopt_long( argc, argv, "hcsfnat:i:p:m:l:b:x:y:w:r:e:g:o:z:k:j:u:v:d:q:T:C:", long_options, &optindex ) ) != -1 )
   {
     switch( optchar )
     {
@@ -92,8 +221,8 @@ int main(int argc, char* argv[])
 
     case 'i':
       iterations = atoi( optarg );
-      if( iterations < 20 || iterations >= MAX_ITERATIONS ) {
-        log_error("number of iterations must be in range [%d:%d]\n", 20, MAX_ITERATIONS );
+      if( iterations < PARMAN_MIN_ITERATIONS || iterations >= PARMAN_MAX_ITERATIONS ) {
+        log_error("number of iterations must be in range [%d:%d]\n", PARMAN_MIN_ITERATIONS, PARMAN_MAX_ITERATIONS );
         return -1;
       }
       break;
@@ -102,14 +231,234 @@ int main(int argc, char* argv[])
       headless = 1;
       break;
 
+    case 'c':
+      options.interior_checks = 0;
+      break;
+
+    case 's':
+      options.subdivide = 1;
+      break;
+
+    case 'f':
+      options.smooth = 1;
+      break;
+
+    case 'm':
+      tile_cache_mb = atoi( optarg );
+      if( tile_cache_mb < 0 ) {
+        log_error("tile cache budget must not be negative\n");
+        return -1;
+      }
+      break;
+
+    case 'l':
+      palette = find_palette( optarg );
+      if( palette < 0 ) {
+        log_error("unknown palette %s\n", optarg );
+        return -1;
+      }
+      break;
+
+    case 'b':
+      batch.path = optarg;
+      batch.format = strcmp( optarg, "-" ) ? parse_image_format( optarg ) : IMAGE_FORMAT_RGB;
+      if( (int)batch.format < 0 ) {
+        log_error("file name %s must end with .ppm, .png, .tif, .rgb or .raw\n", optarg );
+        return -1;
+      }
+      break;
+
+    case 'x':
+    case 'y':
+      if( bigfix_from_string( ( optchar == 'x' ) ? & batch.center_x : & batch.center_y, optarg ) ) {
+        log_error("invalid coordinate %s\n", optarg );
+        return -1;
+      }
+      break;
+
+    case 'w':
+      batch.width = strtold( optarg, NULL );
+      if( batch.width <= 0 ) {
+        log_error("width of the view must be positive\n");
+        return -1;
+      }
+      break;
+
+    case 'r':
+      if( sscanf( optarg, "%dx%d", & batch.res_x, & batch.res_y ) != 2 || batch.res_x < 1 || batch.res_y < 1 ) {
+        log_error("resolution must be given as WIDTHxHEIGHT\n");
+        return -1;
+      }
+      break;
+
+    case 'e':
+      batch.band_budget = atol( optarg ) * 1024L * 1024L;
+      if( batch.band_budget <= 0 ) {
+        log_error("memory budget must be positive\n");
+        return -1;
+      }
+      break;
+
+    case 'z':
+      zoom_to = strtold( optarg, NULL );
+      if( zoom_to <= 0 ) {
+        log_error("width to zoom to must be positive\n");
+        return -1;
+      }
+      break;
+
+    case 'k':
+      octave_frames = atoi( optarg );
+      if( octave_frames < 1 ) {
+        log_error("number of frames per octave must be positive\n");
+        return -1;
+      }
+      break;
+
+    case 'a':
+      expmap = 1;
+      break;
+
+    case 'j':
+      batch.workers = optarg;
+      break;
+
+    case 'u':
+      worker_address = optarg;
+      break;
+
+    case 'v':
+      serve_address = optarg;
+      break;
+
+    case 'd':
+      tile_dir = optarg;
+      break;
+
+    case 'q':
+      stats_path = optarg;
+      break;
+
+    case 'T':
+      trace_path = optarg;
+      break;
+
+    case 'C':
+      batch.cost_map_path = optarg;
+      break;
+
+    case 'g':
+      batch.grid_path = optarg;
+      break;
+
+    case 'o':
+      batch.load_path = optarg;
+      break;
+
+    case 'p':
+      precision = parse_precision( optarg );
+      if( precision < 0 ) {
+        log_error("unknown precision %s\n", optarg );
+        return -1;
+      }
+      options.precision = precision;
+      break;
+
     default:
       fprintf( stderr, "input argument error!\n");
       return -1;
     }
   }
 
-  if( headless )
-    return start_head_less( nr_threads );
+  if( ( batch.grid_path || batch.load_path || zoom_to > 0 || batch.workers ) && batch.path == NULL ) {
+    log_error("grid files, zoom sequences and workers require an image file given by --batch\n");
+    return -1;
+  }
+
+  if( zoom_to > 0 && ( batch.grid_path || batch.load_path
+                       || ( strcmp( batch.path, "-" ) && strchr( batch.path, '%' ) == NULL ) ) ) {
+    log_error("zoom sequences require a frame number pattern such as zoom%%05d.png and no grid file\n");
+    return -1;
+  }
+
+  if( batch.workers && ( zoom_to > 0 || batch.load_path ) ) {
+    log_error("workers render single images only\n");
+    return -1;
+  }
+
+  if( tile_dir && serve_address == NULL ) {
+    log_error("tile directories require a server address given by --serve\n");
+    return -1;
+  }
+
+  if( batch.cost_map_path && ( worker_address || serve_address || expmap
+                               || ( batch.path && zoom_to <= 0 ) ) ) {
+    log_error("cost maps are written for the window, the console and zoom sequences only\n");
+    return -1;
+  }
+
+  if( expmap && zoom_to <= 0 ) {
+    log_error("exponential maps require a zoom sequence given by --zoom-to\n");
+    return -1;
+  }
+
+  if( tile_cache_mb > 0 ) {
+    p_tile_cache = create_tile_cache( tile_cache_mb * 1024L * 1024L );
+    if( p_tile_cache == NULL ) {
+      log_error("could not create tile cache!\n");
+      return -1;
+    }
+  }
+
+  options.p_tile_cache = p_tile_cache;
+  set_parman_options( & options );
+
+  p_pool = create_thread_pool( nr_threads );
+  if( p_pool == NULL ) {
+    log_error("could not create rendering threads!\n");
+    return -1;
+  }
+
+  if( ( stats_path && ( p_stats = create_pool_stats( p_pool ) ) == NULL )
+      || ( trace_path && start_trace( p_pool ) ) ) {
+    log_error("could not start the statistics of the rendering threads!\n");
+    release_thread_pool( p_pool );
+    return -1;
+  }
+
+  if( worker_address )
+    retcode = start_worker( p_pool, worker_address );
+  else if( serve_address )
+    retcode = start_server( p_pool, serve_address, tile_dir, batch.band_budget, iterations, palette );
+  else if( batch.path ) {
+    batch.iterations = iterations;
+    batch.palette = palette;
+    if( zoom_to > 0 && expmap )
+      retcode = start_expmap_animation( p_pool, & batch, zoom_to, octave_frames );
+    else if( zoom_to > 0 )
+      retcode = start_animation( p_pool, & batch, zoom_to, octave_frames );
+    else
+      retcode = start_batch( p_pool, & batch );
+  }
+  else if( headless )
+    retcode = start_head_less( p_pool, batch.cost_map_path );
   else
-    return start_gui( nr_threads, iterations );
+    retcode = start_gui( p_pool, iterations, palette, batch.cost_map_path );
+
+  if( p_stats ) {
+    update_pool_stats( p_stats, p_pool );
+    log_pool_stats( p_stats );
+    if( write_pool_stats( p_stats, stats_path ) )
+      retcode = -1;
+    release_pool_stats( p_stats );
+  }
+
+  if( trace_path && write_trace( p_pool, trace_path ) )
+    retcode = -1;
+
+  release_thread_pool( p_pool );
+  release_tile_cache( p_tile_cache );
+  release_palette_cache();
+
+  return retcode;
 }
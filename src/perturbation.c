@@ -0,0 +1,534 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <perturbation.h>
+#include <kernel.h>
+#include <log.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* check for cancellation only every STOP_CHECK_MASK+1 iterations */
+#define STOP_CHECK_MASK   0xff
+
+/* maximum relative deviation of the series from the iterated probes */
+#define SERIES_TOLERANCE  1e-9
+
+/* border pixels which are iterated to validate the series */
+#define NR_PROBES         8
+
+
+void release_ref_orbit( t_ref_orbit* p )
+{
+  if( p ) {
+    if( p->p_refs == NULL || __sync_sub_and_fetch( p->p_refs, 1 ) == 0 ) {
+      free( p->z_re );
+      free( p->z_im );
+      free( p->p_refs );
+    }
+    free( p );
+  }
+}
+
+t_ref_orbit* share_ref_orbit( const t_ref_orbit* p )
+{
+  t_ref_orbit* p_shared;
+
+  p_shared = malloc( sizeof( t_ref_orbit ) );
+  if( p_shared == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+
+  *p_shared = *p;
+  p_shared->prepared = 0;
+  memset( & p_shared->series, 0, sizeof( t_series ) );
+  __sync_add_and_fetch( p->p_refs, 1 );
+
+  return p_shared;
+}
+
+t_ref_orbit* create_ref_orbit( const t_bigfix* c_re, const t_bigfix* c_im, const int iterations,
+                               volatile int* p_stop )
+{
+  t_ref_orbit* p;
+  t_bigfix zr, zi, zr2, zi2, zri;
+  int n;
+
+  p = malloc( sizeof( t_ref_orbit ) );
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_ref_orbit ) );
+
+  p->z_re = malloc( ( iterations + 1 ) * sizeof( double ) );
+  p->z_im = malloc( ( iterations + 1 ) * sizeof( double ) );
+  p->p_refs = malloc( sizeof( int ) );
+  if( p->z_re == NULL || p->z_im == NULL || p->p_refs == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_ref_orbit( p );
+    return NULL;
+  }
+
+  p->c_re = *c_re;
+  p->c_im = *c_im;
+  p->iterations = iterations;
+  *p->p_refs = 1;
+
+  memset( & zr, 0, sizeof( t_bigfix ) );
+  memset( & zi, 0, sizeof( t_bigfix ) );
+  p->z_re[0] = 0.0;
+  p->z_im[0] = 0.0;
+
+  for( n=1; n <= iterations; ++n ) {
+    bigfix_mul( & zr2, & zr, & zr );
+    bigfix_mul( & zi2, & zi, & zi );
+    bigfix_mul( & zri, & zr, & zi );
+
+    bigfix_sub( & zr, & zr2, & zi2 );
+    bigfix_add( & zr, & zr, c_re );
+    bigfix_add( & zi, & zri, & zri );
+    bigfix_add( & zi, & zi, c_im );
+
+    p->z_re[n] = (double)bigfix_to_ld( & zr );
+    p->z_im[n] = (double)bigfix_to_ld( & zi );
+
+    if( p->z_re[n] * p->z_re[n] + p->z_im[n] * p->z_im[n] > 4.0 )
+      break;
+
+    if( ( n & STOP_CHECK_MASK ) == 0 && *p_stop ) {
+      release_ref_orbit( p );
+      return NULL;
+    }
+  }
+
+  p->length = ( n <= iterations ) ? n : iterations;
+
+  return p;
+}
+
+static double complex eval_series( const double complex a, const double complex b, const double complex c,
+                                   const double complex u )
+{
+  return ( ( c * u + b ) * u + a ) * u;
+}
+
+/*
+ * Advance the coefficients together with the perturbation orbits of the
+ * image corners and edge centers. The series is accepted up to the last
+ * iteration where the next (omitted) coefficient is still negligible
+ * and where it reproduces all probe orbits within SERIES_TOLERANCE.
+ */
+static void compute_series( t_parman_data* p, t_ref_orbit* o, volatile int* p_stop )
+{
+  const int px[NR_PROBES] = { 0, p->res_x / 2, p->res_x - 1, p->res_x - 1, p->res_x - 1, p->res_x / 2, 0, 0 };
+  const int py[NR_PROBES] = { 0, 0, 0, p->res_y / 2, p->res_y - 1, p->res_y - 1, p->res_y - 1, p->res_y / 2 };
+  double complex dc[NR_PROBES], u[NR_PROBES], dz[NR_PROBES], ndz[NR_PROBES];
+  double complex a = 0, b = 0, c = 0, d = 0, na, nb, nc, nd, z, z1;
+  t_series* s = & o->series;
+  double scale = 0.0;
+  int i, n;
+
+  memset( s, 0, sizeof( t_series ) );
+
+  for( i=0; i < NR_PROBES; ++i ) {
+    dc[i] = (double)( px[i] * p->step_x - p->orbit_dx )
+      + I * (double)( ( p->res_y - py[i] ) * p->step_y - p->orbit_dy );
+    dz[i] = 0;
+    if( cabs( dc[i] ) > scale )
+      scale = cabs( dc[i] );
+  }
+
+  if( scale == 0.0 )
+    return;
+
+  for( i=0; i < NR_PROBES; ++i )
+    u[i] = dc[i] / scale;
+
+  for( n=0; n < o->length - 1; ++n ) {
+    z = o->z_re[n] + I * o->z_im[n];
+    z1 = o->z_re[n+1] + I * o->z_im[n+1];
+
+    na = 2 * z * a + scale;
+    nb = 2 * z * b + a * a;
+    nc = 2 * z * c + 2 * a * b;
+    nd = 2 * z * d + 2 * a * c + b * b;
+
+    if( cabs( nd ) > SERIES_TOLERANCE * cabs( na ) )
+      break;
+
+    for( i=0; i < NR_PROBES; ++i ) {
+      ndz[i] = 2 * z * dz[i] + dz[i] * dz[i] + dc[i];
+      if( cabs( z1 + ndz[i] ) < cabs( ndz[i] ) || cabs( z1 + ndz[i] ) >= 2.0 )
+        break;
+      if( cabs( eval_series( na, nb, nc, u[i] ) - ndz[i] ) > SERIES_TOLERANCE * cabs( ndz[i] ) )
+        break;
+    }
+    if( i < NR_PROBES )
+      break;
+
+    a = na; b = nb; c = nc; d = nd;
+    memcpy( dz, ndz, sizeof( dz ) );
+
+    if( ( n & STOP_CHECK_MASK ) == 0 && *p_stop )
+      return;
+  }
+
+  s->skip = n;
+  s->scale = scale;
+  s->a_re = creal( a ); s->a_im = cimag( a );
+  s->b_re = creal( b ); s->b_im = cimag( b );
+  s->c_re = creal( c ); s->c_im = cimag( c );
+}
+
+/*
+ * start a pixel at the first iteration which is not covered by the series
+ *
+ * \return number of skipped iterations
+ */
+static int init_from_series( const t_series* s, const double dcr, const double dci, double* p_dzr, double* p_dzi )
+{
+  double complex dz;
+
+  if( s->skip == 0 ) {
+    *p_dzr = 0; *p_dzi = 0;
+    return 0;
+  }
+
+  dz = eval_series( s->a_re + I * s->a_im, s->b_re + I * s->b_im, s->c_re + I * s->c_im,
+                    ( dcr + I * dci ) / s->scale );
+  *p_dzr = creal( dz );
+  *p_dzi = cimag( dz );
+
+  return s->skip;
+}
+
+int prepare_perturbation( t_parman_data* p, volatile int* p_stop )
+{
+  /* the center of an exponential map is its origin */
+  const long double ref_x = ( p->expmap_radius > 0 ) ? 0 : ( p->res_x / 2 ) * p->step_x;
+  const long double ref_y = ( p->expmap_radius > 0 ) ? 0 : ( p->res_y - p->res_y / 2 ) * p->step_y;
+  t_bigfix c_re, c_im;
+
+  if( p->p_orbit && p->p_orbit->prepared )
+    return 0;
+
+  if( p->p_orbit ) {
+    /* shared orbit, its point may lie anywhere within the image */
+    bigfix_sub( & c_re, & p->p_orbit->c_re, & p->hp_x );
+    bigfix_sub( & c_im, & p->p_orbit->c_im, & p->hp_y );
+    p->orbit_dx = bigfix_to_ld( & c_re );
+    p->orbit_dy = bigfix_to_ld( & c_im );
+  }
+  else {
+    bigfix_add_ld( & c_re, & p->hp_x, ref_x );
+    bigfix_add_ld( & c_im, & p->hp_y, ref_y );
+
+    p->p_orbit = create_ref_orbit( & c_re, & c_im, p->iterations, p_stop );
+    if( p->p_orbit == NULL )
+      return -1;
+
+    p->orbit_dx = ref_x;
+    p->orbit_dy = ref_y;
+  }
+
+  /* the probes of the series lie on a rectangular lattice */
+  if( p->expmap_radius == 0 )
+    compute_series( p, p->p_orbit, p_stop );
+  p->p_orbit->prepared = 1;
+
+  log_message("reference orbit with %d of %d iterations, series approximation skips %d iterations"
+              " (%lld per frame)\n", p->p_orbit->length, p->iterations, p->p_orbit->series.skip,
+              (long long)p->p_orbit->series.skip * p->res_x * p->res_y );
+
+  return 0;
+}
+
+/*
+ * The view is described by image data without grids, which is all that
+ * prepare_perturbation() needs.
+ */
+t_ref_orbit* create_view_orbit( const t_bigfix* min_x, const t_bigfix* min_y, const long double step_x,
+                                const long double step_y, const int res_x, const int res_y,
+                                const int iterations, volatile int* p_stop )
+{
+  t_parman_data view;
+
+  memset( & view, 0, sizeof( t_parman_data ) );
+  view.res_x = res_x;
+  view.res_y = res_y;
+  view.hp_x = *min_x;
+  view.hp_y = *min_y;
+  view.init_x = bigfix_to_ld( min_x );
+  view.init_y = bigfix_to_ld( min_y );
+  view.step_x = step_x;
+  view.step_y = step_y;
+  view.iterations = iterations;
+
+  if( prepare_perturbation( & view, p_stop ) ) {
+    release_ref_orbit( view.p_orbit );
+    return NULL;
+  }
+
+  return view.p_orbit;
+}
+
+int attach_view_orbit( t_parman_data* p, const t_ref_orbit* p_view_orbit )
+{
+  t_bigfix d;
+
+  p->p_orbit = share_ref_orbit( p_view_orbit );
+  if( p->p_orbit == NULL )
+    return -1;
+
+  p->p_orbit->series = p_view_orbit->series;
+  p->p_orbit->prepared = 1;
+
+  bigfix_sub( & d, & p_view_orbit->c_re, & p->hp_x );
+  p->orbit_dx = bigfix_to_ld( & d );
+  bigfix_sub( & d, & p_view_orbit->c_im, & p->hp_y );
+  p->orbit_dy = bigfix_to_ld( & d );
+
+  return 0;
+}
+
+
+static int span_perturbation( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                              volatile int* p_stop )
+{
+  const t_ref_orbit* o = p->p_orbit;
+  const double* z_re = o->z_re;
+  const double* z_im = o->z_im;
+  int* p_grid = & p->grid[ y * p->res_x ];
+  const int max_iter = p->iterations;
+  const double row_dci = (double)( (p->res_y - y) * p->step_y - p->orbit_dy );
+  const int checks = p->interior_checks;
+  const int smooth = p->smooth_grid != NULL;
+  const double eps2 = (double)periodicity_threshold( p );
+  double dcr, dci, dzr, dzi, zr, zi, temp, mag, saved_r, saved_i;
+  long nr_periodic = 0;
+  int k, x, m, iter, lam, power;
+
+  for( k=0, x=x0; k < n; ++k, x += dx ) {
+    if( p->expmap_radius > 0 ) {
+      get_expmap_offset( p, x, y, & dcr, & dci );
+      dcr -= (double)p->orbit_dx;
+      dci -= (double)p->orbit_dy;
+    }
+    else {
+      dcr = (double)( x * p->step_x - p->orbit_dx );
+      dci = row_dci;
+    }
+    m = init_from_series( & o->series, dcr, dci, & dzr, & dzi );
+    zr = z_re[m] + dzr; zi = z_im[m] + dzi;
+    saved_r = 0; saved_i = 0;
+    lam = 0; power = 1;
+
+    for( iter=m; iter < max_iter; ) {
+      zr = z_re[m]; zi = z_im[m];
+      temp = 2 * ( zr * dzr - zi * dzi ) + dzr * dzr - dzi * dzi + dcr;
+      dzi = 2 * ( zr * dzi + zi * dzr + dzr * dzi ) + dci;
+      dzr = temp;
+      ++m;
+
+      zr = z_re[m] + dzr;
+      zi = z_im[m] + dzi;
+      mag = zr * zr + zi * zi;
+      if( mag >= 4.0 )
+        break;
+      ++iter;
+
+      if( checks ) {
+        if( ( zr - saved_r ) * ( zr - saved_r ) + ( zi - saved_i ) * ( zi - saved_i ) < eps2 ) {
+          iter = max_iter;
+          ++nr_periodic;
+          break;
+        }
+        if( ++lam == power ) {
+          saved_r = zr; saved_i = zi;
+          power <<= 1; lam = 0;
+        }
+      }
+
+      /* rebase when the full orbit comes closer to zero than the difference */
+      if( mag < dzr * dzr + dzi * dzi || m == o->length ) {
+        dzr = zr; dzi = zi;
+        m = 0;
+      }
+
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )
+        return -1;
+    }
+
+    p_grid[x] = iter;
+    if( smooth )
+      store_smooth( p, x, y, iter, zr, zi );
+  }
+
+  add_interior_stats( p, 0, nr_periodic );
+  return 0;
+}
+
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * four pixels in lock step, each lane tracks its own position in the
+ * reference orbit and gathers the orbit points from there
+ */
+__attribute__((target("avx2,fma")))
+static int span_perturbation_avx2( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                                   volatile int* p_stop )
+{
+  const t_ref_orbit* o = p->p_orbit;
+  const double* z_re = o->z_re;
+  const double* z_im = o->z_im;
+  int* p_grid = & p->grid[ y * p->res_x ];
+  const int max_iter = p->iterations;
+  const __m256d four = _mm256_set1_pd( 4.0 );
+  const __m256d one = _mm256_set1_pd( 1.0 );
+  const __m256d two = _mm256_set1_pd( 2.0 );
+  const __m256i length = _mm256_set1_epi64x( o->length );
+  const __m256i inc = _mm256_set1_epi64x( 1 );
+  __m256d dcr, dci, dzr, dzi, ndzr, zr, zi, mag, cnt, active, rebase, saved_r, saved_i, periodic, bounded, esc_r, esc_i;
+  __m256i m;
+  const double row_ci = (double)( (p->res_y - y) * p->step_y - p->orbit_dy );
+  const __m256d eps2 = _mm256_set1_pd( (double)periodicity_threshold( p ) );
+  const __m256d maxv = _mm256_set1_pd( max_iter );
+  const int checks = p->interior_checks;
+  const int smooth = p->smooth_grid != NULL;
+  double lane_c[4], lane_ci[4], lane_dzr[4], lane_dzi[4], lane_cnt[4], lane_zr[4], lane_zi[4];
+  long nr_periodic = 0;
+  int k, l, x, iter, skip = 0, lam, power, periodic_lanes;
+
+  for( k=0; k < n; k += 4 ) {
+    for( l=0; l < 4; ++l ) {
+      x = x0 + ( (k + l < n) ? k + l : n - 1 ) * dx;
+      if( p->expmap_radius > 0 ) {
+        get_expmap_offset( p, x, y, & lane_c[l], & lane_ci[l] );
+        lane_c[l] -= (double)p->orbit_dx;
+        lane_ci[l] -= (double)p->orbit_dy;
+      }
+      else {
+        lane_c[l] = (double)( x * p->step_x - p->orbit_dx );
+        lane_ci[l] = row_ci;
+      }
+      skip = init_from_series( & o->series, lane_c[l], lane_ci[l], & lane_dzr[l], & lane_dzi[l] );
+    }
+
+    dcr = _mm256_loadu_pd( lane_c );
+    dci = _mm256_loadu_pd( lane_ci );
+    dzr = _mm256_loadu_pd( lane_dzr );
+    dzi = _mm256_loadu_pd( lane_dzi );
+    cnt = _mm256_set1_pd( skip );
+    m = _mm256_set1_epi64x( skip );
+    active = _mm256_castsi256_pd( _mm256_set1_epi64x( -1 ) );
+    saved_r = _mm256_setzero_pd();
+    saved_i = _mm256_setzero_pd();
+    esc_r = _mm256_setzero_pd();
+    esc_i = _mm256_setzero_pd();
+    lam = 0; power = 1; periodic_lanes = 0;
+
+    for( iter=skip; iter < max_iter; ++iter ) {
+      zr = _mm256_i64gather_pd( z_re, m, 8 );
+      zi = _mm256_i64gather_pd( z_im, m, 8 );
+
+      /* dz' = 2 Z dz + dz^2 + dc */
+      ndzr = _mm256_fmsub_pd( zr, dzr, _mm256_mul_pd( zi, dzi ) );
+      ndzr = _mm256_fmadd_pd( two, ndzr, _mm256_fmsub_pd( dzr, dzr, _mm256_mul_pd( dzi, dzi ) ) );
+      ndzr = _mm256_add_pd( ndzr, dcr );
+      dzi = _mm256_fmadd_pd( zr, dzi, _mm256_fmadd_pd( zi, dzr, _mm256_mul_pd( dzr, dzi ) ) );
+      dzi = _mm256_fmadd_pd( two, dzi, dci );
+      dzr = ndzr;
+      m = _mm256_add_epi64( m, inc );
+
+      zr = _mm256_add_pd( _mm256_i64gather_pd( z_re, m, 8 ), dzr );
+      zi = _mm256_add_pd( _mm256_i64gather_pd( z_im, m, 8 ), dzi );
+      mag = _mm256_fmadd_pd( zr, zr, _mm256_mul_pd( zi, zi ) );
+
+      bounded = _mm256_cmp_pd( mag, four, _CMP_LT_OQ );
+      if( smooth ) {
+        esc_r = _mm256_blendv_pd( esc_r, zr, _mm256_andnot_pd( bounded, active ) );
+        esc_i = _mm256_blendv_pd( esc_i, zi, _mm256_andnot_pd( bounded, active ) );
+      }
+      active = _mm256_and_pd( active, bounded );
+      if( _mm256_movemask_pd( active ) == 0 )
+        break;
+      cnt = _mm256_add_pd( cnt, _mm256_and_pd( active, one ) );
+
+      if( checks ) {
+        ndzr = _mm256_sub_pd( zr, saved_r );
+        periodic = _mm256_sub_pd( zi, saved_i );
+        periodic = _mm256_fmadd_pd( ndzr, ndzr, _mm256_mul_pd( periodic, periodic ) );
+        periodic = _mm256_and_pd( active, _mm256_cmp_pd( periodic, eps2, _CMP_LT_OQ ) );
+        if( _mm256_movemask_pd( periodic ) ) {
+          cnt = _mm256_blendv_pd( cnt, maxv, periodic );
+          active = _mm256_andnot_pd( periodic, active );
+          periodic_lanes |= _mm256_movemask_pd( periodic );
+        }
+        if( ++lam == power ) {
+          saved_r = zr; saved_i = zi;
+          power <<= 1; lam = 0;
+        }
+      }
+
+      /* rebase glitching lanes and park escaped ones at the orbit start */
+      rebase = _mm256_cmp_pd( mag, _mm256_fmadd_pd( dzr, dzr, _mm256_mul_pd( dzi, dzi ) ), _CMP_LT_OQ );
+      rebase = _mm256_or_pd( rebase, _mm256_castsi256_pd( _mm256_cmpeq_epi64( m, length ) ) );
+      dzr = _mm256_blendv_pd( dzr, zr, rebase );
+      dzi = _mm256_blendv_pd( dzi, zi, rebase );
+      m = _mm256_and_si256( _mm256_castpd_si256( active ), m );
+      m = _mm256_andnot_si256( _mm256_castpd_si256( rebase ), m );
+
+      if( ( iter & STOP_CHECK_MASK ) == 0 && *p_stop )
+        return -1;
+    }
+
+    nr_periodic += __builtin_popcount( periodic_lanes & ( ( 1 << ( n - k < 4 ? n - k : 4 ) ) - 1 ) );
+    _mm256_storeu_pd( lane_cnt, cnt );
+    for( l=0; l < 4 && k + l < n; ++l )
+      p_grid[ x0 + (k + l) * dx ] = (int)lane_cnt[l];
+
+    if( smooth ) {
+      _mm256_storeu_pd( lane_zr, esc_r );
+      _mm256_storeu_pd( lane_zi, esc_i );
+      for( l=0; l < 4 && k + l < n; ++l )
+        store_smooth( p, x0 + (k + l) * dx, y, (int)lane_cnt[l], lane_zr[l], lane_zi[l] );
+    }
+  }
+
+  add_interior_stats( p, 0, nr_periodic );
+  return 0;
+}
+
+#endif /* #ifdef HAVE_X86_SIMD */
+
+
+t_span_kernel get_perturbation_kernel( const t_parman_precision precision )
+{
+  switch( precision ) {
+  case PARMAN_PRECISION_PERTURBATION:
+    return span_perturbation;
+
+#ifdef HAVE_X86_SIMD
+  case PARMAN_PRECISION_PERTURBATION_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ? span_perturbation_avx2 : NULL;
+#endif
+
+  default:
+    return NULL;
+  }
+}
@@ -0,0 +1,129 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+#include <rendering.h>
+#include <bignum.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file perturbation.h
+    \brief deep zoom rendering relative to a high precision reference orbit
+
+    The orbit Z of one reference point is iterated in fixed point
+    arithmetic of high precision and stored in double. Every pixel with
+    the offset dc to the reference point is then iterated as the double
+    difference dz to this orbit:
+
+        dz' = 2 Z dz + dz^2 + dc
+
+    When |Z + dz| drops below |dz| the difference would lose its
+    significant digits (a glitch). The pixel is then rebased to the
+    start of the reference orbit with dz = Z + dz.
+
+    For the first iterations dz is approximated by a truncated power
+    series in dc with coefficients common to all pixels:
+
+        dz_n = A_n dc + B_n dc^2 + C_n dc^3
+
+    The series is advanced as long as probe pixels on the image border
+    agree with it, so that all pixels can start at iteration N.
+
+    Frames of a zoom into the same point share the orbit of this point,
+    only the series is computed for every frame. Parts of one view such
+    as the bands of a large image share both, so that they give the same
+    iterations as the whole view rendered at once.
+ */
+
+
+/*!
+ * series approximation of the first iterations for one image
+ *
+ * The coefficients are stored scaled by the powers of the largest
+ * pixel offset, so that they stay within the range of double at any
+ * zoom depth and are evaluated for u = dc / scale with |u| <= 1.
+ */
+typedef struct {
+  int                   skip;           /*!< iterations covered by the series */
+  double                scale;
+  double                a_re, a_im;
+  double                b_re, b_im;
+  double                c_re, c_im;
+} t_series;
+
+
+typedef struct s_ref_orbit {
+  t_bigfix              c_re;
+  t_bigfix              c_im;
+  double*               z_re;
+  double*               z_im;
+  int                   length;         /*!< index of the last valid orbit point */
+  int                   iterations;
+  int*                  p_refs;         /*!< number of frames sharing z_re and z_im */
+  int                   prepared;       /*!< offset and series of the frame are set up */
+  t_series              series;         /*!< approximation for the image the orbit belongs to */
+} t_ref_orbit;
+
+
+void release_ref_orbit( t_ref_orbit* p );
+
+/*!
+ * iterate the orbit of c until it escapes or the maximum number of
+ * iterations has been reached
+ *
+ * \return orbit or NULL when out of memory or stopped
+ */
+t_ref_orbit* create_ref_orbit( const t_bigfix* c_re, const t_bigfix* c_im, const int iterations,
+                               volatile int* p_stop );
+
+/*!
+ * \return orbit for another frame with the same orbit points, which are
+ * released with the last frame, or NULL when out of memory
+ */
+t_ref_orbit* share_ref_orbit( const t_ref_orbit* p );
+
+/*!
+ * set up the reference orbit for the center of the image, or the offset
+ * to a shared orbit attached to the image, and the series approximation
+ * of its first iterations
+ */
+int prepare_perturbation( t_parman_data* p, volatile int* p_stop );
+
+/*!
+ * set up the reference orbit for the center of a whole view of
+ * res_x * res_y pixels with origin min_x, min_y and the series
+ * approximation for all of its pixels
+ *
+ * \return orbit or NULL when out of memory or stopped
+ */
+t_ref_orbit* create_view_orbit( const t_bigfix* min_x, const t_bigfix* min_y, const long double step_x,
+                                const long double step_y, const int res_x, const int res_y,
+                                const int iterations, volatile int* p_stop );
+
+/*!
+ * render the part p of a view relative to the orbit and series of the
+ * whole view given by create_view_orbit()
+ *
+ * \return 0 on success, -1 when out of memory
+ */
+int attach_view_orbit( t_parman_data* p, const t_ref_orbit* p_view_orbit );
+
+/*!
+ * \return perturbation kernel for the given tier or NULL if not supported
+ */
+t_span_kernel get_perturbation_kernel( const t_parman_precision precision );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef PERTURBATION_H */
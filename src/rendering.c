@@ -9,18 +9,62 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <unistd.h>
 #include <rendering.h>
+#include <kernel.h>
+#include <perturbation.h>
+#include <costmap.h>
 #include <log.h>
 
-#define SQUARE(x)     ( (x)*(x) )
+/* tile pass which computes the reference orbit before the image tiles are queued */
+#define PASS_REFERENCE_ORBIT  -1
+
+/* tile pass of rectangle subdivision whose border pixels have already been computed */
+#define PASS_SUBDIVIDE        1
+
+/* rectangles below this edge length are iterated instead of subdivided */
+#define SUBDIVIDE_MIN_SIZE    6
+
+/*
+ * Progressive passes: every 4th pixel of every 4th row is iterated and
+ * fills its 4x4 block, then the remaining pixels at even positions fill
+ * their 2x2 blocks, and finally all other pixels are iterated. A pass
+ * is queued when all tiles of the previous one are done, so that no
+ * block fill can overwrite finer results.
+ */
+#define PASS_COARSE           2
+#define PASS_MEDIUM           3
+#define PASS_FINE             4
+
+
+static t_parman_options parman_options = {
+  .precision = PARMAN_PRECISION_AUTO,
+  .interior_checks = 1,
+  .progressive = 1
+};
+
+void set_parman_options( const t_parman_options* p_options )
+{
+  parman_options = *p_options;
+}
+
+const t_parman_options* get_parman_options( void )
+{
+  return & parman_options;
+}
 
 void release_parman_data( t_parman_data* p )
 {
   if( p ) {
-    if( p->grid ) {
+    if( p->p_grid_file )
+      release_grid_file( p->p_grid_file );
+    else {
       free( p->grid );
+      free( p->smooth_grid );
     }
+    free( p->image );
+    free( p->tile_cost );
+    free( p->predicted_cost );
+    release_ref_orbit( p->p_orbit );
     free( p );
   }
 }
@@ -32,82 +76,699 @@ t_parman_data* create_parman_data( const int res_x,
                                    const long double width,
                                    const long double height,
                                    const int iterations )
+{
+  t_bigfix hp_x, hp_y;
+
+  bigfix_from_ld( & hp_x, min_x );
+  bigfix_from_ld( & hp_y, min_y );
+
+  return create_parman_data_hp( res_x, res_y, & hp_x, & hp_y, width, height, iterations );
+}
+
+/*
+ * the grids are allocated unless they are given by a mapped file
+ */
+static t_parman_data* new_parman_data( const int res_x,
+                                       const int res_y,
+                                       const t_bigfix* min_x,
+                                       const t_bigfix* min_y,
+                                       const long double width,
+                                       const long double height,
+                                       const int iterations,
+                                       t_grid_file* p_grid_file )
 {
   t_parman_data* p = malloc( sizeof( t_parman_data ) );
   const long grid_elements = (long) res_x * (long) res_y;
 
   if( p == NULL ) {
     log_error(  "%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_grid_file( p_grid_file );
     return NULL;
   }
-  p->grid = malloc( sizeof(int) * grid_elements );
+  memset( p, 0, sizeof( t_parman_data ) );
+
+  if( p_grid_file ) {
+    p->p_grid_file = p_grid_file;
+    p->grid = p_grid_file->grid;
+    p->smooth_grid = p_grid_file->smooth_grid;
+  }
+  else {
+    p->grid = malloc( sizeof(int) * grid_elements );
+    if( p->grid == NULL ) {
+      log_error(  "%s,%d: out of memory error!\n", __func__, __LINE__ );
+      release_parman_data( p );
+      return NULL;
+    }
+    memset( p->grid, 0, sizeof(int) * grid_elements );
+  }
+
+  if( parman_options.smooth && p_grid_file == NULL ) {
+    p->smooth_grid = malloc( sizeof(float) * grid_elements );
+    if( p->smooth_grid == NULL ) {
+      log_error(  "%s,%d: out of memory error!\n", __func__, __LINE__ );
+      release_parman_data( p );
+      return NULL;
+    }
+    memset( p->smooth_grid, 0, sizeof(float) * grid_elements );
+  }
 
-  if( p->grid == NULL ) {
+  p->tile_cost = calloc( count_tiles( res_x, res_y ), sizeof( long ) );
+  if( p->tile_cost == NULL ) {
     log_error(  "%s,%d: out of memory error!\n", __func__, __LINE__ );
     release_parman_data( p );
     return NULL;
   }
 
-  memset( p->grid, 0, sizeof(int) * grid_elements );
+  if( parman_options.p_palette ) {
+    p->image = malloc( sizeof(t_argb) * grid_elements );
+    if( p->image == NULL ) {
+      log_error(  "%s,%d: out of memory error!\n", __func__, __LINE__ );
+      release_parman_data( p );
+      return NULL;
+    }
+    p->p_palette = parman_options.p_palette;
+  }
+
   p->res_x = res_x;
   p->res_y = res_y;
 
-  p->init_x = min_x;
-  p->init_y = min_y;
+  p->hp_x = *min_x;
+  p->hp_y = *min_y;
+  p->init_x = bigfix_to_ld( min_x );
+  p->init_y = bigfix_to_ld( min_y );
   p->step_x = width / (long double)res_x;
   p->step_y = height / (long double)res_y;
   p->iterations = iterations;
+  p->precision = parman_options.precision;
+  p->interior_checks = parman_options.interior_checks;
+  p->subdivide = parman_options.subdivide;
+  p->progressive = parman_options.progressive;
+  /* cached tiles carry no fractional counts and are not flagged in a grid file */
+  p->p_tile_cache = ( p->smooth_grid || p_grid_file ) ? NULL : parman_options.p_tile_cache;
+
+  return p;
+}
+
+t_parman_data* create_parman_data_hp( const int res_x,
+                                      const int res_y,
+                                      const t_bigfix* min_x,
+                                      const t_bigfix* min_y,
+                                      const long double width,
+                                      const long double height,
+                                      const int iterations )
+{
+  return new_parman_data( res_x, res_y, min_x, min_y, width, height, iterations, NULL );
+}
+
+t_parman_data* create_parman_data_file( t_grid_file* p_grid_file )
+{
+  const t_grid_header* p_header = p_grid_file->p_header;
+  t_parman_data* p;
+
+  p = new_parman_data( p_header->res_x, p_header->res_y, & p_header->hp_x, & p_header->hp_y,
+                       p_header->step_x * p_header->res_x, p_header->step_y * p_header->res_y,
+                       p_header->iterations, p_grid_file );
+
+  /* the very same lattice when a rendering is resumed */
+  if( p ) {
+    p->step_x = p_header->step_x;
+    p->step_y = p_header->step_y;
+  }
 
   return p;
 }
 
-static void* render_mandel( void* pa )
+void mark_rendered( t_parman_data* p, const int x, const int y, const int w, const int h )
 {
-  t_parman_thread_state* p_thread_state = (t_parman_thread_state *)pa;
-  t_parman_data* p_data = p_thread_state->p_data;
-  const int start_idx = p_thread_state->start_idx;
-  const int elements = p_thread_state->elements;
+  p->known_x = x;
+  p->known_y = y;
+  p->known_w = w;
+  p->known_h = h;
+}
 
-  int idx_x = start_idx % p_data->res_x;
-  int idx_y = start_idx / p_data->res_x;
-  int i, iter;
-  long double z, zi ,c, ci, temp;
-  const int max_iter = p_data->iterations;
-  long invoc_cnt = 0L;
-  static int thread_nr = 0;
+int same_step( const long double a, const long double b )
+{
+  return fabsl( a - b ) <= fabsl( a ) * 1e-15L;
+}
 
-  ++thread_nr;
+/*
+ * Row y of a grid maps to init_y + (res_y - y) * step_y, so rows of
+ * grids with the same origin but different height are shifted against
+ * each other by the difference of their heights.
+ */
+long reuse_rendered_pixels( t_parman_data* p_dst, const t_parman_data* p_src )
+{
+  const int shift = p_dst->res_y - p_src->res_y;
+  const int w = ( p_dst->res_x < p_src->res_x ) ? p_dst->res_x : p_src->res_x;
+  const int y0 = ( shift > 0 ) ? shift : 0;
+  const int y1 = ( p_src->res_y + shift < p_dst->res_y ) ? p_src->res_y + shift : p_dst->res_y;
+  int y;
 
-  for( i=start_idx; i < start_idx + elements; ++i )
-  {
-    z  = 0; zi = 0;
-    c  = p_data->init_x  +  idx_x * p_data->step_x;
-    ci = p_data->init_y  +  (p_data->res_y - idx_y) * p_data->step_y;
-    iter = 0;
+  if( p_dst->iterations != p_src->iterations
+      || bigfix_cmp( & p_dst->hp_x, & p_src->hp_x ) || bigfix_cmp( & p_dst->hp_y, & p_src->hp_y )
+      || ! same_step( p_dst->step_x, p_src->step_x ) || ! same_step( p_dst->step_y, p_src->step_y )
+      || ( p_dst->smooth_grid == NULL ) != ( p_src->smooth_grid == NULL )
+      || y1 <= y0 )
+    return 0;
 
-    do {
-      temp = z * z - zi * zi + c;
-      zi = 2 * z * zi + ci;
-      z = temp;
+  for( y = y0; y < y1; ++y ) {
+    memcpy( & p_dst->grid[ y * p_dst->res_x ], & p_src->grid[ ( y - shift ) * p_src->res_x ], w * sizeof( int ) );
+    if( p_dst->smooth_grid )
+      memcpy( & p_dst->smooth_grid[ y * p_dst->res_x ], & p_src->smooth_grid[ ( y - shift ) * p_src->res_x ],
+              w * sizeof( float ) );
+  }
+
+  mark_rendered( p_dst, 0, y0, w, y1 - y0 );
+
+  return (long)w * ( y1 - y0 );
+}
+
+/*
+ * The origin a lies k steps away from origin b, up to the rounding of
+ * the step to long double. The remainder is taken at full precision, so
+ * that origins which differ by less than the resolution of long double
+ * are not mistaken for each other.
+ */
+static int on_lattice( const t_bigfix* a, const t_bigfix* b, const long double step, const long k )
+{
+  t_bigfix d, offset;
+
+  bigfix_from_ld( & offset, step );
+  bigfix_mul_int( & offset, & offset, (int)k );
+  bigfix_sub( & d, a, b );
+  bigfix_sub( & d, & d, & offset );
+
+  return k == (int)k && fabsl( bigfix_to_ld( & d ) ) <= 1e-6L * fabsl( step );
+}
+
+/*
+ * Row y of a grid with twice the step maps to row y0 + 2 * y of the
+ * finer grid, where y0 follows from both origins and heights.
+ */
+long reuse_coarser_pixels( t_parman_data* p_dst, const t_parman_data* p_src )
+{
+  t_bigfix d;
+  long double fx, fy;
+  long x0, y0;
+  int x, y;
+
+  if( p_dst->iterations != p_src->iterations || p_dst->precision != p_src->precision
+      || ! same_step( 2 * p_dst->step_x, p_src->step_x ) || ! same_step( 2 * p_dst->step_y, p_src->step_y )
+      || ( p_dst->smooth_grid == NULL ) != ( p_src->smooth_grid == NULL ) )
+    return 0;
+
+  bigfix_sub( & d, & p_src->hp_x, & p_dst->hp_x );
+  fx = bigfix_to_ld( & d ) / p_dst->step_x;
+  bigfix_sub( & d, & p_src->hp_y, & p_dst->hp_y );
+  fy = bigfix_to_ld( & d ) / p_dst->step_y;
+
+  x0 = lroundl( fx );
+  y0 = p_dst->res_y - lroundl( fy ) - 2L * p_src->res_y;
+  if( ! on_lattice( & p_src->hp_x, & p_dst->hp_x, p_dst->step_x, x0 )
+      || ! on_lattice( & p_src->hp_y, & p_dst->hp_y, p_dst->step_y, lroundl( fy ) )
+      || ( x0 & 1 ) || ( y0 & 1 )
+      || x0 > 0 || y0 > 0 || x0 + 2L * p_src->res_x < p_dst->res_x || y0 + 2L * p_src->res_y < p_dst->res_y )
+    return 0;
+
+  for( y = 0; y < p_dst->res_y; y += 2 ) {
+    for( x = 0; x < p_dst->res_x; x += 2 ) {
+      p_dst->grid[ y * p_dst->res_x + x ] = p_src->grid[ ( y - y0 ) / 2 * p_src->res_x + ( x - x0 ) / 2 ];
+      if( p_dst->smooth_grid )
+        p_dst->smooth_grid[ y * p_dst->res_x + x ] = p_src->smooth_grid[ ( y - y0 ) / 2 * p_src->res_x + ( x - x0 ) / 2 ];
+    }
+  }
+  p_dst->even_known = 1;
+
+  return (long)( ( p_dst->res_x + 1 ) / 2 ) * ( ( p_dst->res_y + 1 ) / 2 );
+}
+
+/*
+ * Row y of the copy is row y + y0 of the original, which lies
+ * res_y - y0 - h rows above the origin of the copy.
+ */
+t_parman_data* copy_parman_rect( const t_parman_data* p, const int x, const int y, const int w, const int h )
+{
+  t_parman_data* p_copy;
+  t_bigfix step, offset;
+  int j;
+
+  p_copy = malloc( sizeof( t_parman_data ) );
+  if( p_copy == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p_copy, 0, sizeof( t_parman_data ) );
+
+  p_copy->grid = malloc( sizeof(int) * w * h );
+  if( p->smooth_grid )
+    p_copy->smooth_grid = malloc( sizeof(float) * w * h );
+  if( p_copy->grid == NULL || ( p->smooth_grid && p_copy->smooth_grid == NULL ) ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_parman_data( p_copy );
+    return NULL;
+  }
+
+  for( j = 0; j < h; ++j ) {
+    memcpy( & p_copy->grid[ j * w ], & p->grid[ ( y + j ) * p->res_x + x ], w * sizeof( int ) );
+    if( p->smooth_grid )
+      memcpy( & p_copy->smooth_grid[ j * w ], & p->smooth_grid[ ( y + j ) * p->res_x + x ], w * sizeof( float ) );
+  }
+
+  bigfix_from_ld( & step, p->step_x );
+  bigfix_mul_int( & offset, & step, x );
+  bigfix_add( & p_copy->hp_x, & p->hp_x, & offset );
+  bigfix_from_ld( & step, p->step_y );
+  bigfix_mul_int( & offset, & step, p->res_y - y - h );
+  bigfix_add( & p_copy->hp_y, & p->hp_y, & offset );
+
+  p_copy->res_x = w;
+  p_copy->res_y = h;
+  p_copy->init_x = bigfix_to_ld( & p_copy->hp_x );
+  p_copy->init_y = bigfix_to_ld( & p_copy->hp_y );
+  p_copy->step_x = p->step_x;
+  p_copy->step_y = p->step_y;
+  p_copy->iterations = p->iterations;
+  p_copy->precision = p->precision;
+
+  return p_copy;
+}
+
+static int tile_index( const t_parman_data* p, const t_tile* p_tile );
+
+static int is_rendered_tile( const t_parman_data* p, const t_tile* p_tile )
+{
+  if( p->p_grid_file && is_saved_tile( p->p_grid_file, tile_index( p, p_tile ) ) )
+    return 1;
+
+  return p_tile->x >= p->known_x && p_tile->x + p_tile->w <= p->known_x + p->known_w
+    && p_tile->y >= p->known_y && p_tile->y + p_tile->h <= p->known_y + p->known_h;
+}
+
+/*
+ * The upper left pixel of a tile is computed exactly in fixed point, so
+ * that tiles of different frames on the same pixel lattice share keys.
+ */
+static void get_tile_key( const t_parman_data* p, const t_tile* p_tile, t_tile_key* p_key )
+{
+  t_bigfix c_re, c_im, step;
+
+  bigfix_from_ld( & step, p->step_x );
+  bigfix_mul_int( & c_re, & step, p_tile->x );
+  bigfix_add( & c_re, & c_re, & p->hp_x );
+
+  bigfix_from_ld( & step, p->step_y );
+  bigfix_mul_int( & c_im, & step, p->res_y - p_tile->y );
+  bigfix_add( & c_im, & c_im, & p->hp_y );
+
+  init_tile_key( p_key, & c_re, & c_im, p->step_x, p->step_y, p_tile->w, p_tile->h,
+                 p->iterations, p->precision );
+}
+
+static int tile_index( const t_parman_data* p, const t_tile* p_tile )
+{
+  return ( p_tile->y / TILE_SIZE ) * ( ( p->res_x + TILE_SIZE - 1 ) / TILE_SIZE ) + p_tile->x / TILE_SIZE;
+}
+
+static void get_tile_rect( const t_parman_data* p, const int index, t_tile* p_tile )
+{
+  const int tiles_per_row = ( p->res_x + TILE_SIZE - 1 ) / TILE_SIZE;
+
+  p_tile->x = ( index % tiles_per_row ) * TILE_SIZE;
+  p_tile->y = ( index / tiles_per_row ) * TILE_SIZE;
+  p_tile->w = ( p_tile->x + TILE_SIZE <= p->res_x ) ? TILE_SIZE : p->res_x - p_tile->x;
+  p_tile->h = ( p_tile->y + TILE_SIZE <= p->res_y ) ? TILE_SIZE : p->res_y - p_tile->y;
+}
+
+/*
+ * \return 1 when the tile has been copied from the tile cache
+ */
+static int take_cached_tile( t_parman_job* p_job, const t_tile* p_tile )
+{
+  t_parman_data* p = p_job->p_data;
+  t_tile_key key;
+
+  if( p->p_tile_cache == NULL || p_job->tile_cached == NULL )
+    return 0;
+
+  get_tile_key( p, p_tile, & key );
+  if( ! lookup_tile( p->p_tile_cache, & key, & p->grid[ p_tile->y * p->res_x + p_tile->x ], p->res_x ) )
+    return 0;
+
+  p_job->tile_cached[ tile_index( p, p_tile ) ] = 1;
+  return 1;
+}
+
+static int is_cached_tile( const t_parman_job* p_job, const t_tile* p_tile )
+{
+  return p_job->tile_cached && p_job->tile_cached[ tile_index( p_job->p_data, p_tile ) ];
+}
+
+/*
+ * a complete tile is stored in the tile cache and flagged in the grid file
+ */
+static void keep_tile( t_parman_job* p_job, const t_tile* p_tile )
+{
+  t_parman_data* p = p_job->p_data;
+  t_tile_key key;
+
+  if( p->p_grid_file )
+    mark_saved_tile( p->p_grid_file, tile_index( p, p_tile ) );
+
+  if( p->p_tile_cache == NULL )
+    return;
+
+  get_tile_key( p, p_tile, & key );
+  store_tile( p->p_tile_cache, & key, & p->grid[ p_tile->y * p->res_x + p_tile->x ], p->res_x );
+}
+
+/*
+ * A subdivided tile is complete when the last of its quarters is, which
+ * may be processed by any worker. Quarters lie within their tile.
+ */
+static void finish_tile_piece( t_parman_job* p_job, const t_tile* p_piece )
+{
+  const int index = tile_index( p_job->p_data, p_piece );
+  t_tile tile;
+
+  if( __sync_sub_and_fetch( & p_job->tile_pieces[ index ], 1 ) == 0 ) {
+    get_tile_rect( p_job->p_data, index, & tile );
+    keep_tile( p_job, & tile );
+  }
+}
+
+/*
+ * add a span which has just been iterated to the counters of the worker
+ * and to the cost of its tile, pixels resolved by the interior checks
+ * have not run to the maximum depth
+ */
+static void count_span( t_parman_job* p_job, const int worker, const int row, const int x0,
+                        const int n, const int dx )
+{
+  const t_parman_data* p_data = p_job->p_data;
+  const int* counts = & p_data->grid[ row * p_data->res_x + x0 ];
+  t_worker_stats* p_stats = & p_job->p_pool->stats[worker];
+  long nr_escaped = 0, nr_iterations = 0, nr_iterated_interior;
+  int i;
+
+  for( i=0; i < n; ++i ) {
+    if( counts[ i * dx ] < p_data->iterations ) {
+      ++nr_escaped;
+      nr_iterations += counts[ i * dx ];
+    }
+  }
+
+  nr_iterated_interior = n - nr_escaped - take_interior_pixels();
+  if( nr_iterated_interior > 0 )
+    nr_iterations += nr_iterated_interior * p_data->iterations;
 
-      if( p_thread_state->stop )
-        goto stop;
-    } while( (SQUARE(z) + SQUARE(zi)) < 4.0 && ++iter < max_iter );
+  p_stats->pixels += n;
+  p_stats->escaped += nr_escaped;
+  p_stats->interior += n - nr_escaped;
+  p_stats->iterations += nr_iterations;
 
-    p_data->grid[i] = iter;
+  if( p_data->tile_cost )
+    __sync_fetch_and_add( & p_data->tile_cost[ ( row / TILE_SIZE ) * ( ( p_data->res_x + TILE_SIZE - 1 ) / TILE_SIZE )
+                                               + x0 / TILE_SIZE ], nr_iterations + n );
+}
+
+static int render_rect( t_parman_job* p_job, const int worker, const int x, const int y,
+                        const int w, const int h )
+{
+  int row;
+
+  for( row = y; row < y + h; ++row ) {
+    if( p_job->kernel( p_job->p_data, row, x, w, 1, & p_job->job.stop ) )
+      return -1;
+    count_span( p_job, worker, row, x, w, 1 );
+  }
 
-    if( ++idx_x >= p_data->res_x ) {
-      idx_x = 0;
-      if( ++idx_y >= p_data->res_y ) {
-        log_error("%s,%d: out of bound exceptions error!\n", __func__, __LINE__ );
-        return NULL;
+  return 0;
+}
+
+/*
+ * Mariani-Silver subdivision of a rectangle whose border is known: a
+ * uniform border is filled, since the set is connected and no detail
+ * can be enclosed. Otherwise the rectangle is cut into four along a
+ * center cross which is iterated and the quarters are queued as new
+ * tiles, sharing their borders with the cross.
+ */
+static int subdivide_tile( t_parman_job* p_job, const t_tile* p_tile, const int worker )
+{
+  t_parman_data* p_data = p_job->p_data;
+  int* grid = p_data->grid;
+  const int res_x = p_data->res_x;
+  const int x = p_tile->x, y = p_tile->y, w = p_tile->w, h = p_tile->h;
+  const int x_mid = x + w / 2, y_mid = y + h / 2;
+  const int value = grid[ y * res_x + x ];
+  t_tile quarter = { .pass = PASS_SUBDIVIDE };
+  int uniform = 1, i, j;
+
+  if( w <= 2 || h <= 2 )
+    return 0;
+
+  /* fractional counts vary within a band of equal counts, only the interior is uniform */
+  if( p_data->smooth_grid && value != p_data->iterations )
+    uniform = 0;
+
+  for( i = x; i < x + w && uniform; ++i )
+    uniform = grid[ y * res_x + i ] == value && grid[ (y + h - 1) * res_x + i ] == value;
+  for( j = y + 1; j < y + h - 1 && uniform; ++j )
+    uniform = grid[ j * res_x + x ] == value && grid[ j * res_x + x + w - 1 ] == value;
+
+  if( uniform ) {
+    for( j = y + 1; j < y + h - 1; ++j ) {
+      for( i = x + 1; i < x + w - 1; ++i )
+        grid[ j * res_x + i ] = value;
+      if( p_data->smooth_grid ) {
+        for( i = x + 1; i < x + w - 1; ++i )
+          p_data->smooth_grid[ j * res_x + i ] = value;
       }
     }
+    __sync_fetch_and_add( & p_data->nr_filled_pixels, (long)( w - 2 ) * ( h - 2 ) );
+    return 0;
+  }
+
+  if( w < SUBDIVIDE_MIN_SIZE || h < SUBDIVIDE_MIN_SIZE )
+    return render_rect( p_job, worker, x + 1, y + 1, w - 2, h - 2 );
+
+  if( render_rect( p_job, worker, x + 1, y_mid, w - 2, 1 )
+      || render_rect( p_job, worker, x_mid, y + 1, 1, y_mid - y - 1 )
+      || render_rect( p_job, worker, x_mid, y_mid + 1, 1, y + h - y_mid - 2 ) )
+    return -1;
+
+  __sync_fetch_and_add( & p_job->tile_pieces[ tile_index( p_data, p_tile ) ], 4 );
+  for( j = 0; j < 4; ++j ) {
+    quarter.x = ( j & 1 ) ? x_mid : x;
+    quarter.w = ( j & 1 ) ? x + w - x_mid : x_mid - x + 1;
+    quarter.y = ( j & 2 ) ? y_mid : y;
+    quarter.h = ( j & 2 ) ? y + h - y_mid : y_mid - y + 1;
+    if( enqueue_tile( p_job->p_pool, & p_job->job, & quarter, worker ) )
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * iterate the pixels of columns x0, x0 + dx, ... within the tile
+ */
+static int render_columns( t_parman_job* p_job, const int worker, const t_tile* p_tile, const int row,
+                           const int x0, const int dx )
+{
+  const int n = ( p_tile->x + p_tile->w - x0 + dx - 1 ) / dx;
+
+  if( n <= 0 )
+    return 0;
+
+  if( p_job->kernel( p_job->p_data, row, x0, n, dx, & p_job->job.stop ) )
+    return -1;
+  count_span( p_job, worker, row, x0, n, dx );
+
+  return 0;
+}
+
+/*
+ * replicate every pixel at positions divisible by size to its block
+ */
+static void fill_blocks( t_parman_data* p_data, const t_tile* p_tile, const int size )
+{
+  const int res_x = p_data->res_x;
+  int* grid = p_data->grid;
+  float* smooth_grid = p_data->smooth_grid;
+  int x, y, i, j, value;
+  float smooth_value = 0;
+
+  for( y = p_tile->y; y < p_tile->y + p_tile->h; y += size ) {
+    for( x = p_tile->x; x < p_tile->x + p_tile->w; x += size ) {
+      value = grid[ y * res_x + x ];
+      if( smooth_grid )
+        smooth_value = smooth_grid[ y * res_x + x ];
+      for( j = y; j < y + size && j < p_tile->y + p_tile->h; ++j ) {
+        for( i = x; i < x + size && i < p_tile->x + p_tile->w; ++i ) {
+          grid[ j * res_x + i ] = value;
+          if( smooth_grid )
+            smooth_grid[ j * res_x + i ] = smooth_value;
+        }
+      }
+    }
+  }
+}
+
+static int render_pass( t_parman_job* p_job, const t_tile* p_tile, const int worker )
+{
+  const int x = p_tile->x;
+  int y;
+
+  for( y = p_tile->y; y < p_tile->y + p_tile->h; ++y ) {
+    switch( p_tile->pass ) {
+    case PASS_COARSE:
+      if( y % 4 == 0 && render_columns( p_job, worker, p_tile, y, x, 4 ) )
+        return -1;
+      break;
+
+    case PASS_MEDIUM:
+      if( y % 4 == 2 && render_columns( p_job, worker, p_tile, y, x, 2 ) )
+        return -1;
+      if( y % 4 == 0 && render_columns( p_job, worker, p_tile, y, x + 2, 4 ) )
+        return -1;
+      break;
+
+    default:
+      if( render_columns( p_job, worker, p_tile, y, ( y % 2 ) ? x : x + 1, ( y % 2 ) ? 1 : 2 ) )
+        return -1;
+      break;
+    }
+  }
+
+  if( p_tile->pass == PASS_COARSE )
+    fill_blocks( p_job->p_data, p_tile, 4 );
+  else if( p_tile->pass == PASS_MEDIUM )
+    fill_blocks( p_job->p_data, p_tile, 2 );
+
+  return 0;
+}
+
+/*
+ * Tiles of the first pass are dealt out by their predicted cost if any,
+ * those of later passes by the cost measured in the earlier ones.
+ */
+static int submit_pass( t_parman_job* p_job, const int pass )
+{
+  t_parman_data* p_data = p_job->p_data;
+  const long* cost = ( pass == p_job->first_pass ) ? p_data->predicted_cost : p_data->tile_cost;
+
+  p_job->pass_pending = count_tiles( p_data->res_x, p_data->res_y );
+  if( cost )
+    return submit_tile_pass_by_cost( p_job->p_pool, & p_job->job, p_data->res_x, p_data->res_y, pass, cost );
+
+  return submit_tile_pass( p_job->p_pool, & p_job->job, p_data->res_x, p_data->res_y, pass );
+}
+
+static int process_tile( t_tile_job* p_tile_job, const t_tile* p_tile, const int worker )
+{
+  t_parman_job* p_job = (t_parman_job *)p_tile_job;
+  t_parman_data* p_data = p_job->p_data;
+  const int x = p_tile->x, y = p_tile->y, w = p_tile->w, h = p_tile->h;
+
+  if( p_tile->pass == PASS_REFERENCE_ORBIT ) {
+    if( prepare_perturbation( p_data, & p_tile_job->stop ) )
+      return -1;
+    return submit_pass( p_job, p_job->first_pass );
+  }
+
+  if( p_tile->pass == PASS_SUBDIVIDE ) {
+    if( subdivide_tile( p_job, p_tile, worker ) )
+      return -1;
+    finish_tile_piece( p_job, p_tile );
+    return 0;
+  }
+
+  if( p_tile->pass >= PASS_COARSE ) {
+    /* tiles found in the cache by the first pass are skipped by the others */
+    if( ! is_rendered_tile( p_data, p_tile ) && ! is_cached_tile( p_job, p_tile )
+        && ! ( p_tile->pass == PASS_COARSE && take_cached_tile( p_job, p_tile ) ) ) {
+      if( render_pass( p_job, p_tile, worker ) )
+        return -1;
+      if( p_tile->pass == PASS_FINE )
+        keep_tile( p_job, p_tile );
+    }
+
+    /* the last tile of a pass queues the next one */
+    if( __sync_sub_and_fetch( & p_job->pass_pending, 1 ) == 0 ) {
+      ++p_job->completed_passes;
+      if( p_tile->pass < PASS_FINE )
+        return submit_pass( p_job, p_tile->pass + 1 );
+    }
+    return 0;
+  }
+
+  if( is_rendered_tile( p_data, p_tile ) || take_cached_tile( p_job, p_tile ) )
+    return 0;
+
+  if( ! p_data->subdivide || w < SUBDIVIDE_MIN_SIZE || h < SUBDIVIDE_MIN_SIZE ) {
+    if( render_rect( p_job, worker, x, y, w, h ) )
+      return -1;
+    keep_tile( p_job, p_tile );
+    return 0;
+  }
+
+  /* iterate the border of a fresh tile, then continue as subdivided tile */
+  if( render_rect( p_job, worker, x, y, w, 1 ) || render_rect( p_job, worker, x, y + h - 1, w, 1 )
+      || render_rect( p_job, worker, x, y + 1, 1, h - 2 )
+      || render_rect( p_job, worker, x + w - 1, y + 1, 1, h - 2 ) )
+    return -1;
+
+  p_job->tile_pieces[ tile_index( p_data, p_tile ) ] = 1;
+  if( subdivide_tile( p_job, p_tile, worker ) )
+    return -1;
+  finish_tile_piece( p_job, p_tile );
+
+  return 0;
+}
+
+
+/*
+ * The image is stored top down as the display expects it, grid rows
+ * run bottom up.
+ */
+static void colorize_tile( t_parman_data* p, const t_tile* p_tile, const t_palette* p_palette )
+{
+  int y;
+
+  for( y = p_tile->y; y < p_tile->y + p_tile->h; ++y ) {
+    if( p->smooth_grid )
+      colorize_smooth_span( p_palette, p->iterations, & p->smooth_grid[ y * p->res_x + p_tile->x ],
+                            & p->image[ ( p->res_y - 1 - y ) * p->res_x + p_tile->x ], p_tile->w );
+    else
+      colorize_span( p_palette, p->iterations, & p->grid[ y * p->res_x + p_tile->x ],
+                     & p->image[ ( p->res_y - 1 - y ) * p->res_x + p_tile->x ], p_tile->w );
   }
+}
+
+/*
+ * The worker which has finished a tile colors it right away, so that
+ * the display only has to copy the image.
+ */
+static int render_tile( t_tile_job* p_tile_job, const t_tile* p_tile, const int worker )
+{
+  t_parman_job* p_job = (t_parman_job *)p_tile_job;
+  const int retcode = process_tile( p_tile_job, p_tile, worker );
+  const t_palette* p_palette;
 
-stop:
-  p_thread_state->done = 1;
-  return p_data;
+  /* color again when recolor_image() has swapped the palette meanwhile */
+  if( p_tile->pass != PASS_REFERENCE_ORBIT && p_job->p_data->image && ! retcode ) {
+    do {
+      p_palette = p_job->p_data->p_palette;
+      colorize_tile( p_job->p_data, p_tile, p_palette );
+      __sync_synchronize();
+    } while( p_palette != p_job->p_data->p_palette );
+  }
+
+  /* full barrier, the display must not see the flag before the pixels */
+  if( p_tile->pass != PASS_REFERENCE_ORBIT && p_job->tile_dirty )
+    __sync_fetch_and_or( & p_job->tile_dirty[ tile_index( p_job->p_data, p_tile ) ], 1 );
+
+  return retcode;
 }
 
 
@@ -130,102 +791,151 @@ void print_mandel( const t_parman_data* p )
   }
 }
 
-void release_rendering( t_parman_threads* p )
+void log_rendering_stats( const t_parman_data* p )
 {
-  int i, all_done;
+  const long nr_pixels = (long)p->res_x * p->res_y;
 
-  for( i=0; i < p->nr_threads; ++i ) {
-    if( ! p->thread[i].state.done ) {
-      p->thread[i].state.stop = 1;
-    }
-  }
+  t_tile_cache_stats stats;
 
-  do {
-    for(i=0, all_done = 1; i < p->nr_threads; ++i ) {
-      all_done = all_done && p->thread[i].state.done;
-    }
-    usleep( 1000 );
-  } while( !all_done );
+  log_message("%s kernel: %ld of %ld pixels inside cardioid or bulb, %ld periodic, %ld filled\n",
+              precision_name( p->precision ), p->nr_bulb_pixels, nr_pixels, p->nr_periodic_pixels,
+              p->nr_filled_pixels );
 
-  free( p->thread );
+  if( p->p_tile_cache ) {
+    get_tile_cache_stats( p->p_tile_cache, & stats );
+    log_message("tile cache: %ld hits, %ld misses, %ld evictions, %ld tiles in %ld of %ld kB\n",
+                stats.hits, stats.misses, stats.evictions, stats.nr_tiles, stats.bytes / 1024,
+                stats.budget / 1024 );
+  }
+}
+
+void release_rendering( t_parman_job* p )
+{
+  cancel_tile_job( & p->job );
+  wait_tile_job( & p->job );
+  destroy_tile_job( & p->job );
+  free( p->tile_cached );
+  free( p->tile_dirty );
+  free( p->tile_pieces );
   free( p );
 }
 
-t_parman_threads* start_rendering( t_parman_data* p_data, const int nr_threads )
+int wait_rendering( t_parman_job* p )
 {
-  t_parman_threads*      p;
-  t_parman_thread_state* p_thread_state;
-  const int tot_elements = p_data->res_x * p_data->res_y;
-  int retcode, i, j;
+  wait_tile_job( & p->job );
 
-  p = malloc( sizeof( t_parman_threads ) );
+  return p->job.stop ? -1 : 0;
+}
+
+t_parman_job* start_rendering( t_parman_data* p_data, t_thread_pool* p_pool )
+{
+  t_parman_job* p;
+
+  p = malloc( sizeof( t_parman_job ) );
   if( p == NULL ) {
     log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
     return NULL;
   }
-  memset( p, 0, sizeof(t_parman_threads) );
+  memset( p, 0, sizeof(t_parman_job) );
+  init_tile_job( & p->job, render_tile );
+  p->p_data = p_data;
+  p->p_pool = p_pool;
+
+  /* pixels of an exponential map span all zoom depths at once */
+  if( p_data->expmap_radius > 0 && ! is_perturbation( p_data->precision ) )
+    p_data->precision = get_span_kernel( PARMAN_PRECISION_PERTURBATION_AVX2 ) ?
+      PARMAN_PRECISION_PERTURBATION_AVX2 : PARMAN_PRECISION_PERTURBATION;
+
+  if( p_data->precision == PARMAN_PRECISION_AUTO )
+    p_data->precision = select_precision( p_data );
+
+  p->kernel = get_span_kernel( p_data->precision );
+  if( p->kernel == NULL ) {
+    log_error("%s,%d: precision %s is not supported by this processor, fall back to %s!\n",
+              __func__, __LINE__, precision_name( p_data->precision ),
+              precision_name( PARMAN_PRECISION_LONG_DOUBLE ) );
+    p_data->precision = PARMAN_PRECISION_LONG_DOUBLE;
+    p->kernel = get_span_kernel( p_data->precision );
+  }
+
+  /* known pixels in even rows and columns are those of the coarse and medium passes */
+  if( p_data->even_known ) {
+    p->first_pass = PASS_FINE;
+    if( p_data->predicted_cost == NULL )
+      predict_tile_cost( p_data, p_data );
+  }
+  else
+    p->first_pass = ( p_data->progressive && ! p_data->subdivide ) ? PASS_COARSE : 0;
 
-  p->thread = malloc( nr_threads * sizeof( t_parman_thread ) );
-  if( p->thread == NULL ) {
+  /* all tiles start dirty, the frame may come from the cache or a previous view */
+  p->tile_dirty = malloc( count_tiles( p_data->res_x, p_data->res_y ) );
+  if( p->tile_dirty == NULL ) {
     log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    destroy_tile_job( & p->job );
     free( p );
     return NULL;
   }
-  memset( p->thread, 0, nr_threads * sizeof(t_parman_thread) );
-  p->nr_threads = nr_threads;
+  memset( p->tile_dirty, 1, count_tiles( p_data->res_x, p_data->res_y ) );
 
-  for( i=0; i<nr_threads; ++i ) {
-    p_thread_state = & p->thread[i].state;
-    p_thread_state->p_data = p_data;
-    p_thread_state->elements = tot_elements / nr_threads;
-    p_thread_state->start_idx = i * p_thread_state->elements;
-    if( i == nr_threads-1 )
-      p_thread_state->elements = tot_elements - i * p_thread_state->elements - 1;
-
-    retcode = pthread_create( & p->thread[i].renderer, NULL, render_mandel, p_thread_state );
-    if( ! retcode ) {
-      retcode = pthread_detach( p->thread[i].renderer );
+  if( p_data->subdivide ) {
+    p->tile_pieces = calloc( count_tiles( p_data->res_x, p_data->res_y ), sizeof( long ) );
+    if( p->tile_pieces == NULL ) {
+      log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+      free( p->tile_dirty );
+      destroy_tile_job( & p->job );
+      free( p );
+      return NULL;
     }
+  }
 
-    if( retcode ) {
-      log_error("%s,%d: could not create thread no %d error %d!\n",
-              __func__, __LINE__, i, retcode );
-      for( j=i-1; j>=0; ++j ) {
-        p->thread[j].state.stop = 1;
-      }
-      free( p->thread );
-      free( p );
+  if( p_data->p_tile_cache ) {
+    p->tile_cached = calloc( count_tiles( p_data->res_x, p_data->res_y ), 1 );
+    if( p->tile_cached == NULL )
+      log_error("%s,%d: out of memory error, tile cache not used!\n", __func__, __LINE__ );
+  }
+
+  if( is_perturbation( p_data->precision ) && ( p_data->p_orbit == NULL || ! p_data->p_orbit->prepared ) ) {
+    t_tile orbit_tile = { .pass = PASS_REFERENCE_ORBIT };
+
+    if( enqueue_tile( p_pool, & p->job, & orbit_tile, 0 ) ) {
+      log_error("%s,%d: could not submit rendering job error!\n", __func__, __LINE__ );
+      release_rendering( p );
       return NULL;
     }
   }
+  else if( submit_pass( p, p->first_pass ) ) {
+    log_error("%s,%d: could not submit rendering job error!\n", __func__, __LINE__ );
+    release_rendering( p );
+    return NULL;
+  }
 
   return p;
 }
 
 /* convenience function which handle both, threads and data */
 
-t_parman_data* get_image_data( t_parman_threads* p_parman_threads )
+t_parman_data* get_image_data( t_parman_job* p_job )
 {
-  return p_parman_threads->thread[0].state.p_data;
+  return p_job->p_data;
 }
 
-void release_image( t_parman_threads* p_parman_threads )
+void release_image( t_parman_job* p_job )
 {
-  t_parman_data* p_data = p_parman_threads->thread[0].state.p_data;
-  release_rendering( p_parman_threads );
+  t_parman_data* p_data = p_job->p_data;
+  release_rendering( p_job );
   release_parman_data( p_data );
 }
 
-t_parman_threads* render_image( const int res_x,
+t_parman_job* render_image( const int res_x,
                                 const int res_y,
                                 const long double min_x,
                                 const long double min_y,
                                 const long double width,
                                 const long double height,
                                 const int iterations,
-                                const int nr_threads )
+                                t_thread_pool* p_pool )
 {
-  t_parman_threads* p_parman_threads;
+  t_parman_job* p_job;
 
   t_parman_data* p_data = create_parman_data( res_x, res_y, min_x, min_y, width, height, iterations );
   if( p_data == NULL ) {
@@ -233,22 +943,95 @@ t_parman_threads* render_image( const int res_x,
     return NULL;
   }
 
-  p_parman_threads = start_rendering( p_data, nr_threads );
-  if( p_parman_threads == NULL ) {
+  p_job = start_rendering( p_data, p_pool );
+  if( p_job == NULL ) {
+    log_error("%s, %d: could create renderer error!\n", __func__, __LINE__ );
+    release_parman_data( p_data );
+    return NULL;
+  }
+
+  return p_job;
+}
+
+t_parman_job* render_image_hp( const int res_x,
+                               const int res_y,
+                               const t_bigfix* min_x,
+                               const t_bigfix* min_y,
+                               const long double width,
+                               const long double height,
+                               const int iterations,
+                               t_thread_pool* p_pool )
+{
+  t_parman_job* p_job;
+
+  t_parman_data* p_data = create_parman_data_hp( res_x, res_y, min_x, min_y, width, height, iterations );
+  if( p_data == NULL ) {
+    log_error("%s, %d: could not initialize parameter data error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+
+  p_job = start_rendering( p_data, p_pool );
+  if( p_job == NULL ) {
     log_error("%s, %d: could create renderer error!\n", __func__, __LINE__ );
     release_parman_data( p_data );
     return NULL;
   }
 
-  return p_parman_threads;
+  return p_job;
 }
 
-int has_rendering_completed( t_parman_threads* p)
+void recolor_image( t_parman_job* p, const t_palette* p_palette )
 {
-  int i, all_done;
+  t_parman_data* p_data = p->p_data;
+  const int nr_tiles = count_tiles( p_data->res_x, p_data->res_y );
+  const t_tile image = { .x = 0, .y = 0, .w = p_data->res_x, .h = p_data->res_y };
+  int i;
 
-  for( i=0, all_done = 1; i < p->nr_threads; ++i )
-    all_done = all_done && p->thread[i].state.done;
+  if( p_data->image == NULL )
+    return;
+
+  p_data->p_palette = p_palette;
+  __sync_synchronize();
+  colorize_tile( p_data, & image, p_palette );
+
+  for( i=0; i < nr_tiles; ++i )
+    __sync_fetch_and_or( & p->tile_dirty[i], 1 );
+}
+
+int lower_iterations( t_parman_job* p, const int iterations, const t_palette* p_palette )
+{
+  t_parman_data* p_data = p->p_data;
+  const long nr_pixels = (long)p_data->res_x * p_data->res_y;
+  long i;
+
+  if( ! p->job.done || p->job.stop || iterations >= p_data->iterations )
+    return -1;
+
+  for( i=0; i < nr_pixels; ++i ) {
+    if( p_data->grid[i] >= iterations ) {
+      p_data->grid[i] = iterations;
+      if( p_data->smooth_grid )
+        p_data->smooth_grid[i] = iterations;
+    }
+  }
+  p_data->iterations = iterations;
+
+  recolor_image( p, p_palette );
+
+  return 0;
+}
+
+int fetch_dirty_tile( t_parman_job* p, const int index, t_tile* p_tile )
+{
+  get_tile_rect( p->p_data, index, p_tile );
+
+  return __sync_fetch_and_and( & p->tile_dirty[ index ], 0 );
+}
+
+int has_rendering_completed( t_parman_job* p )
+{
+  if( p->job.done )
+    return PARMAN_NR_PASSES;
 
-  return all_done;
+  return p->completed_passes;
 }
@@ -9,43 +9,123 @@
 #define RENDERING_H
 
 #include <pthread.h>
+#include <scheduler.h>
+#include <bignum.h>
+#include <tilecache.h>
+#include <colormap.h>
+#include <gridfile.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*! range of the iteration depth */
+#define PARMAN_MIN_ITERATIONS 20
+#define PARMAN_MAX_ITERATIONS 1000000
+
+/*! number of passes of progressive rendering: 1/16, 1/4 and all pixels */
+#define PARMAN_NR_PASSES      3
+
+/*!
+ * numeric type and instruction set used by the escape-time kernel
+ */
+typedef enum {
+  PARMAN_PRECISION_AUTO = 0,            /*!< choose the fastest sufficient tier */
+  PARMAN_PRECISION_FLOAT_AVX2,          /*!< eight pixels per AVX2 register in float */
+  PARMAN_PRECISION_FLOAT_AVX512,        /*!< sixteen pixels per AVX-512 register in float */
+  PARMAN_PRECISION_DOUBLE,              /*!< one pixel at a time in double */
+  PARMAN_PRECISION_DOUBLE_AVX2,         /*!< four pixels per AVX2 register */
+  PARMAN_PRECISION_DOUBLE_AVX512,       /*!< eight pixels per AVX-512 register */
+  PARMAN_PRECISION_LONG_DOUBLE,         /*!< x87 extended precision, deep zoom fallback */
+  PARMAN_PRECISION_FLOAT128,            /*!< software emulated quad precision */
+  PARMAN_PRECISION_PERTURBATION,        /*!< double differences to a reference orbit */
+  PARMAN_PRECISION_PERTURBATION_AVX2,   /*!< four differences per AVX2 register */
+  PARMAN_NR_PRECISIONS
+} t_parman_precision;
+
+
+/*!
+ * rendering options which are applied to newly created image data
+ */
+typedef struct {
+  t_parman_precision    precision;
+  int                   interior_checks;        /*!< cardioid, bulb and periodicity shortcuts */
+  int                   subdivide;              /*!< Mariani-Silver rectangle subdivision */
+  int                   progressive;            /*!< coarse preview passes before full resolution */
+  int                   smooth;                 /*!< fractional iteration counts for coloring */
+  t_tile_cache*         p_tile_cache;           /*!< tiles shared between frames or NULL */
+  const t_palette*      p_palette;              /*!< colors tiles when finished or NULL */
+} t_parman_options;
+
+
+struct s_ref_orbit;
+
 typedef struct {
   int                   res_x;;
   int                   res_y;;
+  t_bigfix              hp_x;           /*!< init_x at full precision */
+  t_bigfix              hp_y;           /*!< init_y at full precision */
   long double           init_x;
   long double           init_y;
   long double           step_x;
   long double           step_y;
   int                   iterations;
+  t_parman_precision    precision;
+  int                   interior_checks;
+  long                  nr_bulb_pixels;         /*!< resolved by the cardioid and bulb test */
+  long                  nr_periodic_pixels;     /*!< resolved by periodicity detection */
+  int                   subdivide;
+  int                   progressive;
+  t_tile_cache*         p_tile_cache;
+  long                  nr_filled_pixels;       /*!< filled from a uniform rectangle border */
+  double                expmap_radius;  /*!< radius of row 0 of an exponential map or 0 */
+  struct s_ref_orbit*   p_orbit;        /*!< reference orbit for perturbation */
+  long double           orbit_dx;       /*!< offset of the reference point to init_x */
+  long double           orbit_dy;       /*!< offset of the reference point to init_y */
+  int                   known_x;        /*!< rectangle of the grid which is valid before rendering */
+  int                   known_y;
+  int                   known_w;
+  int                   known_h;
+  int                   even_known;     /*!< pixels in even rows and columns are valid */
   int*                  grid;
+  float*                smooth_grid;    /*!< fractional iteration counts or NULL */
+  t_grid_file*          p_grid_file;    /*!< owner of the mapped grids or NULL */
+  const t_palette* volatile p_palette; /*!< may be swapped while rendering */
+  t_argb*               image;          /*!< colored grid, rows top down, or NULL */
+  long*                 tile_cost;      /*!< iterations and pixels of every tile so far, see costmap.h */
+  long*                 predicted_cost; /*!< expected cost of every tile before rendering or NULL */
 } t_parman_data;
 
 
-typedef struct {
-  t_parman_data*        p_data;
-  int                   start_idx;
-  int                   elements;
-  int                   stop;
-  int                   done;
-} t_parman_thread_state;
+/*!
+ * iterate n pixels of row y starting at column x0 with a column
+ * distance of dx and store their iteration counts in the grid
+ *
+ * \return 0 on success, -1 when the rendering has been stopped
+ */
+typedef int (*t_span_kernel)( t_parman_data* p, const int y, const int x0, const int n, const int dx,
+                              volatile int* p_stop );
 
 
+/*!
+ * rendering of one image grid by the workers of a thread pool
+ */
 typedef struct {
-  pthread_t             renderer;
-  t_parman_thread_state state;
-} t_parman_thread;
-
+  t_tile_job            job;
+  t_parman_data*        p_data;
+  t_thread_pool*        p_pool;
+  t_span_kernel         kernel;
+  int                   first_pass;
+  long                  pass_pending;           /*!< tiles of the current pass not done yet */
+  volatile int          completed_passes;
+  char*                 tile_cached;            /*!< tiles taken from the tile cache */
+  char*                 tile_dirty;             /*!< tiles changed since fetched by the display */
+  long*                 tile_pieces;            /*!< unfinished quarters of subdivided tiles */
+} t_parman_job;
 
-typedef struct {
-  t_parman_thread*      thread;
-  int                   nr_threads;
-} t_parman_threads;
 
+void set_parman_options( const t_parman_options* p_options );
+const t_parman_options* get_parman_options( void );
 
 void release_parman_data( t_parman_data* p );
 t_parman_data* create_parman_data( const int res_x,
@@ -55,22 +135,126 @@ t_parman_data* create_parman_data( const int res_x,
                                  const long double width,
                                  const long double height,
                                  const int iterations );
+t_parman_data* create_parman_data_hp( const int res_x,
+                                      const int res_y,
+                                      const t_bigfix* min_x,
+                                      const t_bigfix* min_y,
+                                      const long double width,
+                                      const long double height,
+                                      const int iterations );
+
+/*!
+ * create image data on the grid of a mapped file, the data takes over
+ * the file and releases it with the data
+ *
+ * Tiles flagged as complete in the file are skipped by start_rendering(),
+ * all others are flagged as soon as they are rendered. Neither the tile
+ * cache nor subdivision is used, the latter completes tiles piecewise.
+ */
+t_parman_data* create_parman_data_file( t_grid_file* p_grid_file );
 void print_mandel( const t_parman_data* p );
-void release_rendering( t_parman_threads* p );
-t_parman_threads* start_rendering( t_parman_data* p_data, const int nr_threads );
 
-t_parman_data* get_image_data( t_parman_threads* p_parman_threads );
-void release_image( t_parman_threads* p_parman_threads );
-t_parman_threads* render_image( const int res_x,
+/*!
+ * declare a rectangle of the grid as valid, its tiles are skipped by
+ * start_rendering()
+ */
+void mark_rendered( t_parman_data* p, const int x, const int y, const int w, const int h );
+
+/*!
+ * \return true when two steps describe the same pixel lattice up to
+ * the rounding of width / resolution
+ */
+int same_step( const long double a, const long double b );
+
+/*!
+ * copy the overlap of a completely rendered grid with the same origin,
+ * step and iteration depth and mark it as valid
+ *
+ * \return number of copied pixels
+ */
+long reuse_rendered_pixels( t_parman_data* p_dst, const t_parman_data* p_src );
+
+/*!
+ * \return copy of the iteration counts within a rectangle of a
+ * rendered grid, without image, or NULL when out of memory
+ */
+t_parman_data* copy_parman_rect( const t_parman_data* p, const int x, const int y, const int w, const int h );
+
+/*!
+ * copy the pixels of a grid with twice the step which fall onto the
+ * even rows and columns of another grid, all of them have to be covered
+ * with the same iteration depth and kernel tier; start_rendering() then
+ * iterates only the remaining three quarters of the pixels
+ *
+ * \return number of copied pixels
+ */
+long reuse_coarser_pixels( t_parman_data* p_dst, const t_parman_data* p_src );
+
+/*!
+ * log how many pixels of the frame have been resolved by interior checks
+ * or filled by rectangle subdivision and the tile cache statistics
+ */
+void log_rendering_stats( const t_parman_data* p );
+void release_rendering( t_parman_job* p );
+t_parman_job* start_rendering( t_parman_data* p_data, t_thread_pool* p_pool );
+
+/*!
+ * wait until all tiles of the job have been processed or skipped
+ *
+ * \return 0 when the image is complete, -1 when the job has been stopped
+ * by a failed tile or cancelled before
+ */
+int wait_rendering( t_parman_job* p );
+
+t_parman_data* get_image_data( t_parman_job* p_job );
+void release_image( t_parman_job* p_job );
+t_parman_job* render_image( const int res_x,
                                 const int res_y,
                                 const long double min_x,
                                 const long double min_y,
                                 const long double width,
                                 const long double height,
                                 const int iterations,
-                                const int nr_threads );
+                                t_thread_pool* p_pool );
+t_parman_job* render_image_hp( const int res_x,
+                               const int res_y,
+                               const t_bigfix* min_x,
+                               const t_bigfix* min_y,
+                               const long double width,
+                               const long double height,
+                               const int iterations,
+                               t_thread_pool* p_pool );
+
+/*!
+ * \return number of completed passes, PARMAN_NR_PASSES when the job is
+ * done, which includes stopped jobs, see wait_rendering()
+ */
+int has_rendering_completed( t_parman_job* p );
+
+/*!
+ * color the whole image of a job with another palette and mark all its
+ * tiles as changed, tiles which are finished meanwhile use the new
+ * palette as well
+ */
+void recolor_image( t_parman_job* p, const t_palette* p_palette );
 
-int has_rendering_completed( t_parman_threads* p);
+/*!
+ * lower the iteration depth of a completed image without iterating
+ * again, pixels which have not escaped within the new depth become
+ * interior, and color it with the given palette
+ *
+ * \return 0 on success, -1 when the image is not complete or the depth
+ * is not lower, it has to be rendered again then
+ */
+int lower_iterations( t_parman_job* p, const int iterations, const t_palette* p_palette );
+
+/*!
+ * check whether the tile with the given index has changed since the
+ * last call, clear its flag and store its geometry in p_tile
+ *
+ * \return 1 when the tile has changed
+ */
+int fetch_dirty_tile( t_parman_job* p, const int index, t_tile* p_tile );
 
 #ifdef __cplusplus
 }
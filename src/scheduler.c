@@ -0,0 +1,562 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <scheduler.h>
+#include <log.h>
+
+#define INITIAL_DEQUE_CAPACITY   64
+
+/* events per worker when a trace is started and at most */
+#define INITIAL_TRACE_CAPACITY   1024
+#define TRACE_MAX_EVENTS         ( 1L << 20 )
+
+
+static int grow_deque( t_tile_deque* p )
+{
+  const int elements = p->tail - p->head;
+  const int capacity = p->capacity ? 2 * p->capacity : INITIAL_DEQUE_CAPACITY;
+  t_tile* tiles;
+  int i;
+
+  tiles = malloc( capacity * sizeof(t_tile) );
+  if( tiles == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  for( i=0; i < elements; ++i )
+    tiles[i] = p->tiles[ (p->head + i) % p->capacity ];
+
+  free( p->tiles );
+  p->tiles = tiles;
+  p->capacity = capacity;
+  p->head = 0;
+  p->tail = elements;
+
+  return 0;
+}
+
+static int pop_tail( t_tile_deque* p, t_tile* p_tile )
+{
+  int found = 0;
+
+  pthread_mutex_lock( & p->lock );
+  if( p->tail > p->head ) {
+    --p->tail;
+    *p_tile = p->tiles[ p->tail % p->capacity ];
+    found = 1;
+  }
+  pthread_mutex_unlock( & p->lock );
+
+  return found;
+}
+
+static int steal_head( t_tile_deque* p, t_tile* p_tile )
+{
+  int found = 0;
+
+  pthread_mutex_lock( & p->lock );
+  if( p->tail > p->head ) {
+    *p_tile = p->tiles[ p->head % p->capacity ];
+    ++p->head;
+    found = 1;
+  }
+  pthread_mutex_unlock( & p->lock );
+
+  return found;
+}
+
+void release_tile_scheduler( t_tile_scheduler* p )
+{
+  int i;
+
+  if( p ) {
+    for( i=0; i < p->nr_deques; ++i ) {
+      pthread_mutex_destroy( & p->deque[i].lock );
+      free( p->deque[i].tiles );
+    }
+    free( p->deque );
+    free( p );
+  }
+}
+
+t_tile_scheduler* create_tile_scheduler( const int nr_deques )
+{
+  t_tile_scheduler* p;
+  int i;
+
+  p = malloc( sizeof( t_tile_scheduler ) );
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+
+  p->deque = malloc( nr_deques * sizeof( t_tile_deque ) );
+  if( p->deque == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( p );
+    return NULL;
+  }
+  memset( p->deque, 0, nr_deques * sizeof( t_tile_deque ) );
+  p->nr_deques = nr_deques;
+
+  for( i=0; i < nr_deques; ++i )
+    pthread_mutex_init( & p->deque[i].lock, NULL );
+
+  return p;
+}
+
+int push_tile( t_tile_scheduler* p, const int worker, const t_tile* p_tile )
+{
+  t_tile_deque* p_deque = & p->deque[ worker % p->nr_deques ];
+  int retcode = 0;
+
+  pthread_mutex_lock( & p_deque->lock );
+  if( p_deque->tail - p_deque->head >= p_deque->capacity )
+    retcode = grow_deque( p_deque );
+
+  if( ! retcode ) {
+    p_deque->tiles[ p_deque->tail % p_deque->capacity ] = *p_tile;
+    ++p_deque->tail;
+  }
+  pthread_mutex_unlock( & p_deque->lock );
+
+  return retcode;
+}
+
+int next_tile( t_tile_scheduler* p, const int worker, t_tile* p_tile )
+{
+  int i;
+
+  if( pop_tail( & p->deque[ worker ], p_tile ) )
+    return 1;
+
+  for( i=1; i < p->nr_deques; ++i ) {
+    if( steal_head( & p->deque[ (worker + i) % p->nr_deques ], p_tile ) )
+      return 2;
+  }
+
+  return 0;
+}
+
+
+/* job bookkeeping */
+
+static void finish_tile( t_tile_job* p_job )
+{
+  if( __sync_sub_and_fetch( & p_job->pending, 1 ) == 0 ) {
+    pthread_mutex_lock( & p_job->lock );
+    p_job->done = 1;
+    pthread_cond_broadcast( & p_job->cond );
+    pthread_mutex_unlock( & p_job->lock );
+  }
+}
+
+void init_tile_job( t_tile_job* p_job, t_tile_fn process_tile )
+{
+  p_job->process_tile = process_tile;
+  p_job->stop = 0;
+  p_job->done = 0;
+  p_job->pending = 0;
+  pthread_mutex_init( & p_job->lock, NULL );
+  pthread_cond_init( & p_job->cond, NULL );
+}
+
+void destroy_tile_job( t_tile_job* p_job )
+{
+  pthread_cond_destroy( & p_job->cond );
+  pthread_mutex_destroy( & p_job->lock );
+}
+
+void cancel_tile_job( t_tile_job* p_job )
+{
+  p_job->stop = 1;
+}
+
+void wait_tile_job( t_tile_job* p_job )
+{
+  pthread_mutex_lock( & p_job->lock );
+  while( ! p_job->done )
+    pthread_cond_wait( & p_job->cond, & p_job->lock );
+  pthread_mutex_unlock( & p_job->lock );
+}
+
+static void announce_tiles( t_thread_pool* p, const int nr_tiles )
+{
+  pthread_mutex_lock( & p->lock );
+  p->queued += nr_tiles;
+  if( nr_tiles > 1 )
+    pthread_cond_broadcast( & p->work_cond );
+  else
+    pthread_cond_signal( & p->work_cond );
+  pthread_mutex_unlock( & p->lock );
+}
+
+int enqueue_tile( t_thread_pool* p, t_tile_job* p_job, const t_tile* p_tile, const int worker )
+{
+  t_tile tile = *p_tile;
+
+  tile.p_job = p_job;
+  __sync_add_and_fetch( & p_job->pending, 1 );
+  if( push_tile( p->p_scheduler, worker, & tile ) ) {
+    finish_tile( p_job );
+    return -1;
+  }
+
+  announce_tiles( p, 1 );
+  return 0;
+}
+
+/*
+ * Cuts the grid into tiles and deals them out round robin so that
+ * every worker starts with tiles scattered over the whole image and
+ * expensive areas such as the interior of the set are shared from the
+ * beginning.
+ */
+int count_tiles( const int res_x, const int res_y )
+{
+  return ( ( res_x + TILE_SIZE - 1 ) / TILE_SIZE ) * ( ( res_y + TILE_SIZE - 1 ) / TILE_SIZE );
+}
+
+int submit_tile_job( t_thread_pool* p, t_tile_job* p_job, const int res_x, const int res_y )
+{
+  return submit_tile_pass( p, p_job, res_x, res_y, 0 );
+}
+
+int submit_tile_pass( t_thread_pool* p, t_tile_job* p_job, const int res_x, const int res_y, const int pass )
+{
+  t_tile tile;
+  int x, y, worker, nr_tiles = 0, retcode = 0;
+
+  /* hold back completion until all tiles have been queued */
+  __sync_add_and_fetch( & p_job->pending, 1 );
+  worker = __sync_fetch_and_add( & p->next_worker, 1 ) % p->nr_threads;
+  tile.pass = pass;
+  tile.p_job = p_job;
+
+  for( y = 0; y < res_y && !retcode; y += TILE_SIZE ) {
+    for( x = 0; x < res_x; x += TILE_SIZE ) {
+      tile.x = x;
+      tile.y = y;
+      tile.w = ( x + TILE_SIZE <= res_x ) ? TILE_SIZE : res_x - x;
+      tile.h = ( y + TILE_SIZE <= res_y ) ? TILE_SIZE : res_y - y;
+
+      __sync_add_and_fetch( & p_job->pending, 1 );
+      if( push_tile( p->p_scheduler, worker, & tile ) ) {
+        finish_tile( p_job );
+        retcode = -1;
+        break;
+      }
+      ++nr_tiles;
+
+      if( ++worker >= p->nr_threads )
+        worker = 0;
+    }
+  }
+
+  if( retcode )
+    cancel_tile_job( p_job );
+
+  announce_tiles( p, nr_tiles );
+  finish_tile( p_job );
+
+  return retcode;
+}
+
+typedef struct {
+  long                  cost;
+  int                   index;
+} t_tile_cost;
+
+static int compare_cost( const void* a, const void* b )
+{
+  const long ca = ((const t_tile_cost *)a)->cost, cb = ((const t_tile_cost *)b)->cost;
+
+  return ( ca < cb ) ? 1 : ( ca > cb ) ? -1 : 0;
+}
+
+/*
+ * Longest processing time first: every tile, starting with the most
+ * expensive one, goes to the worker with the least expected work so
+ * far. Each queue is filled from its cheapest tile on, so that the
+ * owner pops its most expensive tile first while thieves take the
+ * cheap ones which fill the gaps at the end of the pass.
+ */
+int submit_tile_pass_by_cost( t_thread_pool* p, t_tile_job* p_job, const int res_x, const int res_y,
+                              const int pass, const long* cost )
+{
+  const int tiles_x = ( res_x + TILE_SIZE - 1 ) / TILE_SIZE;
+  const int nr_tiles = count_tiles( res_x, res_y );
+  t_tile_cost* order = malloc( nr_tiles * sizeof( t_tile_cost ) );
+  int* owner = malloc( nr_tiles * sizeof( int ) );
+  long* load = calloc( p->nr_threads, sizeof( long ) );
+  t_tile tile;
+  int i, w, worker, pushed = 0, retcode = 0;
+
+  if( order == NULL || owner == NULL || load == NULL ) {
+    log_error("%s,%d: out of memory error, tiles are dealt out round robin!\n", __func__, __LINE__ );
+    free( order );
+    free( owner );
+    free( load );
+    return submit_tile_pass( p, p_job, res_x, res_y, pass );
+  }
+
+  for( i=0; i < nr_tiles; ++i ) {
+    order[i].cost = cost[i];
+    order[i].index = i;
+  }
+  qsort( order, nr_tiles, sizeof( t_tile_cost ), compare_cost );
+
+  for( i=0; i < nr_tiles; ++i ) {
+    for( worker = 0, w = 1; w < p->nr_threads; ++w ) {
+      if( load[w] < load[worker] )
+        worker = w;
+    }
+    owner[i] = worker;
+    load[worker] += order[i].cost + 1;
+  }
+
+  /* hold back completion until all tiles have been queued */
+  __sync_add_and_fetch( & p_job->pending, 1 );
+  tile.pass = pass;
+  tile.p_job = p_job;
+
+  for( i = nr_tiles - 1; i >= 0; --i ) {
+    tile.x = ( order[i].index % tiles_x ) * TILE_SIZE;
+    tile.y = ( order[i].index / tiles_x ) * TILE_SIZE;
+    tile.w = ( tile.x + TILE_SIZE <= res_x ) ? TILE_SIZE : res_x - tile.x;
+    tile.h = ( tile.y + TILE_SIZE <= res_y ) ? TILE_SIZE : res_y - tile.y;
+
+    __sync_add_and_fetch( & p_job->pending, 1 );
+    if( push_tile( p->p_scheduler, owner[i], & tile ) ) {
+      finish_tile( p_job );
+      retcode = -1;
+      break;
+    }
+    ++pushed;
+  }
+
+  if( retcode )
+    cancel_tile_job( p_job );
+
+  announce_tiles( p, pushed );
+  finish_tile( p_job );
+
+  free( order );
+  free( owner );
+  free( load );
+
+  return retcode;
+}
+
+
+/* thread pool */
+
+long get_time_ns( void )
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+typedef struct {
+  t_thread_pool*        p_pool;
+  int                   worker;
+} t_worker_arg;
+
+/*
+ * Tiles are appended to the trace of the worker until its buffer has
+ * reached TRACE_MAX_EVENTS, the rest is only counted.
+ */
+static void trace_tile( t_trace_buffer* p, const t_tile* p_tile, const long start_ns, const long duration_ns )
+{
+  t_trace_event* events;
+  long capacity;
+
+  if( p->nr_events == p->capacity ) {
+    capacity = p->capacity ? 2 * p->capacity : INITIAL_TRACE_CAPACITY;
+    events = ( capacity <= TRACE_MAX_EVENTS ) ? realloc( p->events, capacity * sizeof( t_trace_event ) ) : NULL;
+    if( events == NULL ) {
+      ++p->dropped;
+      return;
+    }
+    p->events = events;
+    p->capacity = capacity;
+  }
+
+  p->events[ p->nr_events ].start_ns = start_ns;
+  p->events[ p->nr_events ].duration_ns = duration_ns;
+  p->events[ p->nr_events ].tile = *p_tile;
+  ++p->nr_events;
+}
+
+static void* pool_worker( void* pa )
+{
+  t_worker_arg* p_arg = (t_worker_arg *)pa;
+  t_thread_pool* p = p_arg->p_pool;
+  const int worker = p_arg->worker;
+  t_worker_stats* p_stats = & p->stats[ worker ];
+  t_tile_job* p_job;
+  t_tile tile;
+  long start, end;
+  int found;
+
+  free( p_arg );
+
+  while( 1 ) {
+    found = next_tile( p->p_scheduler, worker, & tile );
+    if( found ) {
+      __sync_sub_and_fetch( & p->queued, 1 );
+      p_job = tile.p_job;
+      if( ! p_job->stop ) {
+        start = get_time_ns();
+        if( p_job->process_tile( p_job, & tile, worker ) )
+          p_job->stop = 1;
+        end = get_time_ns();
+        p_stats->busy_ns += end - start;
+        ++p_stats->tiles;
+        if( found == 2 )
+          ++p_stats->steals;
+        if( p->trace )
+          trace_tile( & p->trace[ worker ], & tile, start - p->trace_start_ns, end - start );
+      }
+      finish_tile( p_job );
+      continue;
+    }
+
+    pthread_mutex_lock( & p->lock );
+    while( p->queued <= 0 && ! p->shutdown )
+      pthread_cond_wait( & p->work_cond, & p->lock );
+    if( p->queued <= 0 && p->shutdown ) {
+      pthread_mutex_unlock( & p->lock );
+      break;
+    }
+    pthread_mutex_unlock( & p->lock );
+  }
+
+  return NULL;
+}
+
+void release_thread_pool( t_thread_pool* p )
+{
+  int i;
+
+  if( p ) {
+    pthread_mutex_lock( & p->lock );
+    p->shutdown = 1;
+    pthread_cond_broadcast( & p->work_cond );
+    pthread_mutex_unlock( & p->lock );
+
+    for( i=0; i < p->nr_threads; ++i )
+      pthread_join( p->thread[i], NULL );
+
+    release_tile_scheduler( p->p_scheduler );
+    pthread_cond_destroy( & p->work_cond );
+    pthread_mutex_destroy( & p->lock );
+    stop_trace( p );
+    free( p->thread );
+    free( p->stats );
+    free( p );
+  }
+}
+
+t_thread_pool* create_thread_pool( const int nr_threads )
+{
+  t_thread_pool* p;
+  t_worker_arg* p_arg;
+  int retcode = 0, i, nr;
+
+  nr = nr_threads;
+  if( nr <= 0 ) {
+    nr = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    if( nr < 1 )
+      nr = 1;
+  }
+
+  p = malloc( sizeof( t_thread_pool ) );
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_thread_pool ) );
+  pthread_mutex_init( & p->lock, NULL );
+  pthread_cond_init( & p->work_cond, NULL );
+
+  /* one cache line per worker, so that the counters are not shared */
+  p->thread = malloc( nr * sizeof( pthread_t ) );
+  if( posix_memalign( (void **) & p->stats, 64, nr * sizeof( t_worker_stats ) ) )
+    p->stats = NULL;
+  else
+    memset( p->stats, 0, nr * sizeof( t_worker_stats ) );
+  p->p_scheduler = create_tile_scheduler( nr );
+  if( p->thread == NULL || p->stats == NULL || p->p_scheduler == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_thread_pool( p );
+    return NULL;
+  }
+
+  for( i=0; i < nr; ++i ) {
+    p_arg = malloc( sizeof( t_worker_arg ) );
+    if( p_arg == NULL ) {
+      retcode = -1;
+    } else {
+      p_arg->p_pool = p;
+      p_arg->worker = i;
+      retcode = pthread_create( & p->thread[i], NULL, pool_worker, p_arg );
+      if( retcode )
+        free( p_arg );
+    }
+
+    if( retcode ) {
+      log_error("%s,%d: could not create thread no %d error %d!\n",
+                __func__, __LINE__, i, retcode );
+      release_thread_pool( p );
+      return NULL;
+    }
+    p->nr_threads = i + 1;
+  }
+
+  return p;
+}
+
+void get_worker_stats( const t_thread_pool* p, t_worker_stats* p_stats )
+{
+  memcpy( p_stats, p->stats, p->nr_threads * sizeof( t_worker_stats ) );
+}
+
+int start_trace( t_thread_pool* p )
+{
+  if( p->trace )
+    return 0;
+
+  p->trace = calloc( p->nr_threads, sizeof( t_trace_buffer ) );
+  if( p->trace == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return -1;
+  }
+  p->trace_start_ns = get_time_ns();
+
+  return 0;
+}
+
+void stop_trace( t_thread_pool* p )
+{
+  int i;
+
+  if( p->trace ) {
+    for( i=0; i < p->nr_threads; ++i )
+      free( p->trace[i].events );
+    free( p->trace );
+    p->trace = NULL;
+  }
+}
@@ -0,0 +1,225 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! edge length in pixels of the square work items handed to the renderers */
+#define TILE_SIZE       32
+
+
+struct s_tile_job;
+
+/*!
+ * rectangular work item within the image grid of a job
+ */
+typedef struct {
+  int                   x;
+  int                   y;
+  int                   w;
+  int                   h;
+  int                   pass;           /*!< processing stage, interpreted by the job */
+  struct s_tile_job*    p_job;
+} t_tile;
+
+
+/*!
+ * callback which processes one tile of a job on the given worker
+ */
+typedef int (*t_tile_fn)( struct s_tile_job* p_job, const t_tile* p_tile, const int worker );
+
+
+/*!
+ * unit of work submitted to the thread pool
+ *
+ * A job is done as soon as all of its tiles have been processed or
+ * skipped after cancellation. Users embed this struct as the first
+ * member of their own job description.
+ */
+typedef struct s_tile_job {
+  t_tile_fn             process_tile;
+  volatile int          stop;
+  volatile int          done;
+  long                  pending;
+  pthread_mutex_t       lock;
+  pthread_cond_t        cond;
+} t_tile_job;
+
+
+/*!
+ * double ended tile queue, one per worker thread
+ *
+ * The owning worker pushes and pops tiles at the tail while idle
+ * workers steal from the head, so that owner and thieves only
+ * contend when the queue is nearly empty.
+ */
+typedef struct {
+  pthread_mutex_t       lock;
+  t_tile*               tiles;
+  int                   capacity;
+  int                   head;
+  int                   tail;
+} t_tile_deque;
+
+
+/*!
+ * set of tile queues shared by all workers of a pool
+ */
+typedef struct {
+  t_tile_deque*         deque;
+  int                   nr_deques;
+} t_tile_scheduler;
+
+
+/*!
+ * counters of one worker thread, written by the worker only and
+ * filling one cache line
+ */
+typedef struct {
+  long                  tiles;          /*!< processed tiles */
+  long                  steals;         /*!< tiles taken from the queues of other workers */
+  long                  busy_ns;        /*!< time spent processing tiles */
+  long                  idle_ns;        /*!< rest of a measured interval, see get_render_stats() */
+  long                  pixels;         /*!< iterated pixels */
+  long                  iterations;     /*!< executed iterations */
+  long                  escaped;        /*!< pixels whose orbit escaped */
+  long                  interior;       /*!< pixels which reached the iteration depth */
+} t_worker_stats;
+
+/*!
+ * a processed tile in the timeline of a worker
+ */
+typedef struct {
+  long                  start_ns;       /*!< since start_trace() */
+  long                  duration_ns;
+  t_tile                tile;
+} t_trace_event;
+
+typedef struct {
+  t_trace_event*        events;
+  long                  nr_events;
+  long                  capacity;
+  long                  dropped;        /*!< events beyond the maximum size of the buffer */
+} t_trace_buffer;
+
+/*!
+ * long-lived worker threads which process the tiles of all jobs
+ */
+typedef struct {
+  pthread_t*            thread;
+  int                   nr_threads;
+  t_tile_scheduler*     p_scheduler;
+  pthread_mutex_t       lock;
+  pthread_cond_t        work_cond;
+  long                  queued;
+  int                   next_worker;
+  int                   shutdown;
+  t_worker_stats*       stats;          /*!< one per worker */
+  t_trace_buffer*       trace;          /*!< one per worker while tracing or NULL */
+  long                  trace_start_ns;
+} t_thread_pool;
+
+
+void release_tile_scheduler( t_tile_scheduler* p );
+t_tile_scheduler* create_tile_scheduler( const int nr_deques );
+
+int push_tile( t_tile_scheduler* p, const int worker, const t_tile* p_tile );
+
+/*!
+ * fetch the next tile for the given worker, stealing from the other
+ * workers when its own queue has run dry
+ *
+ * \return 1 when a tile has been retrieved from the own queue, 2 when it
+ * has been stolen from another one, 0 when all queues are empty
+ */
+int next_tile( t_tile_scheduler* p, const int worker, t_tile* p_tile );
+
+
+/*!
+ * stop all workers after the queued tiles have been drained
+ */
+void release_thread_pool( t_thread_pool* p );
+
+/*!
+ * start the given number of workers, one per online processor when
+ * nr_threads is zero or negative
+ */
+t_thread_pool* create_thread_pool( const int nr_threads );
+
+
+void init_tile_job( t_tile_job* p_job, t_tile_fn process_tile );
+void destroy_tile_job( t_tile_job* p_job );
+
+/*!
+ * cut a res_x * res_y grid into tiles and deal them out round robin
+ * to the workers of the pool
+ */
+int submit_tile_job( t_thread_pool* p, t_tile_job* p_job, const int res_x, const int res_y );
+
+/*!
+ * same as submit_tile_job() for tiles of the given processing stage
+ */
+int submit_tile_pass( t_thread_pool* p, t_tile_job* p_job, const int res_x, const int res_y, const int pass );
+
+/*!
+ * same as submit_tile_pass() but the tiles are dealt out by their
+ * expected cost, one element per tile in the order of the grid, so
+ * that expensive tiles start first and all workers get about the same
+ * amount of work
+ */
+int submit_tile_pass_by_cost( t_thread_pool* p, t_tile_job* p_job, const int res_x, const int res_y,
+                              const int pass, const long* cost );
+
+/*!
+ * \return number of tiles a res_x * res_y grid is cut into
+ */
+int count_tiles( const int res_x, const int res_y );
+
+/*!
+ * queue an additional tile for a job which has not been completed yet,
+ * preferably on the given worker
+ */
+int enqueue_tile( t_thread_pool* p, t_tile_job* p_job, const t_tile* p_tile, const int worker );
+
+void cancel_tile_job( t_tile_job* p_job );
+void wait_tile_job( t_tile_job* p_job );
+
+/*!
+ * \return monotonic time in nanoseconds
+ */
+long get_time_ns( void );
+
+/*!
+ * copy the counters of all workers of the pool to an array of
+ * nr_threads elements
+ */
+void get_worker_stats( const t_thread_pool* p, t_worker_stats* p_stats );
+
+/*!
+ * record every processed tile from now on, while the pool is idle
+ *
+ * \return 0 on success, -1 on error
+ */
+int start_trace( t_thread_pool* p );
+
+/*!
+ * discard the recorded tiles and stop recording, while the pool is idle
+ */
+void stop_trace( t_thread_pool* p );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef SCHEDULER_H */
@@ -8,28 +8,187 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sdlif.h>
+#include <costmap.h>
 #include <log.h>
 #include <math.h>
 
+/* number of completely rendered frames kept for zooming out again */
+#define FRAME_CACHE_SIZE    16
 
-static void plot_mandel( SDL_Renderer* renderer, const t_gui *p_gui )
+/* bars showing the busy time of every thread */
+#define STATS_BAR_WIDTH     120
+#define STATS_BAR_HEIGHT    6
+#define STATS_BAR_PITCH     8
+
+
+static int resize_texture( SDL_Renderer* renderer, t_gui* p_gui, const int res_x, const int res_y )
+{
+  if( p_gui->texture )
+    SDL_DestroyTexture( p_gui->texture );
+
+  p_gui->texture = SDL_CreateTexture( renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                      res_x, res_y );
+  if( p_gui->texture == NULL ) {
+    log_error("%s,%d: could not create texture error: %s!\n", __func__, __LINE__, SDL_GetError() );
+    p_gui->texture_w = p_gui->texture_h = 0;
+    return -1;
+  }
+
+  p_gui->texture_w = res_x;
+  p_gui->texture_h = res_y;
+  return 0;
+}
+
+/*
+ * Upload the tiles which have changed since the last call to the
+ * streaming texture. The workers have already colored them into the
+ * image of the frame, which is stored top down like the texture.
+ */
+static void plot_mandel( SDL_Renderer* renderer, t_gui *p_gui )
+{
+  const t_parman_data* p = get_image_data( p_gui->p_job );
+  const int nr_tiles = count_tiles( p->res_x, p->res_y );
+  int i, full = 0;
+  SDL_Rect rect;
+  t_tile tile;
+
+  if( p_gui->texture_w != p->res_x || p_gui->texture_h != p->res_y ) {
+    if( resize_texture( renderer, p_gui, p->res_x, p->res_y ) )
+      return;
+    full = 1;
+  }
+
+  for( i=0; i < nr_tiles; ++i ) {
+    if( ! fetch_dirty_tile( p_gui->p_job, i, & tile ) && ! full )
+      continue;
+
+    rect.x = tile.x;
+    rect.y = p->res_y - tile.y - tile.h;
+    rect.w = tile.w;
+    rect.h = tile.h;
+    SDL_UpdateTexture( p_gui->texture, & rect, & p->image[ rect.y * p->res_x + rect.x ],
+                       p->res_x * sizeof( t_argb ) );
+  }
+
+  SDL_RenderCopy( renderer, p_gui->texture, NULL, NULL );
+}
+
+
+/*
+ * The statistics cover the frame from its start until it is complete,
+ * the window title shows their totals.
+ */
+static void update_stats( t_gui* p )
 {
-  const t_parman_data* p = get_image_data( p_gui->p_threads );
-  int x, y, color_index;
-  int max_grid_val = 0;
-  t_rgb* p_rgb;
-
-  for( y = 0; y < p->res_y; ++y ) {
-    for( x = 0; x < p->res_x; ++x ) {
-      color_index = p->grid[ y * p->res_x + x];
-      p_rgb = & p_gui->p_rgb[ color_index ];
-
-      SDL_SetRenderDrawColor(renderer, p_rgb->r, p_rgb->g, p_rgb->b, SDL_ALPHA_OPAQUE);
-      SDL_RenderDrawPoint( renderer, x, p->res_y - y );
+  const t_pool_stats* s = p->p_stats;
+  char title[160];
+
+  if( p->stats_final )
+    return;
+
+  update_pool_stats( p->p_stats, p->p_pool );
+  p->stats_final = has_rendering_completed( p->p_job ) == PARMAN_NR_PASSES;
+
+  if( p->stats_final ) {
+    snprintf( title, sizeof( title ), "parmandel: %.1f Mpixel/s, %.2f Giteration/s, %.0f%% busy, %ld stolen",
+              s->wall_ns > 0 ? 1e3 * s->total.pixels / s->wall_ns : 0.0, get_giterations_per_s( s ),
+              100 * get_busy_share( s ), s->total.steals );
+    SDL_SetWindowTitle( p->window, title );
+  }
+}
+
+/*
+ * one bar per thread in the lower left corner, filled by the share of
+ * the frame in which the thread has been busy
+ */
+static void draw_stats( SDL_Renderer* renderer, t_gui* p_gui )
+{
+  const t_pool_stats* s = p_gui->p_stats;
+  double share;
+  SDL_Rect rect;
+  int i;
+
+  if( ! p_gui->show_stats || s->wall_ns <= 0 )
+    return;
+
+  SDL_SetRenderDrawBlendMode( renderer, SDL_BLENDMODE_BLEND );
+  for( i=0; i < s->nr_workers; ++i ) {
+    share = (double)s->worker[i].busy_ns / s->wall_ns;
+    rect.x = STATS_BAR_PITCH;
+    rect.y = p_gui->texture_h - ( s->nr_workers - i ) * STATS_BAR_PITCH;
+    rect.w = STATS_BAR_WIDTH;
+    rect.h = STATS_BAR_HEIGHT;
+    SDL_SetRenderDrawColor( renderer, 0, 0, 0, 160 );
+    SDL_RenderFillRect( renderer, & rect );
+    rect.w = STATS_BAR_WIDTH * ( share < 1 ? share : 1 );
+    SDL_SetRenderDrawColor( renderer, 0x40, 0xe0, 0x40, 220 );
+    SDL_RenderFillRect( renderer, & rect );
+  }
+}
+
+/*
+ * Leave the current view and start rendering the given one. Completely
+ * rendered frames are kept in the frame cache, a cached frame of the
+ * new view is shown right away and pixels of the current frame which
+ * belong to the new view as well are copied instead of iterated.
+ */
+static t_parman_job* change_view( t_gui* p, const int res_x, const int res_y,
+                                  const t_bigfix* min_x, const t_bigfix* min_y,
+                                  const long double width, const long double height,
+                                  const int iterations )
+{
+  t_parman_data* p_old = get_image_data( p->p_job );
+  const int completed = has_rendering_completed( p->p_job ) == PARMAN_NR_PASSES && ! p->p_job->job.stop;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+
+  p_data = take_cached_frame( p->p_frame_cache, res_x, res_y, min_x, min_y, width, height, iterations );
+  if( p_data ) {
+    p_data->p_palette = get_parman_options()->p_palette;
+  }
+  else {
+    p_data = create_parman_data_hp( res_x, res_y, min_x, min_y, width, height, iterations );
+    if( p_data == NULL )
+      return NULL;
+    if( completed ) {
+      reuse_rendered_pixels( p_data, p_old );
+      predict_tile_cost( p_data, p_old );
     }
   }
+
+  if( completed ) {
+    release_rendering( p->p_job );
+    cache_frame( p->p_frame_cache, p_old );
+  }
+  else
+    release_image( p->p_job );
+  p->p_job = NULL;
+
+  reset_pool_stats( p->p_stats, p->p_pool );
+  p->stats_final = 0;
+  p_job = start_rendering( p_data, p->p_pool );
+  if( p_job == NULL )
+    release_parman_data( p_data );
+
+  return p_job;
 }
 
+/*
+ * new frames are colored with the selected palette
+ */
+static int select_palette( t_gui* p, const int index )
+{
+  const int palette = index % get_nr_palettes();
+  t_parman_options options = *get_parman_options();
+
+  options.p_palette = get_palette( palette );
+  if( options.p_palette == NULL )
+    return -1;
+
+  set_parman_options( & options );
+  p->palette = palette;
+  return 0;
+}
 
 static void* gui_thread( void* _p )
 {
@@ -46,7 +205,8 @@ static void* gui_thread( void* _p )
   const int size_undo_stack = 100;
   t_coord undo_stack[size_undo_stack];
   int top_undo_stack = 0;
-  long double upd_min_x, upd_min_y, upd_width, upd_height;
+  t_bigfix upd_min_x, upd_min_y;
+  long double upd_width, upd_height;
 
   if( SDL_CreateWindowAndRenderer( res_x, res_y, SDL_WINDOW_RESIZABLE, & p->window, & p->renderer) != 0) {
     log_error("%s,%d: could not initialize window and renderer error: %s!\n", __func__, __LINE__, SDL_GetError() );
@@ -57,14 +217,15 @@ static void* gui_thread( void* _p )
   while (!done) {
 
     if( cnt == 0L ) {
-      p->p_threads = render_image( res_x, res_y,
+      reset_pool_stats( p->p_stats, p->p_pool );
+      p->p_job = render_image( res_x, res_y,
                                    -2 /* min_x */,
                                    -1.25 /* min_y */,
                                    2.5 /* width */,
                                    2.5 /* height */,
-                                   iterations, p->nr_threads );
+                                   iterations, p->p_pool );
       update  = 1;
-      if( p->p_threads == NULL ) {
+      if( p->p_job == NULL ) {
         log_error("%s, %d: could create renderer error!\n", __func__, __LINE__ );
         SDL_DestroyRenderer(p->renderer);
         SDL_DestroyWindow(p->window);
@@ -75,7 +236,9 @@ static void* gui_thread( void* _p )
 
 
     if( drawSelection || update ) {
+      update_stats( p );
       plot_mandel( p->renderer, p );
+      draw_stats( p->renderer, p );
       if( drawSelection ) {
         SDL_SetRenderDrawColor( p->renderer, 0xff, 0, 0, 100 );
         SDL_SetRenderDrawBlendMode( p->renderer, SDL_BLENDMODE_BLEND );
@@ -83,13 +246,19 @@ static void* gui_thread( void* _p )
       }
       SDL_RenderPresent( p->renderer );
 
-      if( has_rendering_completed( p->p_threads ) ) {
+      if( has_rendering_completed( p->p_job ) == PARMAN_NR_PASSES ) {
         /* ensure final image update when rendering has been completed and no dragging operation is pending */
         if( ! drawSelection ) {
           SDL_RenderClear( p->renderer );
           plot_mandel( p->renderer, p );
+          draw_stats( p->renderer, p );
           SDL_RenderPresent( p->renderer );
         }
+        if( update ) {
+          log_rendering_stats( get_image_data( p->p_job ) );
+          if( p->cost_map_path )
+            write_cost_map( get_image_data( p->p_job ), p->cost_map_path );
+        }
         update = 0;
       }
     }
@@ -127,22 +296,22 @@ static void* gui_thread( void* _p )
       case SDL_MOUSEBUTTONUP:
         if( SDL_GetWindowID(p->window) == event.button.windowID ) {
           if( event.button.button == SDL_BUTTON_LEFT ) {
-            t_parman_data* p_data = get_image_data( p->p_threads );
+            t_parman_data* p_data = get_image_data( p->p_job );
             drawSelection = 0;
             update = 1;
 
-            upd_min_x  = p_data->init_x + selection.x * p_data->step_x;
-            upd_min_y  = p_data->init_y + selection.y * p_data->step_y;
+            bigfix_add_ld( & upd_min_x, & p_data->hp_x, selection.x * p_data->step_x );
+            bigfix_add_ld( & upd_min_y, & p_data->hp_y, selection.y * p_data->step_y );
             upd_width  = selection.w * p_data->step_x;
             upd_height = selection.h * p_data->step_y;
 
-            undo_stack[top_undo_stack].min_x  = p_data->init_x;
-            undo_stack[top_undo_stack].min_y  = p_data->init_y;
-            undo_stack[top_undo_stack].width  = res_x * p_data->step_x;
-            undo_stack[top_undo_stack].height = res_y * p_data->step_y;
-
-            if( top_undo_stack < size_undo_stack )
+            if( top_undo_stack < size_undo_stack ) {
+              undo_stack[top_undo_stack].min_x  = p_data->hp_x;
+              undo_stack[top_undo_stack].min_y  = p_data->hp_y;
+              undo_stack[top_undo_stack].width  = res_x * p_data->step_x;
+              undo_stack[top_undo_stack].height = res_y * p_data->step_y;
               ++top_undo_stack;
+            }
 
           } else if( event.button.button == SDL_BUTTON_RIGHT ) {
             if( --top_undo_stack < 0 ) {
@@ -153,18 +322,16 @@ static void* gui_thread( void* _p )
               upd_min_x = undo_stack[top_undo_stack].min_x;
               upd_min_y = undo_stack[top_undo_stack].min_y;
               upd_width = undo_stack[top_undo_stack].width;
-              // upd_height = undo_stack[top_undo_stack].height;
-              upd_height = undo_stack[top_undo_stack].width * res_y / res_x;
+              upd_height = undo_stack[top_undo_stack].height;
               update = 1;
             }
           } else {
             break;
           }
 
-          release_image( p->p_threads );
-          p->p_threads = render_image( res_x, res_y, upd_min_x, upd_min_y, upd_width, upd_height,
-                                       iterations, p->nr_threads );
-          if( p->p_threads == NULL ) {
+          p->p_job = change_view( p, res_x, res_y, & upd_min_x, & upd_min_y, upd_width, upd_height,
+                                  iterations );
+          if( p->p_job == NULL ) {
             log_error("%s, %d: could create renderer error!\n", __func__, __LINE__ );
             SDL_DestroyRenderer(p->renderer);
             SDL_DestroyWindow(p->window);
@@ -174,23 +341,80 @@ static void* gui_thread( void* _p )
         }
         break;
 
+      case SDL_KEYDOWN:
+        if( SDL_GetWindowID(p->window) == event.key.windowID ) {
+          t_parman_data* p_data = get_image_data( p->p_job );
+          int upd_iterations = iterations;
+
+          switch( event.key.keysym.sym ) {
+          case SDLK_p:
+            /* the grid stays as it is, only its colors change */
+            if( ! select_palette( p, p->palette + 1 ) ) {
+              recolor_image( p->p_job, get_palette( p->palette ) );
+              update = 1;
+            }
+            break;
+
+          case SDLK_s:
+            p->show_stats = ! p->show_stats;
+            update = 1;
+            break;
+
+          case SDLK_PLUS:
+          case SDLK_EQUALS:
+          case SDLK_KP_PLUS:
+            upd_iterations = ( 2 * iterations < PARMAN_MAX_ITERATIONS ) ? 2 * iterations : PARMAN_MAX_ITERATIONS;
+            break;
+
+          case SDLK_MINUS:
+          case SDLK_KP_MINUS:
+            upd_iterations = ( iterations / 2 > PARMAN_MIN_ITERATIONS ) ? iterations / 2 : PARMAN_MIN_ITERATIONS;
+            break;
+          }
+
+          /* counts up to a lower depth are known, only a higher one is iterated */
+          if( upd_iterations < iterations
+              && ! lower_iterations( p->p_job, upd_iterations, get_palette( p->palette ) ) ) {
+            iterations = upd_iterations;
+            log_message("coloring with %d iterations\n", iterations );
+            update = 1;
+          }
+          else if( upd_iterations != iterations ) {
+            iterations = upd_iterations;
+            log_message("rendering with %d iterations\n", iterations );
+            upd_width  = res_x * p_data->step_x;
+            upd_height = res_y * p_data->step_y;
+            upd_min_x = p_data->hp_x;
+            upd_min_y = p_data->hp_y;
+            p->p_job = change_view( p, res_x, res_y, & upd_min_x, & upd_min_y, upd_width, upd_height,
+                                    iterations );
+            update = 1;
+            if( p->p_job == NULL ) {
+              log_error("%s, %d: could create renderer error!\n", __func__, __LINE__ );
+              SDL_DestroyRenderer(p->renderer);
+              SDL_DestroyWindow(p->window);
+              SDL_Quit();
+              return NULL;
+            }
+          }
+        }
+        break;
+
       case SDL_WINDOWEVENT:
         if( event.window.event == SDL_WINDOWEVENT_RESIZED ) {
-          t_parman_data* p_data = get_image_data( p->p_threads );
+          t_parman_data* p_data = get_image_data( p->p_job );
+
+          /* keep origin and step, so that only the newly exposed strips are iterated */
           res_x = event.window.data1;
           res_y = event.window.data2;
-          if( res_y > res_x ) {
-            upd_width  = p_data->res_x * p_data->step_x;
-            upd_height = upd_width * res_y / res_x;
-          } else {
-            upd_height = p_data->res_y * p_data->step_y;
-            upd_width  = upd_height * res_x / res_y;
-          }
-          release_image( p->p_threads );
-          p->p_threads = render_image( res_x, res_y, p_data->init_x, p_data->init_y, upd_width, upd_height,
-                                       iterations, p->nr_threads );
+          upd_width  = res_x * p_data->step_x;
+          upd_height = res_y * p_data->step_y;
+          upd_min_x = p_data->hp_x;
+          upd_min_y = p_data->hp_y;
+          p->p_job = change_view( p, res_x, res_y, & upd_min_x, & upd_min_y, upd_width, upd_height,
+                                  iterations );
           update = 1;
-          if( p->p_threads == NULL ) {
+          if( p->p_job == NULL ) {
             log_error("%s, %d: could create renderer error!\n", __func__, __LINE__ );
             SDL_DestroyRenderer(p->renderer);
             SDL_DestroyWindow(p->window);
@@ -206,7 +430,9 @@ static void* gui_thread( void* _p )
     ++cnt;
   }
 
-  release_image( p->p_threads );
+  release_image( p->p_job );
+  if( p->texture )
+    SDL_DestroyTexture( p->texture );
   SDL_DestroyRenderer(p->renderer);
   SDL_DestroyWindow(p->window);
   SDL_Quit();
@@ -217,11 +443,13 @@ static void* gui_thread( void* _p )
 
 void release_gui( t_gui* p )
 {
-  release_colormap( p->p_rgb );
+  release_frame_cache( p->p_frame_cache );
+  release_pool_stats( p->p_stats );
   free( p );
 }
 
-t_gui* create_gui( const int nr_threads, const int iterations )
+t_gui* create_gui( t_thread_pool* p_pool, const int iterations, const int palette,
+                   const char* cost_map_path )
 {
   t_gui* p;
   int retcode;
@@ -239,16 +467,26 @@ t_gui* create_gui( const int nr_threads, const int iterations )
     return NULL;
   }
   memset( p, 0, sizeof(t_gui) );
-  p->nr_threads = nr_threads;
+  p->p_pool = p_pool;
   p->iterations = iterations;
+  p->cost_map_path = cost_map_path;
 
-  p->p_rgb = create_default_colormap( iterations + 1 );
-  if( p->p_rgb == NULL ) {
+  /* frames are colored by the workers */
+  if( select_palette( p, palette ) ) {
     log_error("%s, %d: out of memory error!\n", __func__, __LINE__ );
     free( p );
     return NULL;
   }
 
+  p->p_frame_cache = create_frame_cache( FRAME_CACHE_SIZE );
+  p->p_stats = create_pool_stats( p_pool );
+  if( p->p_frame_cache == NULL || p->p_stats == NULL ) {
+    release_frame_cache( p->p_frame_cache );
+    release_pool_stats( p->p_stats );
+    free( p );
+    return NULL;
+  }
+
 #ifdef __APPLE__
   gui_thread( p );
 #else
@@ -260,7 +498,8 @@ t_gui* create_gui( const int nr_threads, const int iterations )
 
   if( retcode ) {
     log_error( "%s, %d: could not create gui thread error!\n", __func__, __LINE__ );
-    release_colormap( p->p_rgb );
+    release_frame_cache( p->p_frame_cache );
+    release_pool_stats( p->p_stats );
     free( p );
     return NULL;
   }
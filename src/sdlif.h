@@ -12,6 +12,8 @@
 #include <SDL_events.h>
 #include <rendering.h>
 #include <colormap.h>
+#include <framecache.h>
+#include <stats.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,25 +23,34 @@ extern "C" {
 typedef struct {
   SDL_Window*           window;
   SDL_Renderer*         renderer;
+  SDL_Texture*          texture;        /*!< streaming texture of the image */
+  int                   texture_w;
+  int                   texture_h;
   pthread_t             gui_thread;
-  t_parman_threads*     p_threads;
-  int                   nr_threads;
+  t_parman_job*         p_job;
+  t_thread_pool*        p_pool;
+  t_frame_cache*        p_frame_cache;
+  t_pool_stats*         p_stats;        /*!< work of the threads on the current frame */
+  int                   stats_final;    /*!< frame complete, the statistics are not updated */
+  int                   show_stats;     /*!< draw the busy time of every thread */
+  const char*           cost_map_path;  /*!< cost map of every completed frame or NULL */
   int                   iterations;
-  t_rgb*                p_rgb;
+  int                   palette;        /*!< index of the built in palette in use */
   int                   done;
 } t_gui;
 
 
 typedef struct {
-  double                min_x;
-  double                min_y;
-  double                width;
-  double                height;
+  t_bigfix              min_x;
+  t_bigfix              min_y;
+  long double           width;
+  long double           height;
 } t_coord;
 
 
 void release_gui( t_gui* p );
-t_gui* create_gui( const int nr_threads, const int iterations );
+t_gui* create_gui( t_thread_pool* p_pool, const int iterations, const int palette,
+                   const char* cost_map_path );
 
 
 #ifdef __cplusplus
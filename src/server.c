@@ -0,0 +1,790 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <server.h>
+#include <cluster.h>
+#include <imagefile.h>
+#include <rendering.h>
+#include <colormap.h>
+#include <bignum.h>
+#include <log.h>
+
+/* level 0 tile, its upper left corner and its width */
+#define SERVER_WORLD_X        -2.5L
+#define SERVER_WORLD_Y        -2.0L
+#define SERVER_WORLD_WIDTH    4.0L
+
+/* seconds for a client to send its request or to take the answer */
+#define SERVER_IO_TIMEOUT     10
+
+/* longest request header which is read */
+#define SERVER_REQUEST_SIZE   4096
+
+/* number of hash buckets per tile of a typical size which fits into the budget */
+#define BUCKETS_PER_TILE      2
+#define TYPICAL_PNG_SIZE      ( 32 * 1024 )
+
+
+typedef struct {
+  int                   z;
+  long                  x;
+  long                  y;
+} t_map_tile;
+
+/* an encoded tile, shared by the cache and the answers being sent */
+typedef struct {
+  long                  refs;
+  long                  size;
+  unsigned char         data[];
+} t_png;
+
+typedef struct s_png_entry {
+  t_map_tile            key;
+  t_png*                p_png;
+  struct s_png_entry*   chain;          /*!< next entry in the same hash bucket */
+  struct s_png_entry*   older;
+  struct s_png_entry*   newer;
+} t_png_entry;
+
+/* a tile being rendered and the number of requests waiting for it */
+typedef struct s_pending {
+  t_map_tile            key;
+  int                   done;
+  int                   waiters;
+  t_png*                p_png;          /*!< NULL when the rendering failed */
+  struct s_pending*     next;
+} t_pending;
+
+typedef struct {
+  long                  requests;
+  long                  memory_hits;
+  long                  disk_hits;
+  long                  renders;
+  long                  coalesced;      /*!< requests which waited for another one */
+  long                  rejected;       /*!< connections answered with 503 */
+  long                  errors;
+} t_server_stats;
+
+typedef struct {
+  t_thread_pool*        p_pool;
+  int                   iterations;
+  char                  tile_dir[ 1024 ];       /*!< empty without disk cache */
+  int                   stop;
+  pthread_mutex_t       lock;           /*!< protects all members below */
+  pthread_cond_t        queued;
+  pthread_cond_t        rendered;
+  int                   queue[ SERVER_QUEUE ];
+  int                   head;
+  int                   nr_queued;
+  t_png_entry**         bucket;
+  int                   nr_buckets;
+  t_png_entry*          oldest;
+  t_png_entry*          newest;
+  long                  nr_cached;
+  long                  cached_bytes;
+  long                  budget;
+  t_pending*            pending;
+  t_server_stats        stats;
+} t_server;
+
+
+/* -- encoded tiles -- */
+
+static t_png* share_png( t_png* p_png )
+{
+  if( p_png )
+    __sync_add_and_fetch( & p_png->refs, 1 );
+
+  return p_png;
+}
+
+static void release_png( t_png* p_png )
+{
+  if( p_png && __sync_sub_and_fetch( & p_png->refs, 1 ) == 0 )
+    free( p_png );
+}
+
+static int same_tile( const t_map_tile* a, const t_map_tile* b )
+{
+  return a->z == b->z && a->x == b->x && a->y == b->y;
+}
+
+static unsigned long hash_tile( const t_map_tile* t )
+{
+  unsigned long hash = (unsigned long)t->x * 0x9e3779b97f4a7c15UL;
+
+  hash ^= (unsigned long)t->y * 0xc2b2ae3d27d4eb4fUL;
+  hash ^= (unsigned long)t->z * 0x165667b19e3779f9UL;
+
+  return hash ^ ( hash >> 29 );
+}
+
+
+/* -- memory cache, all functions are called with the lock held -- */
+
+#define ENTRY_SIZE( size )    ( (long)sizeof( t_png_entry ) + (long)sizeof( t_png ) + (size) )
+
+static t_png_entry** find_entry( t_server* p, const t_map_tile* t )
+{
+  t_png_entry** pp;
+
+  for( pp = & p->bucket[ hash_tile( t ) % p->nr_buckets ]; *pp; pp = & (*pp)->chain ) {
+    if( same_tile( & (*pp)->key, t ) )
+      break;
+  }
+
+  return pp;
+}
+
+static void unlink_lru( t_server* p, t_png_entry* p_entry )
+{
+  if( p_entry->older )
+    p_entry->older->newer = p_entry->newer;
+  else
+    p->oldest = p_entry->newer;
+
+  if( p_entry->newer )
+    p_entry->newer->older = p_entry->older;
+  else
+    p->newest = p_entry->older;
+}
+
+static void link_newest( t_server* p, t_png_entry* p_entry )
+{
+  p_entry->older = p->newest;
+  p_entry->newer = NULL;
+  if( p->newest )
+    p->newest->newer = p_entry;
+  else
+    p->oldest = p_entry;
+  p->newest = p_entry;
+}
+
+static void evict_oldest( t_server* p )
+{
+  t_png_entry* p_entry = p->oldest;
+  t_png_entry** pp = find_entry( p, & p_entry->key );
+
+  *pp = p_entry->chain;
+  unlink_lru( p, p_entry );
+
+  p->cached_bytes -= ENTRY_SIZE( p_entry->p_png->size );
+  --p->nr_cached;
+
+  release_png( p_entry->p_png );
+  free( p_entry );
+}
+
+static t_png* lookup_png( t_server* p, const t_map_tile* t )
+{
+  t_png_entry* p_entry = *find_entry( p, t );
+
+  if( p_entry == NULL )
+    return NULL;
+
+  unlink_lru( p, p_entry );
+  link_newest( p, p_entry );
+
+  return share_png( p_entry->p_png );
+}
+
+static void cache_png( t_server* p, const t_map_tile* t, t_png* p_png )
+{
+  t_png_entry** pp = find_entry( p, t );
+  t_png_entry* p_entry;
+
+  if( *pp || ENTRY_SIZE( p_png->size ) > p->budget )
+    return;
+
+  p_entry = malloc( sizeof( t_png_entry ) );
+  if( p_entry == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return;
+  }
+
+  p_entry->key = *t;
+  p_entry->p_png = share_png( p_png );
+  p_entry->chain = NULL;
+  *pp = p_entry;
+  link_newest( p, p_entry );
+
+  p->cached_bytes += ENTRY_SIZE( p_png->size );
+  ++p->nr_cached;
+
+  while( p->cached_bytes > p->budget )
+    evict_oldest( p );
+}
+
+
+/* -- disk cache -- */
+
+static t_png* load_tile( const t_server* p, const t_map_tile* t )
+{
+  char path[ 1100 ];
+  t_png* p_png;
+  FILE* fp;
+  long size;
+
+  if( ! p->tile_dir[0] )
+    return NULL;
+
+  snprintf( path, sizeof( path ), "%s/%d/%ld/%ld.png", p->tile_dir, t->z, t->x, t->y );
+  fp = fopen( path, "rb" );
+  if( fp == NULL )
+    return NULL;
+
+  if( fseek( fp, 0, SEEK_END ) || ( size = ftell( fp ) ) <= 0 || fseek( fp, 0, SEEK_SET ) ) {
+    fclose( fp );
+    return NULL;
+  }
+
+  p_png = malloc( sizeof( t_png ) + size );
+  if( p_png == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    fclose( fp );
+    return NULL;
+  }
+  p_png->refs = 1;
+  p_png->size = size;
+
+  if( fread( p_png->data, 1, size, fp ) != (size_t)size ) {
+    log_error("%s,%d: could not read %s!\n", __func__, __LINE__, path );
+    free( p_png );
+    p_png = NULL;
+  }
+  fclose( fp );
+
+  return p_png;
+}
+
+/*
+ * The tile is written to a temporary file which is renamed, so that
+ * neither a crash nor another server sharing the directory ever sees
+ * a partial file.
+ */
+static void save_tile( const t_server* p, const t_map_tile* t, const t_png* p_png )
+{
+  char path[ 1100 ], tmp_path[ 1120 ];
+  FILE* fp;
+  int retcode;
+
+  if( ! p->tile_dir[0] )
+    return;
+
+  snprintf( path, sizeof( path ), "%s/%d", p->tile_dir, t->z );
+  mkdir( path, 0755 );
+  snprintf( path, sizeof( path ), "%s/%d/%ld", p->tile_dir, t->z, t->x );
+  mkdir( path, 0755 );
+  snprintf( path, sizeof( path ), "%s/%d/%ld/%ld.png", p->tile_dir, t->z, t->x, t->y );
+  snprintf( tmp_path, sizeof( tmp_path ), "%s.%d.tmp", path, (int)getpid() );
+
+  fp = fopen( tmp_path, "wb" );
+  if( fp == NULL ) {
+    log_error("%s,%d: could not create %s error %s!\n", __func__, __LINE__, tmp_path, strerror( errno ) );
+    return;
+  }
+
+  retcode = fwrite( p_png->data, 1, p_png->size, fp ) != (size_t)p_png->size;
+  retcode |= fclose( fp );
+  if( retcode || rename( tmp_path, path ) ) {
+    log_error("%s,%d: could not write %s!\n", __func__, __LINE__, path );
+    unlink( tmp_path );
+  }
+}
+
+
+/* -- rendering -- */
+
+static t_png* encode_png( const t_parman_data* p_data )
+{
+  char* buf = NULL;
+  size_t size = 0;
+  t_image_file* p_file;
+  t_png* p_png;
+  FILE* fp;
+  int retcode;
+
+  fp = open_memstream( & buf, & size );
+  if( fp == NULL ) {
+    log_error("%s,%d: could not open memory stream!\n", __func__, __LINE__ );
+    return NULL;
+  }
+
+  p_file = create_image_stream( fp, IMAGE_FORMAT_PNG, p_data->res_x, p_data->res_y );
+  if( p_file == NULL ) {
+    free( buf );
+    return NULL;
+  }
+
+  retcode = write_image_band( p_file, p_data );
+  if( ! retcode )
+    retcode = finish_image_file( p_file );
+  release_image_file( p_file );
+
+  p_png = retcode ? NULL : malloc( sizeof( t_png ) + size );
+  if( p_png ) {
+    p_png->refs = 1;
+    p_png->size = size;
+    memcpy( p_png->data, buf, size );
+  }
+  else if( ! retcode )
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+  free( buf );
+
+  return p_png;
+}
+
+/*
+ * Pixel coordinates are multiples of a power of two, so the origin of
+ * every tile is exact at all zoom levels.
+ */
+static t_png* render_tile( t_server* p, const t_map_tile* t )
+{
+  const long double width = ldexpl( SERVER_WORLD_WIDTH, -t->z );
+  t_bigfix min_x, min_y;
+  t_parman_data* p_data;
+  t_parman_job* p_job;
+  t_png* p_png;
+
+  bigfix_from_ld( & min_x, SERVER_WORLD_X );
+  bigfix_add_ld( & min_x, & min_x, t->x * width );
+  bigfix_from_ld( & min_y, SERVER_WORLD_Y );
+  bigfix_add_ld( & min_y, & min_y, t->y * width );
+
+  p_data = create_parman_data_hp( SERVER_TILE_SIZE, SERVER_TILE_SIZE, & min_x, & min_y, width, width,
+                                  p->iterations );
+  if( p_data == NULL )
+    return NULL;
+
+  p_job = start_rendering( p_data, p->p_pool );
+  if( p_job == NULL ) {
+    release_parman_data( p_data );
+    return NULL;
+  }
+  if( wait_rendering( p_job ) ) {
+    log_error("%s,%d: rendering of tile %d/%ld/%ld failed!\n", __func__, __LINE__, t->z, t->x, t->y );
+    release_rendering( p_job );
+    release_parman_data( p_data );
+    return NULL;
+  }
+  release_rendering( p_job );
+
+  p_png = encode_png( p_data );
+  release_parman_data( p_data );
+
+  return p_png;
+}
+
+/*
+ * \return the tile from memory, from disk or freshly rendered, whose
+ * reference the caller has to release, or NULL on error
+ */
+static t_png* get_tile( t_server* p, const t_map_tile* t )
+{
+  t_pending *p_pending, **pp;
+  t_png* p_png;
+  int from_disk = 0;
+
+  pthread_mutex_lock( & p->lock );
+  p_png = lookup_png( p, t );
+  if( p_png ) {
+    ++p->stats.memory_hits;
+    pthread_mutex_unlock( & p->lock );
+    return p_png;
+  }
+
+  for( p_pending = p->pending; p_pending && ! same_tile( & p_pending->key, t ); p_pending = p_pending->next )
+    ;
+
+  if( p_pending ) {
+    /* another request renders this tile already */
+    ++p->stats.coalesced;
+    ++p_pending->waiters;
+    while( ! p_pending->done )
+      pthread_cond_wait( & p->rendered, & p->lock );
+
+    p_png = share_png( p_pending->p_png );
+    if( --p_pending->waiters == 0 ) {
+      release_png( p_pending->p_png );
+      free( p_pending );
+    }
+    pthread_mutex_unlock( & p->lock );
+    return p_png;
+  }
+
+  p_pending = calloc( 1, sizeof( t_pending ) );
+  if( p_pending == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    pthread_mutex_unlock( & p->lock );
+    return NULL;
+  }
+  p_pending->key = *t;
+  p_pending->next = p->pending;
+  p->pending = p_pending;
+  pthread_mutex_unlock( & p->lock );
+
+  p_png = load_tile( p, t );
+  if( p_png )
+    from_disk = 1;
+  else {
+    p_png = render_tile( p, t );
+    if( p_png )
+      save_tile( p, t, p_png );
+  }
+
+  pthread_mutex_lock( & p->lock );
+  if( p_png ) {
+    if( from_disk )
+      ++p->stats.disk_hits;
+    else
+      ++p->stats.renders;
+    cache_png( p, t, p_png );
+  }
+
+  for( pp = & p->pending; *pp != p_pending; pp = & (*pp)->next )
+    ;
+  *pp = p_pending->next;
+
+  p_pending->done = 1;
+  if( p_pending->waiters ) {
+    p_pending->p_png = share_png( p_png );
+    pthread_cond_broadcast( & p->rendered );
+  }
+  else
+    free( p_pending );
+  pthread_mutex_unlock( & p->lock );
+
+  return p_png;
+}
+
+
+/* -- HTTP -- */
+
+static void send_answer( const int fd, const char* status, const char* type, const char* extra,
+                         const void* body, const long size, const int head_only )
+{
+  char header[ 512 ];
+  int len;
+
+  len = snprintf( header, sizeof( header ),
+                  "HTTP/1.1 %s\r\n"
+                  "Content-Type: %s\r\n"
+                  "Content-Length: %ld\r\n"
+                  "Access-Control-Allow-Origin: *\r\n"
+                  "%s"
+                  "Connection: close\r\n\r\n",
+                  status, type, size, extra );
+
+  if( write_full( fd, header, len ) == 0 && ! head_only )
+    write_full( fd, body, size );
+}
+
+static void send_error( t_server* p, const int fd, const char* status, const char* extra )
+{
+  char body[ 64 ];
+
+  snprintf( body, sizeof( body ), "%s\n", status );
+  send_answer( fd, status, "text/plain", extra, body, strlen( body ), 0 );
+  __sync_fetch_and_add( & p->stats.errors, 1 );
+}
+
+static void send_stats( t_server* p, const int fd, const int head_only )
+{
+  char body[ 512 ];
+  int len;
+
+  pthread_mutex_lock( & p->lock );
+  len = snprintf( body, sizeof( body ),
+                  "{\"requests\":%ld,\"memory_hits\":%ld,\"disk_hits\":%ld,\"renders\":%ld,"
+                  "\"coalesced\":%ld,\"rejected\":%ld,\"errors\":%ld,\"queued\":%d,"
+                  "\"cached_tiles\":%ld,\"cached_bytes\":%ld,\"budget\":%ld}\n",
+                  p->stats.requests, p->stats.memory_hits, p->stats.disk_hits, p->stats.renders,
+                  p->stats.coalesced, p->stats.rejected, p->stats.errors, p->nr_queued,
+                  p->nr_cached, p->cached_bytes, p->budget );
+  pthread_mutex_unlock( & p->lock );
+
+  send_answer( fd, "200 OK", "application/json", "Cache-Control: no-store\r\n", body, len, head_only );
+}
+
+/*
+ * \return 0 when the path is /z/x/y, /z/x/y.png or either of them
+ * followed by a query, -1 otherwise
+ */
+static int parse_tile_path( const char* path, t_map_tile* t )
+{
+  char rest[ 16 ] = "";
+  int n;
+
+  n = sscanf( path, "/%d/%ld/%ld%15s", & t->z, & t->x, & t->y, rest );
+  if( n < 3 || ( rest[0] && rest[0] != '?' && strncmp( rest, ".png", 4 ) )
+      || ( ! strncmp( rest, ".png", 4 ) && rest[4] && rest[4] != '?' ) )
+    return -1;
+
+  if( t->z < 0 || t->z > SERVER_MAX_ZOOM || t->x < 0 || t->y < 0 || t->x >= ( 1L << t->z ) || t->y >= ( 1L << t->z ) )
+    return -1;
+
+  return 0;
+}
+
+/* \return length of the request header or -1 when the client has gone */
+static int read_request( const int fd, char* buf )
+{
+  ssize_t got;
+  int len = 0;
+
+  while( len < SERVER_REQUEST_SIZE ) {
+    got = recv( fd, buf + len, SERVER_REQUEST_SIZE - len, 0 );
+    if( got < 0 && errno == EINTR )
+      continue;
+    if( got <= 0 )
+      return -1;
+
+    len += got;
+    buf[ len ] = '\0';
+    if( strstr( buf, "\r\n\r\n" ) || strstr( buf, "\n\n" ) )
+      break;
+  }
+
+  return len;
+}
+
+static void serve_client( t_server* p, const int fd )
+{
+  const struct timeval timeout = { SERVER_IO_TIMEOUT, 0 };
+  char request[ SERVER_REQUEST_SIZE + 1 ];
+  char method[ 8 ], path[ 256 ];
+  t_map_tile tile;
+  t_png* p_png;
+  int head_only;
+
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, & timeout, sizeof( timeout ) );
+  setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, & timeout, sizeof( timeout ) );
+
+  if( read_request( fd, request ) < 0 )
+    return;
+  __sync_fetch_and_add( & p->stats.requests, 1 );
+
+  if( sscanf( request, "%7s %255s", method, path ) != 2 ) {
+    send_error( p, fd, "400 Bad Request", "" );
+    return;
+  }
+
+  head_only = ! strcmp( method, "HEAD" );
+  if( strcmp( method, "GET" ) && ! head_only ) {
+    send_error( p, fd, "405 Method Not Allowed", "Allow: GET, HEAD\r\n" );
+    return;
+  }
+
+  if( ! strcmp( path, "/stats" ) ) {
+    send_stats( p, fd, head_only );
+    return;
+  }
+
+  if( parse_tile_path( path, & tile ) ) {
+    send_error( p, fd, "404 Not Found", "" );
+    return;
+  }
+
+  p_png = get_tile( p, & tile );
+  if( p_png == NULL ) {
+    send_error( p, fd, "500 Internal Server Error", "" );
+    return;
+  }
+
+  send_answer( fd, "200 OK", "image/png", "Cache-Control: public, max-age=86400\r\n",
+               p_png->data, p_png->size, head_only );
+  release_png( p_png );
+}
+
+/*
+ * The request is drained as far as it has arrived, so that closing the
+ * connection does not reset it before the client has read the answer.
+ */
+static void reject_client( t_server* p, const int fd )
+{
+  char buf[ SERVER_REQUEST_SIZE ];
+
+  while( recv( fd, buf, sizeof( buf ), MSG_DONTWAIT ) > 0 )
+    ;
+
+  send_answer( fd, "503 Service Unavailable", "text/plain", "Retry-After: 1\r\n",
+               "503 Service Unavailable\n", 24, 0 );
+  __sync_fetch_and_add( & p->stats.rejected, 1 );
+}
+
+static void* handle_connections( void* p_arg )
+{
+  t_server* p = (t_server *)p_arg;
+  int fd;
+
+  for( ;; ) {
+    pthread_mutex_lock( & p->lock );
+    while( p->nr_queued == 0 && ! p->stop )
+      pthread_cond_wait( & p->queued, & p->lock );
+    if( p->nr_queued == 0 ) {
+      pthread_mutex_unlock( & p->lock );
+      break;
+    }
+    fd = p->queue[ p->head ];
+    p->head = ( p->head + 1 ) % SERVER_QUEUE;
+    --p->nr_queued;
+    pthread_mutex_unlock( & p->lock );
+
+    serve_client( p, fd );
+    close( fd );
+  }
+
+  return NULL;
+}
+
+
+/* -- server -- */
+
+static void release_server( t_server* p )
+{
+  if( p ) {
+    while( p->oldest )
+      evict_oldest( p );
+    pthread_cond_destroy( & p->rendered );
+    pthread_cond_destroy( & p->queued );
+    pthread_mutex_destroy( & p->lock );
+    free( p->bucket );
+    free( p );
+  }
+}
+
+static t_server* create_server( t_thread_pool* p_pool, const char* tile_dir, const long cache_budget,
+                                const int iterations, const t_palette* p_palette )
+{
+  t_server* p = malloc( sizeof( t_server ) );
+
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_server ) );
+
+  p->nr_buckets = BUCKETS_PER_TILE * ( cache_budget / ENTRY_SIZE( TYPICAL_PNG_SIZE ) ) + 1;
+  p->bucket = calloc( p->nr_buckets, sizeof( t_png_entry* ) );
+  if( p->bucket == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( p );
+    return NULL;
+  }
+
+  pthread_mutex_init( & p->lock, NULL );
+  pthread_cond_init( & p->queued, NULL );
+  pthread_cond_init( & p->rendered, NULL );
+  p->p_pool = p_pool;
+  p->iterations = iterations;
+  p->budget = cache_budget;
+
+  /* tiles of other palettes or iteration depths go to other directories */
+  if( tile_dir ) {
+    mkdir( tile_dir, 0755 );
+    snprintf( p->tile_dir, sizeof( p->tile_dir ), "%s/%s-%d%s", tile_dir, p_palette->name, iterations,
+              get_parman_options()->smooth ? "-smooth" : "" );
+    if( mkdir( p->tile_dir, 0755 ) && errno != EEXIST ) {
+      log_error("%s,%d: could not create directory %s error %s!\n", __func__, __LINE__, p->tile_dir,
+                strerror( errno ) );
+      release_server( p );
+      return NULL;
+    }
+  }
+
+  return p;
+}
+
+int start_server( t_thread_pool* p_pool, const char* address, const char* tile_dir, const long cache_budget,
+                  const int iterations, const int palette )
+{
+  const t_parman_options saved_options = *get_parman_options();
+  t_parman_options options = saved_options;
+  pthread_t handlers[ SERVER_HANDLERS ];
+  const t_palette* p_palette;
+  t_server* p;
+  int listen_fd, fd, i, nr_handlers;
+
+  p_palette = get_palette( palette );
+  if( p_palette == NULL )
+    return -1;
+
+  /* every tile is rendered once and colored by the worker threads */
+  options.progressive = 0;
+  options.p_tile_cache = NULL;
+  options.p_palette = p_palette;
+  set_parman_options( & options );
+
+  p = create_server( p_pool, tile_dir, cache_budget, iterations, p_palette );
+  if( p == NULL ) {
+    set_parman_options( & saved_options );
+    return -1;
+  }
+
+  listen_fd = open_socket( address, 1 );
+  if( listen_fd < 0 ) {
+    release_server( p );
+    set_parman_options( & saved_options );
+    return -1;
+  }
+
+  for( nr_handlers = 0; nr_handlers < SERVER_HANDLERS; ++nr_handlers ) {
+    if( pthread_create( & handlers[ nr_handlers ], NULL, handle_connections, p ) ) {
+      log_error("%s,%d: could not create handler thread!\n", __func__, __LINE__ );
+      break;
+    }
+  }
+
+  if( nr_handlers > 0 ) {
+    log_message("serving tiles at %s with %d rendering threads, tile cache of %ld MB%s%s\n", address,
+                p_pool->nr_threads, cache_budget >> 20, p->tile_dir[0] ? " and " : "", p->tile_dir );
+
+    for( ;; ) {
+      fd = accept( listen_fd, NULL, NULL );
+      if( fd < 0 ) {
+        if( errno == EINTR || errno == ECONNABORTED )
+          continue;
+        log_error("%s,%d: could not accept connection error %s!\n", __func__, __LINE__, strerror( errno ) );
+        break;
+      }
+
+      pthread_mutex_lock( & p->lock );
+      if( p->nr_queued == SERVER_QUEUE ) {
+        pthread_mutex_unlock( & p->lock );
+        reject_client( p, fd );
+        close( fd );
+        continue;
+      }
+      p->queue[ ( p->head + p->nr_queued ) % SERVER_QUEUE ] = fd;
+      ++p->nr_queued;
+      pthread_cond_signal( & p->queued );
+      pthread_mutex_unlock( & p->lock );
+    }
+  }
+
+  pthread_mutex_lock( & p->lock );
+  p->stop = 1;
+  pthread_cond_broadcast( & p->queued );
+  pthread_mutex_unlock( & p->lock );
+  for( i=0; i < nr_handlers; ++i )
+    pthread_join( handlers[i], NULL );
+
+  close( listen_fd );
+  release_server( p );
+  set_parman_options( & saved_options );
+
+  return -1;
+}
@@ -0,0 +1,64 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <scheduler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file server.h
+    \brief map tiles served over HTTP
+
+    The server answers GET /z/x/y.png with a PNG image of
+    SERVER_TILE_SIZE pixels like the tiles of a slippy map: the single
+    tile of level 0 covers the real range [-2.5, 1.5] and the imaginary
+    range [-2, 2], each level halves the width, x counts to the right and
+    y downwards from the upper left corner.
+
+    Encoded tiles are kept in memory within a byte budget and evicting
+    the least recently used ones, and optionally in a directory of
+    z/x/y.png files which survives restarts. Concurrent requests for a
+    tile which is being rendered wait for that rendering instead of
+    starting their own. Accepted connections are queued for a fixed
+    number of handler threads; when SERVER_QUEUE connections are waiting
+    new ones are answered with 503 at once, so that clients back off
+    instead of piling up. GET /stats returns the counters as JSON.
+ */
+
+/*! edge length of a map tile in pixels */
+#define SERVER_TILE_SIZE      256
+
+/*! deepest zoom level, tiles are then about 3.5e-18 wide */
+#define SERVER_MAX_ZOOM       60
+
+/*! threads which read requests and answer them */
+#define SERVER_HANDLERS       8
+
+/*! connections waiting for a handler before new ones are rejected */
+#define SERVER_QUEUE          64
+
+
+/*!
+ * serve map tiles at the given address, a port, host:port or
+ * unix:/path, until an error occurs; the tile directory is optional,
+ * the budget is given in bytes
+ *
+ * \return -1 on error
+ */
+int start_server( t_thread_pool* p_pool, const char* address, const char* tile_dir, const long cache_budget,
+                  const int iterations, const int palette );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef SERVER_H */
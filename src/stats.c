@@ -0,0 +1,212 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stats.h>
+#include <log.h>
+
+
+void release_pool_stats( t_pool_stats* p )
+{
+  if( p ) {
+    free( p->worker );
+    free( p->start );
+    free( p );
+  }
+}
+
+t_pool_stats* create_pool_stats( const t_thread_pool* p_pool )
+{
+  t_pool_stats* p = malloc( sizeof( t_pool_stats ) );
+
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_pool_stats ) );
+
+  p->nr_workers = p_pool->nr_threads;
+  p->worker = calloc( p->nr_workers, sizeof( t_worker_stats ) );
+  p->start = calloc( p->nr_workers, sizeof( t_worker_stats ) );
+  if( p->worker == NULL || p->start == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    release_pool_stats( p );
+    return NULL;
+  }
+
+  reset_pool_stats( p, p_pool );
+
+  return p;
+}
+
+void reset_pool_stats( t_pool_stats* p, const t_thread_pool* p_pool )
+{
+  get_worker_stats( p_pool, p->start );
+  p->start_ns = get_time_ns();
+  p->wall_ns = 0;
+  memset( & p->total, 0, sizeof( t_worker_stats ) );
+  memset( p->worker, 0, p->nr_workers * sizeof( t_worker_stats ) );
+}
+
+void update_pool_stats( t_pool_stats* p, const t_thread_pool* p_pool )
+{
+  t_worker_stats *w, *s, *t = & p->total;
+  int i;
+
+  get_worker_stats( p_pool, p->worker );
+  p->wall_ns = get_time_ns() - p->start_ns;
+  memset( t, 0, sizeof( t_worker_stats ) );
+
+  for( i=0; i < p->nr_workers; ++i ) {
+    w = & p->worker[i];
+    s = & p->start[i];
+    w->tiles -= s->tiles;
+    w->steals -= s->steals;
+    w->busy_ns -= s->busy_ns;
+    w->pixels -= s->pixels;
+    w->iterations -= s->iterations;
+    w->escaped -= s->escaped;
+    w->interior -= s->interior;
+
+    /* more threads than processors are also busy while preempted */
+    w->idle_ns = ( p->wall_ns > w->busy_ns ) ? p->wall_ns - w->busy_ns : 0;
+
+    t->tiles += w->tiles;
+    t->steals += w->steals;
+    t->busy_ns += w->busy_ns;
+    t->idle_ns += w->idle_ns;
+    t->pixels += w->pixels;
+    t->iterations += w->iterations;
+    t->escaped += w->escaped;
+    t->interior += w->interior;
+  }
+}
+
+double get_giterations_per_s( const t_pool_stats* p )
+{
+  return p->wall_ns > 0 ? (double)p->total.iterations / p->wall_ns : 0;
+}
+
+double get_busy_share( const t_pool_stats* p )
+{
+  const double available = (double)p->wall_ns * p->nr_workers;
+  const double share = available > 0 ? p->total.busy_ns / available : 0;
+
+  return share < 1 ? share : 1;
+}
+
+void log_pool_stats( const t_pool_stats* p )
+{
+  const t_worker_stats* w;
+  int i;
+
+  log_message("%d workers in %.3f s: %.2f Mpixel/s, %.3f Giteration/s, %.0f%% busy, %ld tiles, %ld stolen\n",
+              p->nr_workers, 1e-9 * p->wall_ns, p->wall_ns > 0 ? 1e3 * p->total.pixels / p->wall_ns : 0.0,
+              get_giterations_per_s( p ), 100 * get_busy_share( p ), p->total.tiles, p->total.steals );
+
+  for( i=0; i < p->nr_workers; ++i ) {
+    w = & p->worker[i];
+    log_message("  worker %2d: %6ld tiles, %5ld stolen, %8.3f s busy, %8.3f s idle, %9ld pixels "
+                "(%ld escaped, %ld interior), %ld iterations\n",
+                i, w->tiles, w->steals, 1e-9 * w->busy_ns, 1e-9 * w->idle_ns, w->pixels, w->escaped,
+                w->interior, w->iterations );
+  }
+}
+
+static void write_worker_json( FILE* fp, const t_worker_stats* w )
+{
+  fprintf( fp, "{ \"tiles\": %ld, \"steals\": %ld, \"busy_s\": %.6f, \"idle_s\": %.6f, \"pixels\": %ld, "
+           "\"iterations\": %ld, \"escaped\": %ld, \"interior\": %ld }",
+           w->tiles, w->steals, 1e-9 * w->busy_ns, 1e-9 * w->idle_ns, w->pixels, w->iterations,
+           w->escaped, w->interior );
+}
+
+int write_pool_stats( const t_pool_stats* p, const char* path )
+{
+  FILE* fp = fopen( path, "w" );
+  int i;
+
+  if( fp == NULL ) {
+    log_error("%s,%d: could not create file %s!\n", __func__, __LINE__, path );
+    return -1;
+  }
+
+  fprintf( fp, "{\n" );
+  fprintf( fp, "  \"wall_s\": %.6f,\n", 1e-9 * p->wall_ns );
+  fprintf( fp, "  \"workers\": %d,\n", p->nr_workers );
+  fprintf( fp, "  \"giterations_per_s\": %.4f,\n", get_giterations_per_s( p ) );
+  fprintf( fp, "  \"busy_share\": %.4f,\n", get_busy_share( p ) );
+  fprintf( fp, "  \"total\": " );
+  write_worker_json( fp, & p->total );
+  fprintf( fp, ",\n  \"per_worker\": [\n" );
+  for( i=0; i < p->nr_workers; ++i ) {
+    fprintf( fp, "    " );
+    write_worker_json( fp, & p->worker[i] );
+    fprintf( fp, "%s\n", i + 1 < p->nr_workers ? "," : "" );
+  }
+  fprintf( fp, "  ]\n}\n" );
+
+  if( fclose( fp ) ) {
+    log_error("%s,%d: could not write file %s!\n", __func__, __LINE__, path );
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * Time stamps of trace events are given in microseconds, each worker
+ * is shown as a thread of its own.
+ */
+int write_trace( const t_thread_pool* p_pool, const char* path )
+{
+  const t_trace_event* e;
+  FILE* fp;
+  long i, nr_events = 0, dropped = 0;
+  int w, first = 1;
+
+  if( p_pool->trace == NULL ) {
+    log_error("%s,%d: no trace has been started!\n", __func__, __LINE__ );
+    return -1;
+  }
+
+  fp = fopen( path, "w" );
+  if( fp == NULL ) {
+    log_error("%s,%d: could not create file %s!\n", __func__, __LINE__, path );
+    return -1;
+  }
+
+  fprintf( fp, "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+  for( w=0; w < p_pool->nr_threads; ++w ) {
+    fprintf( fp, "%s  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+             "\"args\": { \"name\": \"worker %d\" } }", first ? "" : ",\n", w, w );
+    first = 0;
+
+    for( i=0; i < p_pool->trace[w].nr_events; ++i ) {
+      e = & p_pool->trace[w].events[i];
+      fprintf( fp, ",\n  { \"name\": \"pass %d\", \"cat\": \"tile\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+               "\"ts\": %.3f, \"dur\": %.3f, \"args\": { \"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d } }",
+               e->tile.pass, w, 1e-3 * e->start_ns, 1e-3 * e->duration_ns,
+               e->tile.x, e->tile.y, e->tile.w, e->tile.h );
+    }
+    nr_events += p_pool->trace[w].nr_events;
+    dropped += p_pool->trace[w].dropped;
+  }
+  fprintf( fp, "\n] }\n" );
+
+  if( fclose( fp ) ) {
+    log_error("%s,%d: could not write file %s!\n", __func__, __LINE__, path );
+    return -1;
+  }
+
+  log_message("trace of %ld tiles written to %s%s\n", nr_events, path,
+              dropped ? ", later tiles dropped" : "" );
+
+  return 0;
+}
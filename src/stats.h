@@ -0,0 +1,96 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <scheduler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file stats.h
+    \brief where the time of the worker threads goes
+
+    Every worker of the thread pool counts its tiles, stolen tiles, busy
+    time and the pixels and iterations of the spans it has iterated. A
+    t_pool_stats takes these counters at the start of an interval, e.g.
+    a frame, and gives the work of each worker within the interval. The
+    idle time of a worker is the part of the interval in which it has
+    not processed any tile, be it for lack of work or for waiting on
+    locks. The result can be logged or written as JSON.
+
+    A trace of all tiles, see start_trace(), is written in the Chrome
+    trace event format which chrome://tracing or Perfetto show as one
+    timeline per worker.
+ */
+
+typedef struct {
+  int                   nr_workers;
+  long                  start_ns;
+  long                  wall_ns;        /*!< length of the interval */
+  t_worker_stats        total;
+  t_worker_stats*       worker;         /*!< work of each worker within the interval */
+  t_worker_stats*       start;          /*!< counters at the start of the interval */
+} t_pool_stats;
+
+
+void release_pool_stats( t_pool_stats* p );
+
+/*!
+ * start an interval now
+ *
+ * \return statistics or NULL on error
+ */
+t_pool_stats* create_pool_stats( const t_thread_pool* p_pool );
+
+/*!
+ * start a new interval now
+ */
+void reset_pool_stats( t_pool_stats* p, const t_thread_pool* p_pool );
+
+/*!
+ * compute the work of the workers from the start of the interval until now
+ */
+void update_pool_stats( t_pool_stats* p, const t_thread_pool* p_pool );
+
+/*!
+ * \return executed iterations per second in billions
+ */
+double get_giterations_per_s( const t_pool_stats* p );
+
+/*!
+ * \return share of the interval which the workers have been busy, 0 to 1
+ */
+double get_busy_share( const t_pool_stats* p );
+
+/*!
+ * log totals and one line per worker
+ */
+void log_pool_stats( const t_pool_stats* p );
+
+/*!
+ * write totals and the counters of each worker as JSON
+ *
+ * \return 0 on success, -1 on error
+ */
+int write_pool_stats( const t_pool_stats* p, const char* path );
+
+/*!
+ * write the tiles recorded since start_trace() as Chrome trace events
+ *
+ * \return 0 on success, -1 on error
+ */
+int write_trace( const t_thread_pool* p_pool, const char* path );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef STATS_H */
@@ -0,0 +1,219 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tilecache.h>
+#include <scheduler.h>
+#include <log.h>
+
+/* number of hash buckets per tile which fits into the budget */
+#define BUCKETS_PER_TILE      2
+
+#define ENTRY_SIZE( w, h )    ( sizeof( t_tile_entry ) + (long)(w) * (h) * sizeof( int ) )
+
+
+void release_tile_cache( t_tile_cache* p )
+{
+  t_tile_entry *p_entry, *p_older;
+
+  if( p ) {
+    for( p_entry = p->newest; p_entry; p_entry = p_older ) {
+      p_older = p_entry->older;
+      free( p_entry->pixels );
+      free( p_entry );
+    }
+    pthread_mutex_destroy( & p->lock );
+    free( p->bucket );
+    free( p );
+  }
+}
+
+t_tile_cache* create_tile_cache( const long budget )
+{
+  t_tile_cache* p = malloc( sizeof( t_tile_cache ) );
+
+  if( p == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    return NULL;
+  }
+  memset( p, 0, sizeof( t_tile_cache ) );
+
+  p->nr_buckets = BUCKETS_PER_TILE * ( budget / ENTRY_SIZE( TILE_SIZE, TILE_SIZE ) ) + 1;
+  p->bucket = calloc( p->nr_buckets, sizeof( t_tile_entry* ) );
+  if( p->bucket == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( p );
+    return NULL;
+  }
+
+  pthread_mutex_init( & p->lock, NULL );
+  p->stats.budget = budget;
+
+  return p;
+}
+
+void init_tile_key( t_tile_key* p_key, const t_bigfix* c_re, const t_bigfix* c_im,
+                    const long double step_x, const long double step_y,
+                    const int w, const int h, const int iterations, const int precision )
+{
+  memset( p_key, 0, sizeof( t_tile_key ) );
+  p_key->c_re = *c_re;
+  p_key->c_im = *c_im;
+  p_key->step_x = step_x;
+  p_key->step_y = step_y;
+  p_key->w = w;
+  p_key->h = h;
+  p_key->iterations = iterations;
+  p_key->precision = precision;
+}
+
+/* FNV-1a over the key bytes, long double padding has been cleared by init_tile_key() */
+static unsigned long hash_key( const t_tile_key* p_key )
+{
+  const unsigned char* p = (const unsigned char *)p_key;
+  unsigned long hash = 14695981039346656037UL;
+  size_t i;
+
+  for( i=0; i < sizeof( t_tile_key ); ++i ) {
+    hash ^= p[i];
+    hash *= 1099511628211UL;
+  }
+
+  return hash;
+}
+
+static t_tile_entry* find_entry( t_tile_cache* p, const t_tile_key* p_key, const unsigned long hash )
+{
+  t_tile_entry* p_entry;
+
+  for( p_entry = p->bucket[ hash % p->nr_buckets ]; p_entry; p_entry = p_entry->chain ) {
+    if( p_entry->hash == hash && ! memcmp( & p_entry->key, p_key, sizeof( t_tile_key ) ) )
+      return p_entry;
+  }
+
+  return NULL;
+}
+
+static void unlink_lru( t_tile_cache* p, t_tile_entry* p_entry )
+{
+  if( p_entry->older )
+    p_entry->older->newer = p_entry->newer;
+  else
+    p->oldest = p_entry->newer;
+
+  if( p_entry->newer )
+    p_entry->newer->older = p_entry->older;
+  else
+    p->newest = p_entry->older;
+}
+
+static void link_newest( t_tile_cache* p, t_tile_entry* p_entry )
+{
+  p_entry->older = p->newest;
+  p_entry->newer = NULL;
+  if( p->newest )
+    p->newest->newer = p_entry;
+  else
+    p->oldest = p_entry;
+  p->newest = p_entry;
+}
+
+static void evict_oldest( t_tile_cache* p )
+{
+  t_tile_entry* p_entry = p->oldest;
+  t_tile_entry** pp;
+
+  for( pp = & p->bucket[ p_entry->hash % p->nr_buckets ]; *pp != p_entry; pp = & (*pp)->chain )
+    ;
+  *pp = p_entry->chain;
+  unlink_lru( p, p_entry );
+
+  p->stats.bytes -= ENTRY_SIZE( p_entry->key.w, p_entry->key.h );
+  --p->stats.nr_tiles;
+  ++p->stats.evictions;
+
+  free( p_entry->pixels );
+  free( p_entry );
+}
+
+int lookup_tile( t_tile_cache* p, const t_tile_key* p_key, int* grid, const int stride )
+{
+  const unsigned long hash = hash_key( p_key );
+  t_tile_entry* p_entry;
+  int y;
+
+  pthread_mutex_lock( & p->lock );
+  p_entry = find_entry( p, p_key, hash );
+  if( p_entry == NULL ) {
+    ++p->stats.misses;
+    pthread_mutex_unlock( & p->lock );
+    return 0;
+  }
+
+  for( y=0; y < p_key->h; ++y )
+    memcpy( & grid[ y * stride ], & p_entry->pixels[ y * p_key->w ], p_key->w * sizeof( int ) );
+
+  unlink_lru( p, p_entry );
+  link_newest( p, p_entry );
+  ++p->stats.hits;
+  pthread_mutex_unlock( & p->lock );
+
+  return 1;
+}
+
+void store_tile( t_tile_cache* p, const t_tile_key* p_key, const int* grid, const int stride )
+{
+  const unsigned long hash = hash_key( p_key );
+  const long size = ENTRY_SIZE( p_key->w, p_key->h );
+  t_tile_entry* p_entry;
+  int y;
+
+  if( size > p->stats.budget )
+    return;
+
+  p_entry = malloc( sizeof( t_tile_entry ) );
+  if( p_entry )
+    p_entry->pixels = malloc( p_key->w * p_key->h * sizeof( int ) );
+  if( p_entry == NULL || p_entry->pixels == NULL ) {
+    log_error("%s,%d: out of memory error!\n", __func__, __LINE__ );
+    free( p_entry );
+    return;
+  }
+
+  p_entry->key = *p_key;
+  p_entry->hash = hash;
+  for( y=0; y < p_key->h; ++y )
+    memcpy( & p_entry->pixels[ y * p_key->w ], & grid[ y * stride ], p_key->w * sizeof( int ) );
+
+  pthread_mutex_lock( & p->lock );
+  if( find_entry( p, p_key, hash ) ) {
+    /* stored concurrently by another frame */
+    pthread_mutex_unlock( & p->lock );
+    free( p_entry->pixels );
+    free( p_entry );
+    return;
+  }
+
+  while( p->stats.bytes + size > p->stats.budget )
+    evict_oldest( p );
+
+  p_entry->chain = p->bucket[ hash % p->nr_buckets ];
+  p->bucket[ hash % p->nr_buckets ] = p_entry;
+  link_newest( p, p_entry );
+  p->stats.bytes += size;
+  ++p->stats.nr_tiles;
+  pthread_mutex_unlock( & p->lock );
+}
+
+void get_tile_cache_stats( t_tile_cache* p, t_tile_cache_stats* p_stats )
+{
+  pthread_mutex_lock( & p->lock );
+  *p_stats = p->stats;
+  pthread_mutex_unlock( & p->lock );
+}
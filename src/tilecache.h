@@ -0,0 +1,106 @@
+/*
+ * Parallel Rendering of the Mandelbrot Set
+ *
+ * Created by Otto Linnemann
+ * Copyright 2019 GNU General Public Licence. All rights reserved
+ */
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <pthread.h>
+#include <bignum.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \file tilecache.h
+    \brief iteration counts of rendered tiles shared between frames
+
+    Tiles are addressed by content: the exact coordinate of their upper
+    left pixel, step, size, kernel tier and iteration depth. Frames
+    which share tiles of the same pixel lattice, e.g. after panning by
+    whole tiles or when revisiting an area, take them from the cache
+    instead of iterating them again. The least recently used tiles are
+    evicted when the byte budget is exceeded. All functions are thread
+    safe.
+ */
+
+
+typedef struct {
+  t_bigfix              c_re;           /*!< real part of the upper left pixel */
+  t_bigfix              c_im;           /*!< imaginary part of the upper left pixel */
+  long double           step_x;
+  long double           step_y;
+  int                   w;
+  int                   h;
+  int                   iterations;
+  int                   precision;
+} t_tile_key;
+
+
+typedef struct s_tile_entry {
+  t_tile_key            key;
+  unsigned long         hash;
+  int*                  pixels;
+  struct s_tile_entry*  chain;          /*!< next entry in the same hash bucket */
+  struct s_tile_entry*  older;
+  struct s_tile_entry*  newer;
+} t_tile_entry;
+
+
+typedef struct {
+  long                  hits;
+  long                  misses;
+  long                  evictions;
+  long                  nr_tiles;
+  long                  bytes;
+  long                  budget;
+} t_tile_cache_stats;
+
+
+typedef struct {
+  pthread_mutex_t       lock;
+  t_tile_entry**        bucket;
+  int                   nr_buckets;
+  t_tile_entry*         oldest;
+  t_tile_entry*         newest;
+  t_tile_cache_stats    stats;
+} t_tile_cache;
+
+
+void release_tile_cache( t_tile_cache* p );
+
+/*!
+ * create a cache which holds at most budget bytes of tiles
+ */
+t_tile_cache* create_tile_cache( const long budget );
+
+/*!
+ * set up the key of a tile, padding bytes are cleared for hashing
+ */
+void init_tile_key( t_tile_key* p_key, const t_bigfix* c_re, const t_bigfix* c_im,
+                    const long double step_x, const long double step_y,
+                    const int w, const int h, const int iterations, const int precision );
+
+/*!
+ * copy the cached pixels of a tile into a grid with the given row length
+ *
+ * \return 1 on a hit, 0 when the tile is not cached
+ */
+int lookup_tile( t_tile_cache* p, const t_tile_key* p_key, int* grid, const int stride );
+
+/*!
+ * store the pixels of a tile from a grid with the given row length
+ */
+void store_tile( t_tile_cache* p, const t_tile_key* p_key, const int* grid, const int stride );
+
+void get_tile_cache_stats( t_tile_cache* p, t_tile_cache_stats* p_stats );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TILECACHE_H */